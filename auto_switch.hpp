@@ -0,0 +1,254 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file auto_switch.hpp
+
+   \brief Contains a driver that automatically switches between explicit
+   and implicit RK methods depending on the stiffness of the problem.
+*/
+
+#ifndef AUTO_SWITCH_HPP
+#define AUTO_SWITCH_HPP
+
+#include "enums.hpp"
+#include "erk.hpp"
+#include "irk.hpp"
+#include "my_timer.hpp"
+#include "newton.hpp"
+#include "options.hpp"
+#include "output.hpp"
+
+
+/**
+   \brief Contains an integrator that switches between explicit and implicit
+   methods (a la LSODA).
+
+   Integration starts with an explicit method. Once it detects stiffness,
+   the integration continues with an implicit method until the problem
+   appears non-stiff again, after which the explicit method takes over.
+*/
+namespace auto_switch {
+
+typedef arma::vec vec_type;
+typedef arma::mat mat_type;
+
+
+/**
+   \brief options for the switching integrator.
+*/
+struct solver_options : common_solver_options {
+
+	/// \brief Constructor with default values.
+	solver_options() : erk_method(erk::DORMAND_PRINCE_54),
+	                   irk_method(irk::RADAU_IIA_53),
+	                   stiffness_bound(3.25),
+	                   max_switches(-1)
+	{ }
+
+	~solver_options()
+	{ }
+
+	/// The explicit method to use in non-stiff regions.
+	int erk_method;
+
+	/// The implicit method to use in stiff regions.
+	int irk_method;
+
+	/// Bound on dt*rho that decides whether the problem is stiff.
+	/// See erk::solver_options::stiffness_bound.
+	double stiffness_bound;
+
+	/// Maximum number of switches (negative to allow infinite).
+	/// After the last switch the current method is used until t1.
+	int max_switches;
+};
+
+
+/**
+   \brief The output of the switching integrator.
+*/
+struct switch_output : basic_output
+{
+	struct counters {
+		counters() : attempt(0), erk_steps(0), irk_steps(0),
+		             fun_evals(0), jac_evals(0), switches(0) {}
+
+		std::size_t attempt, erk_steps, irk_steps;
+		std::size_t fun_evals, jac_evals;
+		std::size_t switches;
+	};
+
+	/// Times at which the integrator switched method.
+	std::vector<double> switch_times;
+
+	/// Whether an implicit method was used from the time in switch_times.
+	std::vector<bool> switch_to_stiff;
+
+	double elapsed_time;
+
+	counters count;
+};
+
+
+/**
+   \brief Appends the solution points of sol after time t to out.
+*/
+template <typename rk_output> inline
+void append_solution(switch_output &out, const rk_output &sol, double t)
+{
+	for (std::size_t i = 0; i < sol.t_vals.size(); ++i) {
+		if (sol.t_vals[i] <= t) continue;
+		out.t_vals.push_back(sol.t_vals[i]);
+		out.y_vals.push_back(sol.y_vals[i]);
+	}
+}
+
+
+/**
+   \brief Time-integrate a given ODE from t0 to t1, starting at y0, switching
+   between an explicit and an implicit method depending on stiffness.
+
+   \param func         Functor of the ODE to integrate
+   \param t0           Starting time
+   \param t1           Final time
+   \param y0           Initial values
+   \param solver_opts  Options for the integrator. If newton_opts is not set,
+                       default Newton options are used.
+   \param dt           Initial time step size. If <= 0, it is estimated.
+
+   \returns a struct with the solution and info about the solution quality.
+*/
+template <typename functor_type> inline
+switch_output odeint(functor_type &func, double t0, double t1,
+                     const vec_type &y0, const solver_options &solver_opts,
+                     double dt = 0.0)
+{
+	my_timer timer;
+	switch_output sol;
+	sol.status = SUCCESS;
+	if (!solver_opts.abs_tols_match(y0.size())) {
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: abs_tols needs one entry per "
+			          << "equation!\n";
+		}
+		sol.status = GENERAL_ERROR;
+		return sol;
+	}
+
+	newton::options n_opts;
+	n_opts.tol = 0.1*std::min(solver_opts.min_abs_tol(),
+	                          solver_opts.rel_tol);
+
+	erk::solver_options e_opts;
+	irk::solver_options i_opts;
+	static_cast<common_solver_options&>(e_opts) = solver_opts;
+	static_cast<common_solver_options&>(i_opts) = solver_opts;
+	if (!i_opts.newton_opts) i_opts.newton_opts = &n_opts;
+
+	e_opts.stiffness_bound = solver_opts.stiffness_bound;
+	i_opts.stiffness_bound = solver_opts.stiffness_bound;
+
+	erk::solver_coeffs esc = erk::get_coefficients(solver_opts.erk_method);
+	irk::solver_coeffs isc = irk::get_coefficients(solver_opts.irk_method);
+	assert( erk::verify_solver_coeffs( esc ) && "Invalid ERK coefficients!" );
+	assert( irk::verify_solver_coeffs( isc ) && "Invalid IRK coefficients!" );
+
+	double t = t0;
+	vec_type y = y0;
+	bool stiff = false;
+	sol.t_vals.push_back(t);
+	sol.y_vals.push_back(y);
+
+	while (t < t1) {
+		bool may_switch = solver_opts.max_switches < 0 ||
+			static_cast<int>(sol.count.switches) < solver_opts.max_switches;
+		int status = SUCCESS;
+
+		if (stiff) {
+			i_opts.detect_nonstiffness = may_switch;
+			irk::rk_output part = irk::irk_guts(func, t, t1, y, i_opts,
+			                                    dt, isc);
+			append_solution(sol, part, t);
+			sol.count.attempt   += part.count.attempt;
+			sol.count.irk_steps += part.count.steps;
+			sol.count.fun_evals += part.count.fun_evals;
+			sol.count.jac_evals += part.count.jac_evals;
+			status = part.status;
+			dt = part.next_dt;
+		} else {
+			e_opts.detect_stiffness = may_switch;
+			erk::rk_output part = erk::erk_guts(func, t, t1, y, e_opts,
+			                                    dt, esc);
+			append_solution(sol, part, t);
+			sol.count.attempt   += part.count.attempt;
+			sol.count.erk_steps += part.t_vals.size() - 1;
+			sol.count.fun_evals += part.count.fun_evals;
+			status = part.status;
+			dt = part.next_dt;
+		}
+
+		if (status != SUCCESS &&
+		    status != STIFFNESS_DETECTED &&
+		    status != NONSTIFFNESS_DETECTED) {
+			sol.status = status;
+			break;
+		}
+
+		t = sol.t_vals.back();
+		y = sol.y_vals.back();
+
+		if (status != SUCCESS) {
+			stiff = !stiff;
+			++sol.count.switches;
+			sol.switch_times.push_back(t);
+			sol.switch_to_stiff.push_back(stiff);
+		}
+	}
+
+	sol.elapsed_time = timer.toc();
+	return sol;
+}
+
+
+/**
+   \brief Time-integrate a given ODE from t0 to t1, starting at y0, with the
+   default switching options.
+
+   \param func         Functor of the ODE to integrate
+   \param t0           Starting time
+   \param t1           Final time
+   \param y0           Initial values
+
+   \returns a struct with the solution and info about the solution quality.
+*/
+template <typename functor_type> inline
+switch_output odeint(functor_type &func, double t0, double t1,
+                     const vec_type &y0)
+{
+	solver_options s_opts;
+	return odeint(func, t0, t1, y0, s_opts);
+}
+
+
+} // namespace auto_switch
+
+
+#endif // AUTO_SWITCH_HPP
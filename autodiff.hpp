@@ -0,0 +1,381 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file autodiff.hpp
+
+   \brief Forward-mode automatic differentiation for exact Jacobi matrices.
+*/
+
+#ifndef AUTODIFF_HPP
+#define AUTODIFF_HPP
+
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "arma_include.hpp"
+#include "functor_traits.hpp"
+#include "jacobian.hpp"
+
+
+/**
+   \brief Contains dual numbers and a functor adapter that uses them to
+   compute exact Jacobi matrices.
+
+   Instead of writing fun and jac, write the RHS once as a template:
+   \code{
+     struct my_ode
+     {
+       template <typename T>
+       void fun_generic(double t, const std::vector<T> &y,
+                        std::vector<T> &dy)
+       {
+         using std::sin;
+         dy[0] = y[1];
+         dy[1] = -sin(y[0]);
+       }
+     };
+   \code}
+   dy has as many elements as y. Use unqualified calls to the math
+   functions (after using std::sin and the like), so that the overloads
+   for dual numbers are found. If such a functor has no jac, irk computes
+   the Jacobi matrix with ad_functor by itself.
+*/
+namespace autodiff {
+
+
+/**
+   \brief A value with derivatives in K directions at once.
+*/
+template <std::size_t K>
+struct dual
+{
+	dual() : v(0.0)
+	{
+		for (std::size_t k = 0; k < K; ++k) d[k] = 0.0;
+	}
+
+	dual(double x) : v(x)
+	{
+		for (std::size_t k = 0; k < K; ++k) d[k] = 0.0;
+	}
+
+	dual &operator+=(const dual &o)
+	{
+		v += o.v;
+		for (std::size_t k = 0; k < K; ++k) d[k] += o.d[k];
+		return *this;
+	}
+
+	dual &operator-=(const dual &o)
+	{
+		v -= o.v;
+		for (std::size_t k = 0; k < K; ++k) d[k] -= o.d[k];
+		return *this;
+	}
+
+	dual &operator*=(const dual &o)
+	{
+		for (std::size_t k = 0; k < K; ++k) {
+			d[k] = d[k]*o.v + v*o.d[k];
+		}
+		v *= o.v;
+		return *this;
+	}
+
+	dual &operator/=(const dual &o)
+	{
+		double inv = 1.0 / o.v;
+		v *= inv;
+		for (std::size_t k = 0; k < K; ++k) {
+			d[k] = (d[k] - v*o.d[k]) * inv;
+		}
+		return *this;
+	}
+
+	double v;    ///< The value
+	double d[K]; ///< The derivatives in each direction
+};
+
+
+/// \brief Returns a dual with value f and derivatives df_dx * x.d
+template <std::size_t K> inline
+dual<K> chain(const dual<K> &x, double f, double df_dx)
+{
+	dual<K> r(f);
+	for (std::size_t k = 0; k < K; ++k) r.d[k] = df_dx * x.d[k];
+	return r;
+}
+
+
+template <std::size_t K> inline
+dual<K> operator-(const dual<K> &x)
+{
+	return chain(x, -x.v, -1.0);
+}
+
+template <std::size_t K> inline
+dual<K> operator+(const dual<K> &x)
+{
+	return x;
+}
+
+#define AUTODIFF_BINARY_OPERATOR(OP)                                        \
+	template <std::size_t K> inline                                      \
+	dual<K> operator OP(dual<K> a, const dual<K> &b)                     \
+	{ return a OP##= b; }                                                \
+	template <std::size_t K> inline                                      \
+	dual<K> operator OP(dual<K> a, double b)                             \
+	{ return a OP##= dual<K>(b); }                                       \
+	template <std::size_t K> inline                                      \
+	dual<K> operator OP(double a, const dual<K> &b)                      \
+	{ return dual<K>(a) OP##= b; }
+
+AUTODIFF_BINARY_OPERATOR(+)
+AUTODIFF_BINARY_OPERATOR(-)
+AUTODIFF_BINARY_OPERATOR(*)
+AUTODIFF_BINARY_OPERATOR(/)
+
+#undef AUTODIFF_BINARY_OPERATOR
+
+// Comparisons only look at the value:
+#define AUTODIFF_COMPARISON(OP)                                             \
+	template <std::size_t K> inline                                      \
+	bool operator OP(const dual<K> &a, const dual<K> &b)                 \
+	{ return a.v OP b.v; }                                               \
+	template <std::size_t K> inline                                      \
+	bool operator OP(const dual<K> &a, double b)                         \
+	{ return a.v OP b; }                                                 \
+	template <std::size_t K> inline                                      \
+	bool operator OP(double a, const dual<K> &b)                         \
+	{ return a OP b.v; }
+
+AUTODIFF_COMPARISON(<)
+AUTODIFF_COMPARISON(>)
+AUTODIFF_COMPARISON(<=)
+AUTODIFF_COMPARISON(>=)
+AUTODIFF_COMPARISON(==)
+AUTODIFF_COMPARISON(!=)
+
+#undef AUTODIFF_COMPARISON
+
+
+template <std::size_t K> inline
+dual<K> sin(const dual<K> &x)
+{ return chain(x, std::sin(x.v), std::cos(x.v)); }
+
+template <std::size_t K> inline
+dual<K> cos(const dual<K> &x)
+{ return chain(x, std::cos(x.v), -std::sin(x.v)); }
+
+template <std::size_t K> inline
+dual<K> tan(const dual<K> &x)
+{
+	double f = std::tan(x.v);
+	return chain(x, f, 1.0 + f*f);
+}
+
+template <std::size_t K> inline
+dual<K> exp(const dual<K> &x)
+{
+	double f = std::exp(x.v);
+	return chain(x, f, f);
+}
+
+template <std::size_t K> inline
+dual<K> log(const dual<K> &x)
+{ return chain(x, std::log(x.v), 1.0 / x.v); }
+
+template <std::size_t K> inline
+dual<K> sqrt(const dual<K> &x)
+{
+	double f = std::sqrt(x.v);
+	return chain(x, f, 0.5 / f);
+}
+
+template <std::size_t K> inline
+dual<K> tanh(const dual<K> &x)
+{
+	double f = std::tanh(x.v);
+	return chain(x, f, 1.0 - f*f);
+}
+
+template <std::size_t K> inline
+dual<K> atan(const dual<K> &x)
+{ return chain(x, std::atan(x.v), 1.0 / (1.0 + x.v*x.v)); }
+
+template <std::size_t K> inline
+dual<K> fabs(const dual<K> &x)
+{ return chain(x, std::fabs(x.v), x.v < 0 ? -1.0 : 1.0); }
+
+template <std::size_t K> inline
+dual<K> abs(const dual<K> &x)
+{ return fabs(x); }
+
+template <std::size_t K> inline
+dual<K> pow(const dual<K> &x, double p)
+{ return chain(x, std::pow(x.v, p), p*std::pow(x.v, p - 1.0)); }
+
+template <std::size_t K> inline
+dual<K> pow(const dual<K> &x, const dual<K> &p)
+{ return exp(p * log(x)); }
+
+template <std::size_t K> inline
+dual<K> pow(double x, const dual<K> &p)
+{ return chain(p, std::pow(x, p.v), std::pow(x, p.v)*std::log(x)); }
+
+
+/**
+   \brief Tells whether a functor implements fun_generic (see the
+   namespace documentation).
+*/
+template <typename functor_type>
+struct has_fun_generic
+{
+	template <typename F>
+	static auto test(int) -> decltype(
+		std::declval<F&>().fun_generic(
+			std::declval<double>(),
+			std::declval<const std::vector<dual<1> >&>(),
+			std::declval<std::vector<dual<1> >&>()),
+		std::true_type());
+
+	template <typename F>
+	static std::false_type test(...);
+
+	static constexpr bool value = decltype(test<functor_type>(0))::value;
+};
+
+
+/**
+   \brief Wraps a functor that implements fun_generic so that it has fun
+   and an exact jac.
+
+   The Jacobi matrix is computed by seeding K groups of columns per RHS
+   evaluation. Columns that share no non-zero rows are seeded in the same
+   direction (see jacobian::colour_groups), so a banded Jacobi matrix of
+   bandwidth K or less costs a single evaluation with dual numbers.
+
+   \tparam K  Number of directions per dual number.
+*/
+template <typename functor_type, std::size_t K = 8>
+struct ad_functor
+{
+	typedef arma::mat jac_type;
+	typedef dual<K> dual_type;
+
+	static constexpr bool thread_safe =
+		functor_is_thread_safe<functor_type>::value;
+
+	/**
+	   \param func     The functor with fun_generic
+	   \param pattern  Sparsity pattern of the Jacobi matrix. If nullptr,
+	                   it is dense, unless detect is true.
+	   \param detect   If true and pattern is nullptr, detect the pattern
+	                   (see jacobian::detect_pattern) on the first call
+	                   to jac.
+	*/
+	explicit ad_functor(functor_type &func,
+	                    const jacobian::sparsity_pattern *pattern = nullptr,
+	                    bool detect = false)
+		: func(func), user_pattern(pattern), detect(detect),
+		  fun_evals(0), have_pattern(false) {}
+
+	arma::vec fun(double t, const arma::vec &y)
+	{
+		std::size_t N = y.size();
+		std::vector<double> yv(N), dy(N, 0.0);
+		for (std::size_t j = 0; j < N; ++j) yv[j] = y(j);
+		func.fun_generic(t, yv, dy);
+		arma::vec f(N);
+		for (std::size_t i = 0; i < N; ++i) f(i) = dy[i];
+		return f;
+	}
+
+	jac_type jac(double t, const arma::vec &y)
+	{
+		std::size_t N = y.size();
+		if (!have_pattern) {
+			if (user_pattern) {
+				pattern = *user_pattern;
+			} else if (detect) {
+				pattern = jacobian::detect_pattern(*this, t, y,
+				                                   fun_evals);
+			} else {
+				pattern = jacobian::dense_pattern(N);
+			}
+			groups = jacobian::colour_groups(pattern);
+			have_pattern = true;
+		}
+
+		arma::mat J(N, N);
+		J.zeros();
+		std::vector<dual_type> yd(N), dyd(N);
+		for (std::size_t g0 = 0; g0 < groups.size(); g0 += K) {
+			std::size_t n_dirs = std::min(K, groups.size() - g0);
+			for (std::size_t j = 0; j < N; ++j) {
+				yd[j]  = y(j);
+				dyd[j] = 0.0;
+			}
+			for (std::size_t k = 0; k < n_dirs; ++k) {
+				for (std::size_t j : groups[g0 + k]) yd[j].d[k] = 1.0;
+			}
+			func.fun_generic(t, yd, dyd);
+			++fun_evals;
+
+			for (std::size_t k = 0; k < n_dirs; ++k) {
+				for (std::size_t j : groups[g0 + k]) {
+					for (std::size_t i : pattern.col_rows[j]) {
+						J(i,j) = dyd[i].d[k];
+					}
+				}
+			}
+		}
+		return J;
+	}
+
+	template <typename F = functor_type>
+	auto fun_stages(const arma::vec &t, const arma::mat &Y, arma::mat &FY)
+		-> decltype(std::declval<F&>().fun_stages(t, Y, FY))
+	{
+		return func.fun_stages(t, Y, FY);
+	}
+
+	functor_type &func;
+	const jacobian::sparsity_pattern *user_pattern;
+	bool detect;
+
+	/// Number of RHS evaluations done for jac, with dual numbers or for
+	/// detecting the pattern.
+	std::size_t fun_evals;
+
+	/// The sparsity pattern used, set up by the first call to jac.
+	jacobian::sparsity_pattern pattern;
+	std::vector<std::vector<std::size_t> > groups;
+	bool have_pattern;
+};
+
+
+} // namespace autodiff
+
+
+#endif // AUTODIFF_HPP
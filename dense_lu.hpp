@@ -0,0 +1,102 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file dense_lu.hpp
+
+   \brief LU decomposition of dense matrices with LAPACK, kept for many
+   solves.
+
+   The factors are stored like LAPACK's getrf leaves them, with a pivot
+   vector instead of a permutation matrix, and the solves are done in
+   place with getrs. Compared to arma::lu followed by two triangular
+   arma::solve calls this avoids the O(N^2) product with the permutation
+   matrix and the temporaries of every solve.
+*/
+
+#ifndef DENSE_LU_HPP
+#define DENSE_LU_HPP
+
+#include <cassert>
+#include <vector>
+
+#include "arma_include.hpp"
+
+
+/**
+   \brief LU decomposition with partial pivoting of an N x N matrix.
+
+   \tparam eT  The element type, double or float.
+*/
+template <typename eT>
+struct dense_lu
+{
+	dense_lu() : N(0) {}
+
+	/**
+	   \brief Factorises the matrix M.
+
+	   \returns false if M is singular.
+	*/
+	bool factor(const arma::Mat<eT> &M)
+	{
+		assert(M.n_rows == M.n_cols && "Matrix is not square!");
+		LU = M;
+		N = M.n_rows;
+		piv.resize(N);
+		if (N == 0) return true;
+
+		arma::blas_int n = static_cast<arma::blas_int>(N);
+		arma::blas_int info = 0;
+		arma::lapack::getrf(&n, &n, LU.memptr(), &n, piv.data(), &info);
+		return info == 0;
+	}
+
+	/**
+	   \brief Solves M X = B in place.
+
+	   \param B  Right-hand side(s), one per column. Will contain X.
+	*/
+	void solve(arma::Mat<eT> &B) const
+	{
+		assert(B.n_rows == N && "Right-hand side has the wrong size!");
+		if (N == 0 || B.n_cols == 0) return;
+
+		char trans = 'N';
+		arma::blas_int n = static_cast<arma::blas_int>(N);
+		arma::blas_int nrhs = static_cast<arma::blas_int>(B.n_cols);
+		arma::blas_int info = 0;
+		// getrs does not modify the factors or the pivots:
+		arma::lapack::getrs(&trans, &n, &nrhs,
+		                    const_cast<eT*>(LU.memptr()), &n,
+		                    const_cast<arma::blas_int*>(piv.data()),
+		                    B.memptr(), &n, &info);
+	}
+
+	/// The factors L (unit lower, below the diagonal) and U.
+	arma::Mat<eT> LU;
+	/// Row i was swapped with row piv[i] - 1.
+	std::vector<arma::blas_int> piv;
+	/// Size of the matrix.
+	arma::uword N;
+};
+
+
+#endif // DENSE_LU_HPP
@@ -0,0 +1,1284 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file ensemble.hpp
+
+   \brief Contains a driver that integrates the same ODE for many initial
+   values and/or parameter sets in parallel.
+*/
+
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "enums.hpp"
+#include "erk.hpp"
+#include "erk_tableaux.hpp"
+#include "irk.hpp"
+#include "my_timer.hpp"
+#include "newton.hpp"
+#include "options.hpp"
+#include "output.hpp"
+#include "small_lu.hpp"
+#include "step_size.hpp"
+
+
+/**
+   \brief Contains an integrator for ensembles of initial value problems.
+
+   Every member of the ensemble is integrated with erk::odeint or
+   irk::odeint over the same interval. The members are distributed over
+   a pool of threads. Each thread has its own queue of members and steals
+   from the other queues once its own runs dry, so a few members that take
+   much longer than the rest (e.g. because they are stiff) do not leave the
+   other threads idle.
+*/
+namespace ensemble {
+
+typedef arma::vec vec_type;
+typedef arma::mat mat_type;
+
+
+/**
+   \brief options for the ensemble integrator.
+*/
+struct solver_options : common_solver_options {
+
+	/// \brief Constructor with default values.
+	solver_options() : method(erk::DORMAND_PRINCE_54),
+	                   n_threads(0),
+	                   store_solutions(false),
+	                   dt(0.0)
+	{
+		// With many threads, the per-integration messages are noise:
+		quiet = true;
+	}
+
+	~solver_options()
+	{ }
+
+	/// The method to use. Can be an explicit (see erk::rk_methods) or
+	/// implicit (see irk::rk_methods) method.
+	int method;
+
+	/// Number of threads to use. If <= 0, use all hardware threads.
+	int n_threads;
+
+	/// If true, keep the full solution of every member. Otherwise only
+	/// the final states are kept.
+	bool store_solutions;
+
+	/// Initial time step size. If <= 0, it is estimated per member.
+	double dt;
+};
+
+
+/**
+   \brief The output of the ensemble integrator.
+
+   The per-member results are stored contiguously, indexed by member.
+*/
+struct ensemble_output
+{
+	struct counters {
+		counters() : attempt(0), fun_evals(0), jac_evals(0),
+		             steals(0) {}
+
+		std::size_t attempt, fun_evals, jac_evals;
+		/// Number of members taken from the queue of another thread.
+		std::size_t steals;
+	};
+
+	/// SUCCESS if all members succeeded, otherwise the status of the
+	/// first member (by index) that failed.
+	int status;
+
+	/// Number of members that did not succeed.
+	std::size_t n_failed;
+
+	/// Status of each member (see \ref odeint_status_codes).
+	std::vector<int> member_status;
+
+	/// Time each member reached (t1 on success).
+	std::vector<double> t_final;
+
+	/// Column i is the state of member i at t_final[i].
+	mat_type y_final;
+
+	/// Number of time step attempts per member.
+	std::vector<std::size_t> member_attempts;
+
+	/// Full solutions, only if solver_options::store_solutions was set.
+	std::vector<basic_output> solutions;
+
+	double elapsed_time;
+
+	/// Totals over all members.
+	counters count;
+};
+
+
+/**
+   \brief Per-thread queues of member indices with work stealing.
+
+   Each thread takes members from the front of its own queue and steals
+   from the back of the others, so that the thief takes the work furthest
+   away from what the owner is doing.
+*/
+class work_queues
+{
+public:
+	/**
+	   \brief Distributes n_members over n_queues in contiguous chunks.
+	*/
+	work_queues(std::size_t n_members, std::size_t n_queues)
+		: queues(n_queues), locks(n_queues)
+	{
+		for (std::size_t q = 0; q < n_queues; ++q) {
+			std::size_t start = (q * n_members) / n_queues;
+			std::size_t stop  = ((q+1) * n_members) / n_queues;
+			for (std::size_t i = start; i < stop; ++i) {
+				queues[q].push_back(i);
+			}
+		}
+	}
+
+	/**
+	   \brief Gets the next member for thread q.
+
+	   \param q       The queue of the calling thread.
+	   \param member  Will contain the member index.
+	   \param stolen  Will be true if the member came from another queue.
+
+	   \returns false if there is no work left.
+	*/
+	bool next(std::size_t q, std::size_t &member, bool &stolen)
+	{
+		stolen = false;
+		{
+			std::lock_guard<std::mutex> lock(locks[q]);
+			if (!queues[q].empty()) {
+				member = queues[q].front();
+				queues[q].pop_front();
+				return true;
+			}
+		}
+
+		// No work is ever added, so one sweep over the other queues
+		// suffices to tell whether everything is done.
+		std::size_t n_queues = queues.size();
+		for (std::size_t k = 1; k < n_queues; ++k) {
+			std::size_t v = (q + k) % n_queues;
+			std::lock_guard<std::mutex> lock(locks[v]);
+			if (!queues[v].empty()) {
+				member = queues[v].back();
+				queues[v].pop_back();
+				stolen = true;
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	std::vector<std::deque<std::size_t> > queues;
+	std::vector<std::mutex> locks;
+};
+
+
+/**
+   \brief Does not set any parameters. Used when only y0 varies.
+*/
+struct no_params
+{
+	template <typename functor_type, typename param_type>
+	void operator()(functor_type &, const param_type &) const
+	{ }
+};
+
+
+/**
+   \brief Stores the result of member i, which started at (t0, y0), in out.
+
+   Without any solution in part, the member is recorded at its initial
+   state, with a failed status if part does not have one already.
+*/
+template <typename rk_output> inline
+void store_member(ensemble_output &out, std::size_t i, rk_output &part,
+                  double t0, const vec_type &y0, bool store_solution)
+{
+	out.member_status[i] = part.status;
+	out.member_attempts[i] = part.count.attempt;
+	if (part.t_vals.empty() || part.y_vals.empty()) {
+		if (part.status == SUCCESS) out.member_status[i] = GENERAL_ERROR;
+		out.t_final[i] = t0;
+		out.y_final.col(i) = y0;
+	} else {
+		out.t_final[i] = part.t_vals.back();
+		out.y_final.col(i) = part.y_vals.back();
+	}
+	if (store_solution) {
+		out.solutions[i].status = part.status;
+		out.solutions[i].t_vals = std::move(part.t_vals);
+		out.solutions[i].y_vals = std::move(part.y_vals);
+	}
+}
+
+
+/**
+   \brief Integrates the members in queue q until all work is done.
+
+   The functor and options are copied once per thread, so they serve as
+   that thread's workspace and the user functor need not be thread-safe.
+*/
+template <typename functor_type, typename param_type,
+          typename param_setter> inline
+void run_worker(std::size_t q, work_queues &work,
+                const functor_type &func, double t0, double t1,
+                const std::vector<vec_type> &y0s,
+                const std::vector<param_type> &params,
+                param_setter set_params,
+                const solver_options &solver_opts,
+                ensemble_output &out,
+                ensemble_output::counters &count)
+{
+	functor_type f = func;
+
+	newton::options n_opts;
+	n_opts.tol = 0.1*std::min(solver_opts.min_abs_tol(),
+	                          solver_opts.rel_tol);
+
+	bool explicit_method =
+		erk::rk_method_to_string.count(solver_opts.method) > 0;
+	erk::solver_options e_opts;
+	irk::solver_options i_opts;
+	static_cast<common_solver_options&>(e_opts) = solver_opts;
+	static_cast<common_solver_options&>(i_opts) = solver_opts;
+	if (!i_opts.newton_opts) i_opts.newton_opts = &n_opts;
+
+	std::size_t i = 0;
+	bool stolen = false;
+	while (work.next(q, i, stolen)) {
+		if (stolen) ++count.steals;
+		if (!params.empty()) set_params(f, params[i]);
+		const vec_type &y0 = y0s.size() == 1 ? y0s[0] : y0s[i];
+
+		if (explicit_method) {
+			erk::rk_output part = erk::odeint(f, t0, t1, y0, e_opts,
+			                                  solver_opts.method,
+			                                  solver_opts.dt);
+			count.attempt   += part.count.attempt;
+			count.fun_evals += part.count.fun_evals;
+			store_member(out, i, part, t0, y0,
+			             solver_opts.store_solutions);
+		} else {
+			irk::rk_output part = irk::odeint(f, t0, t1, y0, i_opts,
+			                                  solver_opts.method,
+			                                  solver_opts.dt);
+			count.attempt   += part.count.attempt;
+			count.fun_evals += part.count.fun_evals;
+			count.jac_evals += part.count.jac_evals;
+			store_member(out, i, part, t0, y0,
+			             solver_opts.store_solutions);
+		}
+	}
+}
+
+
+/**
+   \brief Sets up out for n_members members of Neq equations.
+*/
+inline void init_output(ensemble_output &out, std::size_t n_members,
+                        std::size_t Neq, double t0, bool store_solutions)
+{
+	out.status = SUCCESS;
+	out.n_failed = 0;
+	out.member_status.resize(n_members, GENERAL_ERROR);
+	out.t_final.resize(n_members, t0);
+	out.member_attempts.resize(n_members, 0);
+	out.y_final.zeros(Neq, n_members);
+	if (store_solutions) {
+		out.solutions.resize(n_members);
+	}
+}
+
+
+/**
+   \brief Returns the number of threads to use for n_members members.
+*/
+inline std::size_t pool_size(const solver_options &solver_opts,
+                             std::size_t n_members)
+{
+	std::size_t n_threads = std::thread::hardware_concurrency();
+	if (solver_opts.n_threads > 0) {
+		n_threads = solver_opts.n_threads;
+	}
+	return std::max<std::size_t>(1, std::min(n_threads, n_members));
+}
+
+
+/**
+   \brief Calls worker(q) for q = 0 to n_threads-1, each on its own thread.
+*/
+template <typename worker_type> inline
+void run_pool(std::size_t n_threads, worker_type worker)
+{
+	if (n_threads == 1) {
+		worker(0);
+		return;
+	}
+	std::vector<std::thread> threads;
+	for (std::size_t q = 0; q < n_threads; ++q) {
+		threads.emplace_back(worker, q);
+	}
+	for (std::thread &th : threads) {
+		th.join();
+	}
+}
+
+
+/**
+   \brief Adds up the per-thread counters and sets the overall status.
+*/
+inline void finish_output(ensemble_output &out,
+                          const std::vector<ensemble_output::counters> &counts)
+{
+	for (const ensemble_output::counters &c : counts) {
+		out.count.attempt   += c.attempt;
+		out.count.fun_evals += c.fun_evals;
+		out.count.jac_evals += c.jac_evals;
+		out.count.steals    += c.steals;
+	}
+	for (std::size_t i = 0; i < out.member_status.size(); ++i) {
+		if (out.member_status[i] == SUCCESS) continue;
+		if (out.n_failed == 0) out.status = out.member_status[i];
+		++out.n_failed;
+	}
+}
+
+
+/**
+   \brief Time-integrate an ensemble of ODEs from t0 to t1.
+
+   Member i starts at y0s[i] and has its parameters set by calling
+   set_params(f, params[i]) on a thread-local copy f of func.
+
+   \param func         Functor of the ODE to integrate. Has to be copyable.
+                       Without a jac member, implicit methods approximate
+                       the Jacobi matrix with finite differences.
+   \param t0           Starting time
+   \param t1           Final time
+   \param y0s          Initial values of each member. If it has only one
+                       element, all members start from it.
+   \param params       Parameters of each member. If empty, the number of
+                       members is y0s.size().
+   \param set_params   Callable as set_params(functor_type&,
+                       const param_type&).
+   \param solver_opts  Options for the integrator.
+
+   \returns a struct with the final states and statistics of all members.
+*/
+template <typename functor_type, typename param_type,
+          typename param_setter> inline
+ensemble_output odeint(const functor_type &func, double t0, double t1,
+                       const std::vector<vec_type> &y0s,
+                       const std::vector<param_type> &params,
+                       param_setter set_params,
+                       const solver_options &solver_opts)
+{
+	my_timer timer;
+	std::size_t n_members = params.empty() ? y0s.size() : params.size();
+	assert( !y0s.empty() && "Need at least one initial value!" );
+	assert( (y0s.size() == 1 || y0s.size() == n_members) &&
+	        "Number of initial values and parameters do not match!" );
+
+	ensemble_output out;
+	init_output(out, n_members, y0s[0].size(), t0,
+	            solver_opts.store_solutions);
+	if (!solver_opts.abs_tols_match(y0s[0].size())) {
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: abs_tols needs one entry per "
+			          << "equation!\n";
+		}
+		// All members keep their initial GENERAL_ERROR status:
+		finish_output(out, std::vector<ensemble_output::counters>());
+		return out;
+	}
+
+	std::size_t n_threads = pool_size(solver_opts, n_members);
+	work_queues work(n_members, n_threads);
+	std::vector<ensemble_output::counters> counts(n_threads);
+
+	run_pool(n_threads, [&](std::size_t q) {
+			run_worker(q, work, func, t0, t1, y0s, params,
+			           set_params, solver_opts, out, counts[q]);
+		});
+
+	finish_output(out, counts);
+	out.elapsed_time = timer.toc();
+	return out;
+}
+
+
+/**
+   \brief Time-integrate an ensemble of ODEs that only differ in their
+   initial values from t0 to t1.
+
+   See the other odeint for the parameters.
+*/
+template <typename functor_type> inline
+ensemble_output odeint(const functor_type &func, double t0, double t1,
+                       const std::vector<vec_type> &y0s,
+                       const solver_options &solver_opts)
+{
+	std::vector<int> params;
+	return odeint(func, t0, t1, y0s, params, no_params(), solver_opts);
+}
+/**
+   \defgroup lockstep Lockstep integration of small systems
+
+   For ensembles of small systems, evaluating one system at a time leaves
+   most of the SIMD units idle. odeint_lanes and odeint_lanes_implicit
+   instead advance W members together, each in its own lane. All state is
+   stored as structure of arrays, i.e., component n of lane l is at index
+   n*W + l, so that the loops over the lanes vectorise. Every lane has its
+   own time, time step size and step controller; lanes that reject a step
+   simply keep their state. Once a member reaches t1 (or fails), its lane
+   is refilled with the next member from the work queue.
+
+   The functor has to provide a batched RHS:
+   \code{
+     template <std::size_t W>
+     void fun_lanes(const double *t, const double *y, double *dy);
+   \code}
+   which sets dy[n*W + l] = f_n(t[l], y[:*W + l]) for all lanes l, and for
+   odeint_lanes_implicit also a batched Jacobi matrix:
+   \code{
+     template <std::size_t W>
+     void jac_lanes(const double *t, const double *y, double *J);
+   \code}
+   which sets J[(n + m*Neq)*W + l] = df_n/dy_m at (t[l], y[:*W + l]).
+   Lanes that have no member left are still evaluated, at a state they had
+   before, and their result is ignored.
+
+   @{
+*/
+
+
+/**
+   \brief Does not set any lane parameters. Used when only y0 varies.
+*/
+struct no_lane_params
+{
+	template <typename functor_type, typename param_type>
+	void operator()(functor_type &, std::size_t, const param_type &) const
+	{ }
+};
+
+
+/**
+   \brief The state of W lanes of Neq equations, and the bookkeeping of
+   which member is in which lane.
+*/
+template <std::size_t Neq, std::size_t W>
+struct lane_state
+{
+	lane_state(const vec_type &y_init, const step_controller &ctrl_init)
+		: n_active(0), ctrl(W, ctrl_init), ctrl_init(ctrl_init)
+	{
+		// Idle lanes keep evaluating a valid state, so start from one:
+		for (std::size_t n = 0; n < Neq; ++n) {
+			for (std::size_t l = 0; l < W; ++l) {
+				y[n*W + l] = y_init(n);
+			}
+		}
+		for (std::size_t l = 0; l < W; ++l) {
+			active[l] = fresh[l] = false;
+		}
+	}
+
+	/**
+	   \brief Puts the next member from work in lane l, or marks the lane
+	   idle if there is none.
+
+	   \returns true if the lane got a member.
+	*/
+	template <typename functor_type, typename param_type,
+	          typename param_setter>
+	bool refill(std::size_t l, std::size_t q, work_queues &work,
+	            functor_type &f, double t0, double t1,
+	            const std::vector<vec_type> &y0s,
+	            const std::vector<param_type> &params,
+	            param_setter &set_params, double dt_init,
+	            ensemble_output::counters &count)
+	{
+		std::size_t i = 0;
+		bool stolen = false;
+		t[l]  = t1;
+		dt[l] = 0.0;
+		active[l] = work.next(q, i, stolen);
+		fresh[l]  = active[l];
+		if (!active[l]) return false;
+
+		++n_active;
+		if (stolen) ++count.steals;
+		member[l]   = i;
+		attempts[l] = 0;
+		steps[l]    = 0;
+		if (!params.empty()) set_params(f, l, params[i]);
+
+		const vec_type &y0 = y0s.size() == 1 ? y0s[0] : y0s[i];
+		assert( y0.size() == Neq && "Wrong number of equations!" );
+		for (std::size_t n = 0; n < Neq; ++n) {
+			y[n*W + l] = y0(n);
+		}
+		t[l]  = t0;
+		dt[l] = dt_init;
+		ctrl[l] = ctrl_init;
+		return true;
+	}
+
+	/**
+	   \brief Stores the result of the member in lane l in out.
+	*/
+	void finish(std::size_t l, int status, ensemble_output &out,
+	            ensemble_output::counters &count)
+	{
+		std::size_t i = member[l];
+		out.member_status[i]   = status;
+		out.member_attempts[i] = attempts[l];
+		out.t_final[i] = t[l];
+		for (std::size_t n = 0; n < Neq; ++n) {
+			out.y_final(n,i) = y[n*W + l];
+		}
+		count.attempt += attempts[l];
+		active[l] = false;
+		--n_active;
+	}
+
+	alignas(64) double t[W];
+	alignas(64) double dt[W];
+	alignas(64) double y[Neq*W];
+
+	std::size_t member[W], attempts[W];
+	long long int steps[W];
+	bool active[W], fresh[W];
+	std::size_t n_active;
+
+	std::vector<step_controller> ctrl;
+	step_controller ctrl_init;
+};
+
+
+/**
+   \brief Estimates the initial dt of the fresh lanes with a time step size
+   <= 0 (see initial_dt).
+
+   \param f0  Will contain f(t,y) for all lanes.
+   \param Y   Work space of Neq*W doubles.
+   \param f1  Work space of Neq*W doubles.
+*/
+template <std::size_t Neq, std::size_t W, typename functor_type> inline
+void estimate_lane_dt(functor_type &f, lane_state<Neq,W> &st, double t0,
+                      double t1, int order, const solver_options &solver_opts,
+                      double *f0, double *Y, double *f1,
+                      ensemble_output::counters &count)
+{
+	const double rtol = solver_opts.rel_tol;
+	f.template fun_lanes<W>(st.t, st.y, f0);
+	count.fun_evals += st.n_active;
+
+	double dt0[W], d1[W], tc[W];
+	for (std::size_t l = 0; l < W; ++l) {
+		dt0[l] = d1[l] = 0.0;
+		if (!st.fresh[l] || st.dt[l] > 0) continue;
+		double d0 = 0.0;
+		for (std::size_t n = 0; n < Neq; ++n) {
+			const double atol = solver_opts.abs_tol_of(n);
+			double sc = atol + rtol*std::fabs(st.y[n*W + l]);
+			double yn = st.y[n*W + l] / sc;
+			double fn = f0[n*W + l] / sc;
+			d0    += yn*yn;
+			d1[l] += fn*fn;
+		}
+		d0    = std::sqrt(d0 / Neq);
+		d1[l] = std::sqrt(d1[l] / Neq);
+		dt0[l] = initial_dt_guess(d0, d1[l], t1 - t0);
+	}
+
+	for (std::size_t n = 0; n < Neq; ++n) {
+		for (std::size_t l = 0; l < W; ++l) {
+			Y[n*W + l] = st.y[n*W + l] + dt0[l]*f0[n*W + l];
+		}
+	}
+	for (std::size_t l = 0; l < W; ++l) {
+		tc[l] = st.t[l] + dt0[l];
+	}
+	f.template fun_lanes<W>(tc, Y, f1);
+	count.fun_evals += st.n_active;
+
+	for (std::size_t l = 0; l < W; ++l) {
+		if (dt0[l] == 0.0) continue;
+		double d2 = 0.0;
+		for (std::size_t n = 0; n < Neq; ++n) {
+			const double atol = solver_opts.abs_tol_of(n);
+			double sc = atol + rtol*std::fabs(st.y[n*W + l]);
+			double df = (f1[n*W + l] - f0[n*W + l]) / sc;
+			d2 += df*df;
+		}
+		d2 = std::sqrt(d2 / Neq) / dt0[l];
+		st.dt[l] = initial_dt_final(dt0[l], d1[l], d2, order, t1 - t0,
+		                            solver_opts.max_dt);
+	}
+}
+
+
+/**
+   \brief Integrates the members in queue q in lockstep, W at a time, with
+   the compile-time tableau (see erk_tableaux.hpp).
+*/
+template <typename tableau, std::size_t Neq, std::size_t W,
+          typename functor_type, typename param_type,
+          typename param_setter> inline
+void run_lanes_worker(std::size_t q, work_queues &work,
+                      const functor_type &func, double t0, double t1,
+                      const std::vector<vec_type> &y0s,
+                      const std::vector<param_type> &params,
+                      param_setter set_params,
+                      const solver_options &solver_opts,
+                      ensemble_output &out,
+                      ensemble_output::counters &count)
+{
+	constexpr std::size_t Ns = tableau::Ns;
+	constexpr std::size_t N  = Neq*W;
+	const double rtol = solver_opts.rel_tol;
+	const int order = std::min(tableau::order, tableau::order2);
+
+	functor_type f = func;
+
+	int ctrl_type = solver_opts.step_controller;
+	if (ctrl_type == common_solver_options::DEFAULT_CONTROLLER) {
+		ctrl_type = common_solver_options::PI_GUSTAFSSON;
+	}
+	lane_state<Neq,W> st(y0s[0], step_controller(ctrl_type, order, 4.0));
+	double *t = st.t, *dt = st.dt, *y = st.y;
+
+	alignas(64) double tc[W], err[W];
+	alignas(64) double Y[N], y_n[N];
+	alignas(64) double K[Ns][N];
+
+	// Whether K[0] holds f(t,y) for all lanes:
+	bool k0_valid = false;
+	auto refill = [&](std::size_t l) {
+		if (st.refill(l, q, work, f, t0, t1, y0s, params, set_params,
+		              solver_opts.dt, count)) {
+			k0_valid = false;
+		}
+	};
+
+	for (std::size_t l = 0; l < W; ++l) {
+		refill(l);
+	}
+
+	while (st.n_active > 0) {
+		bool any_fresh = false;
+		for (std::size_t l = 0; l < W; ++l) {
+			any_fresh = any_fresh || st.fresh[l];
+		}
+		if (any_fresh && solver_opts.dt <= 0) {
+			estimate_lane_dt(f, st, t0, t1, order, solver_opts,
+			                 K[0], Y, K[1], count);
+			k0_valid = true;
+		}
+		for (std::size_t l = 0; l < W; ++l) {
+			st.fresh[l] = false;
+			if (t[l] + dt[l] > t1) dt[l] = t1 - t[l];
+		}
+
+		// ****************  Calculate stages:   ************
+		for (std::size_t s = 0; s < Ns; ++s) {
+			if (s == 0 && k0_valid) continue;
+
+			for (std::size_t n = 0; n < Neq; ++n) {
+#pragma omp simd
+				for (std::size_t l = 0; l < W; ++l) {
+					double acc = 0.0;
+					for (std::size_t j = 0; j < s; ++j) {
+						acc += tableau::A[s][j]*K[j][n*W + l];
+					}
+					Y[n*W + l] = y[n*W + l] + dt[l]*acc;
+				}
+			}
+			for (std::size_t l = 0; l < W; ++l) {
+				tc[l] = t[l] + tableau::c[s]*dt[l];
+			}
+			f.template fun_lanes<W>(tc, Y, K[s]);
+			count.fun_evals += st.n_active;
+		}
+		// With FSAL, accepted lanes get their new K[0] below and
+		// rejected lanes keep theirs:
+		k0_valid = tableau::FSAL;
+
+		// ************* Form solution and error estimate: ***********
+		for (std::size_t l = 0; l < W; ++l) {
+			err[l] = 0.0;
+		}
+		for (std::size_t n = 0; n < Neq; ++n) {
+			const double atol = solver_opts.abs_tol_of(n);
+#pragma omp simd
+			for (std::size_t l = 0; l < W; ++l) {
+				double d = 0.0, d2 = 0.0;
+				for (std::size_t j = 0; j < Ns; ++j) {
+					d  += tableau::b[j]*K[j][n*W + l];
+					d2 += tableau::b2[j]*K[j][n*W + l];
+				}
+				double yi = y[n*W + l];
+				double yn = yi + dt[l]*d;
+				double sc = atol + rtol*std::max(std::fabs(yi),
+				                                 std::fabs(yn));
+				double e  = dt[l]*(d2 - d) / sc;
+				y_n[n*W + l] = yn;
+				err[l] += e*e;
+			}
+		}
+
+		// ************* Per-lane step size control: ***********
+		for (std::size_t l = 0; l < W; ++l) {
+			if (!st.active[l]) continue;
+			++st.attempts[l];
+
+			double e = std::max(std::sqrt(err[l] / Neq),
+			                    machine_precision);
+			bool accepted = e < 1.0;
+			double new_dt = st.ctrl[l].next_dt(dt[l], e, accepted);
+			if (solver_opts.max_dt > 0) {
+				new_dt = std::min(solver_opts.max_dt, new_dt);
+			}
+
+			if (accepted) {
+				t[l] += dt[l];
+				++st.steps[l];
+				for (std::size_t n = 0; n < Neq; ++n) {
+					y[n*W + l] = y_n[n*W + l];
+				}
+				if (tableau::FSAL) {
+					for (std::size_t n = 0; n < Neq; ++n) {
+						K[0][n*W + l] = K[Ns-1][n*W + l];
+					}
+				}
+			}
+			dt[l] = new_dt;
+
+			if (!(t[l] < t1)) {
+				st.finish(l, SUCCESS, out, count);
+				refill(l);
+			} else if (solver_opts.max_steps >= 0 &&
+			           st.steps[l] > solver_opts.max_steps) {
+				st.finish(l, ERROR_MAX_STEPS_EXCEEDED, out, count);
+				refill(l);
+			}
+		}
+	}
+}
+
+
+/**
+   \brief Integrates the members in queue q in lockstep, W at a time, with
+   a fully implicit method of Ns stages.
+
+   This follows irk_guts with newton_solve_stages_fixed, except that J is
+   evaluated on every attempt and not refreshed during the iteration. The
+   Newton matrices I - kron(dt*A, J) and the error filters I - gamma*dt*J
+   of all lanes are factorised together with batched_small_lu.
+*/
+template <std::size_t Neq, std::size_t Ns, std::size_t W,
+          typename functor_type, typename param_type,
+          typename param_setter> inline
+void run_lanes_implicit_worker(std::size_t q, work_queues &work,
+                               const functor_type &func, double t0,
+                               double t1, const std::vector<vec_type> &y0s,
+                               const std::vector<param_type> &params,
+                               param_setter set_params,
+                               const solver_options &solver_opts,
+                               ensemble_output &out,
+                               ensemble_output::counters &count)
+{
+	constexpr std::size_t NN = Neq*Ns;
+	constexpr std::size_t N  = Neq*W;
+	const double rtol = solver_opts.rel_tol;
+
+	irk::solver_coeffs sc = irk::get_coefficients(solver_opts.method);
+	assert( sc.b.size() == Ns && "Wrong number of stages for method!" );
+	assert( sc.b2.size() == Ns && "Lockstep integration needs an "
+	        "embedded method!" );
+	assert( !irk::is_method_dirk(sc) && "DIRK methods are not supported "
+	        "in lockstep integration!" );
+	const int order = std::min(sc.order, sc.order2);
+
+	newton::options n_opts;
+	n_opts.tol = 0.1*std::min(solver_opts.min_abs_tol(),
+	                          solver_opts.rel_tol);
+	const newton::options &newton_opts = solver_opts.newton_opts ?
+		*solver_opts.newton_opts : n_opts;
+	const int maxit = newton_opts.maxit;
+	const double xtol2 = newton_opts.dx_delta*newton_opts.dx_delta;
+	const double Rtol2 = newton_opts.tol*newton_opts.tol;
+
+	// The update is formed from the stages with d = b*inv(A):
+	double A[Ns][Ns], c[Ns], d_w[Ns], d2_w[Ns];
+	mat_type Ai = arma::inv(sc.A);
+	vec_type d_weights  = (Ai.t())*sc.b;
+	vec_type d2_weights = (Ai.t())*sc.b2;
+	for (std::size_t i = 0; i < Ns; ++i) {
+		c[i]    = sc.c(i);
+		d_w[i]  = d_weights(i);
+		d2_w[i] = d2_weights(i);
+		for (std::size_t j = 0; j < Ns; ++j) {
+			A[i][j] = sc.A(i,j);
+		}
+	}
+
+	functor_type f = func;
+
+	int ctrl_type = solver_opts.step_controller;
+	if (ctrl_type == common_solver_options::DEFAULT_CONTROLLER) {
+		ctrl_type = common_solver_options::PREDICTIVE_GUSTAFSSON;
+	}
+	lane_state<Neq,W> st(y0s[0], step_controller(ctrl_type, order, 8.0));
+	double *t = st.t, *dt = st.dt, *y = st.y;
+
+	// Stage arrays are stored as (i*Neq + n)*W + l for stage i:
+	std::vector<double> M(NN*NN*W), J(Neq*Neq*W), E(Neq*Neq*W);
+	std::vector<double> Yv(NN*W), F(NN*W), R(NN*W), dY(NN*W);
+	alignas(64) double tc[W], err[W], y_n[N], f0[N], dd[N], Ys[N];
+	double xnorm2[W], xnorm2_o[W], Rnorm2[W], damp[W], theta[W];
+	int iters[W];
+	bool done[W], converged[W];
+
+	// These are too large for the stack:
+	std::unique_ptr<batched_small_lu<NN,W> > lu(new batched_small_lu<NN,W>);
+	std::unique_ptr<batched_small_lu<Neq,W> > lu_err(
+		new batched_small_lu<Neq,W>);
+
+	auto refill = [&](std::size_t l) {
+		st.refill(l, q, work, f, t0, t1, y0s, params, set_params,
+		          solver_opts.dt, count);
+	};
+
+	// R = Y - kron(dt*A, I)*F(Y):
+	auto construct_R = [&]() {
+		for (std::size_t i = 0; i < Ns; ++i) {
+			for (std::size_t k = 0; k < N; ++k) {
+				Ys[k] = y[k] + Yv[i*N + k];
+			}
+			for (std::size_t l = 0; l < W; ++l) {
+				tc[l] = t[l] + c[i]*dt[l];
+			}
+			f.template fun_lanes<W>(tc, Ys, &F[i*N]);
+			count.fun_evals += st.n_active;
+		}
+		for (std::size_t i = 0; i < Ns; ++i) {
+			for (std::size_t n = 0; n < Neq; ++n) {
+#pragma omp simd
+				for (std::size_t l = 0; l < W; ++l) {
+					double acc = 0.0;
+					for (std::size_t j = 0; j < Ns; ++j) {
+						acc += A[i][j]*F[(j*Neq + n)*W + l];
+					}
+					std::size_t k = (i*Neq + n)*W + l;
+					R[k] = Yv[k] - dt[l]*acc;
+				}
+			}
+		}
+	};
+
+	for (std::size_t l = 0; l < W; ++l) {
+		refill(l);
+	}
+
+	while (st.n_active > 0) {
+		bool any_fresh = false;
+		for (std::size_t l = 0; l < W; ++l) {
+			any_fresh = any_fresh || st.fresh[l];
+		}
+		if (any_fresh && solver_opts.dt <= 0) {
+			estimate_lane_dt(f, st, t0, t1, order, solver_opts,
+			                 f0, Ys, dd, count);
+		}
+		for (std::size_t l = 0; l < W; ++l) {
+			st.fresh[l] = false;
+			if (t[l] + dt[l] > t1) dt[l] = t1 - t[l];
+		}
+
+		// ****************  Newton iteration for the stages:  **********
+		f.template jac_lanes<W>(t, y, J.data());
+		count.jac_evals += st.n_active;
+
+		// M = I - kron(dt*A, J), column-major:
+		for (std::size_t bj = 0; bj < Ns; ++bj) {
+			for (std::size_t m = 0; m < Neq; ++m) {
+				std::size_t col = bj*Neq + m;
+				for (std::size_t bi = 0; bi < Ns; ++bi) {
+					for (std::size_t n = 0; n < Neq; ++n) {
+						std::size_t row = bi*Neq + n;
+						double Id = row == col;
+						double *Mk = &M[(row + col*NN)*W];
+						const double *Jk = &J[(n + m*Neq)*W];
+#pragma omp simd
+						for (std::size_t l = 0; l < W; ++l) {
+							Mk[l] = Id - dt[l]*A[bi][bj]*Jk[l];
+						}
+					}
+				}
+			}
+		}
+		lu->factor(M.data());
+
+		for (std::size_t k = 0; k < NN*W; ++k) Yv[k] = 0.0;
+		construct_R();
+		for (std::size_t l = 0; l < W; ++l) {
+			done[l] = !st.active[l] || lu->singular[l];
+			converged[l] = false;
+			xnorm2[l] = 0.0;
+			theta[l]  = 0.0;
+			Rnorm2[l] = 0.0;
+			for (std::size_t k = 0; k < NN; ++k) {
+				Rnorm2[l] += R[k*W + l]*R[k*W + l];
+			}
+			damp[l]  = 1.0 / std::sqrt(1.0 + Rnorm2[l]);
+			iters[l] = 1;
+		}
+
+		for (int it = 1; it < maxit; ++it) {
+			bool all_done = true;
+			for (std::size_t l = 0; l < W; ++l) {
+				all_done = all_done && done[l];
+			}
+			if (all_done) break;
+
+			for (std::size_t k = 0; k < NN*W; ++k) dY[k] = -R[k];
+			lu->solve(dY.data());
+
+			for (std::size_t l = 0; l < W; ++l) {
+				if (done[l]) {
+					damp[l] = 0.0;
+					continue;
+				}
+				iters[l] = it;
+				xnorm2_o[l] = xnorm2[l];
+				xnorm2[l]   = 0.0;
+				for (std::size_t k = 0; k < NN; ++k) {
+					xnorm2[l] += dY[k*W + l]*dY[k*W + l];
+				}
+				if (it > 1 && xnorm2_o[l] > 0) {
+					theta[l] = std::sqrt(xnorm2[l] / xnorm2_o[l]);
+				}
+				if (it > 1 && xnorm2_o[l] < 0.81*xnorm2[l]) {
+					done[l]  = true;
+					damp[l] = 0.0;
+				}
+			}
+
+			for (std::size_t k = 0; k < NN; ++k) {
+#pragma omp simd
+				for (std::size_t l = 0; l < W; ++l) {
+					Yv[k*W + l] += damp[l]*dY[k*W + l];
+				}
+			}
+			construct_R();
+
+			for (std::size_t l = 0; l < W; ++l) {
+				if (done[l]) continue;
+				Rnorm2[l] = 0.0;
+				for (std::size_t k = 0; k < NN; ++k) {
+					Rnorm2[l] += R[k*W + l]*R[k*W + l];
+				}
+				if (Rnorm2[l] < Rtol2 || xnorm2[l] < xtol2) {
+					done[l] = converged[l] = true;
+				} else {
+					damp[l] = 1.0 / std::sqrt(1.0 + Rnorm2[l]);
+				}
+			}
+		}
+
+		// ****************  Construct solution at t + dt   ************
+		f.template fun_lanes<W>(t, y, f0);
+		count.fun_evals += st.n_active;
+
+		for (std::size_t n = 0; n < Neq; ++n) {
+#pragma omp simd
+			for (std::size_t l = 0; l < W; ++l) {
+				double d = 0.0, d2 = 0.0;
+				for (std::size_t i = 0; i < Ns; ++i) {
+					d  += d_w[i]*Yv[(i*Neq + n)*W + l];
+					d2 += d2_w[i]*Yv[(i*Neq + n)*W + l];
+				}
+				double gam = sc.gamma*dt[l];
+				y_n[n*W + l] = y[n*W + l] + d;
+				dd[n*W + l]  = gam*f0[n*W + l] + d2 - d;
+			}
+		}
+
+		// **************      Estimate error:    **********************
+		// Formula 8.19 of Hairer & Wanner, with E = I - gamma*dt*J:
+		for (std::size_t m = 0; m < Neq; ++m) {
+			for (std::size_t n = 0; n < Neq; ++n) {
+				double Id = n == m;
+				double *Ek = &E[(n + m*Neq)*W];
+				const double *Jk = &J[(n + m*Neq)*W];
+#pragma omp simd
+				for (std::size_t l = 0; l < W; ++l) {
+					Ek[l] = Id - sc.gamma*dt[l]*Jk[l];
+				}
+			}
+		}
+		// A singular E would give a zero estimate, so reject those
+		// lanes like the ones with a singular Newton matrix:
+		if (!lu_err->factor(E.data())) {
+			for (std::size_t l = 0; l < W; ++l) {
+				if (!lu_err->singular[l]) continue;
+				converged[l] = false;
+				theta[l] = 0.0;
+			}
+		}
+		lu_err->solve(dd);
+
+		for (std::size_t l = 0; l < W; ++l) {
+			err[l] = 0.0;
+		}
+		for (std::size_t n = 0; n < Neq; ++n) {
+			const double atol = solver_opts.abs_tol_of(n);
+#pragma omp simd
+			for (std::size_t l = 0; l < W; ++l) {
+				double y0i = std::fabs(y[n*W + l]);
+				double y1i = std::fabs(y_n[n*W + l]);
+				double sci = atol + rtol*std::max(y0i, y1i);
+				double e   = dt[l]*dd[n*W + l] / sci;
+				err[l] += e*e;
+			}
+		}
+
+		// ************* Per-lane step size control: ***********
+		for (std::size_t l = 0; l < W; ++l) {
+			if (!st.active[l]) continue;
+			++st.attempts[l];
+
+			if (!converged[l]) {
+				// As in irk_guts, aim for a contraction rate of
+				// about 0.5, or just halve dt without a rate:
+				double dt_fac = 0.5;
+				if (theta[l] > 0) {
+					dt_fac = std::max(0.1, std::min(0.7,
+					                  0.4 / theta[l]));
+				}
+				dt[l] *= dt_fac;
+				continue;
+			}
+
+			double e = std::max(std::sqrt(err[l] / Neq),
+			                    machine_precision);
+			bool accepted = e <= 1.0;
+			st.ctrl[l].fac = 0.9*(maxit + 1.0) / (maxit + iters[l]);
+			double new_dt = st.ctrl[l].next_dt(dt[l], e, accepted);
+			if (solver_opts.max_dt > 0) {
+				new_dt = std::min(solver_opts.max_dt, new_dt);
+			}
+
+			if (accepted) {
+				t[l] += dt[l];
+				++st.steps[l];
+				for (std::size_t n = 0; n < Neq; ++n) {
+					y[n*W + l] = y_n[n*W + l];
+				}
+			}
+			dt[l] = new_dt;
+
+			if (!(t[l] < t1)) {
+				st.finish(l, SUCCESS, out, count);
+				refill(l);
+			} else if (solver_opts.max_steps >= 0 &&
+			           st.steps[l] > solver_opts.max_steps) {
+				st.finish(l, ERROR_MAX_STEPS_EXCEEDED, out, count);
+				refill(l);
+			}
+		}
+	}
+}
+
+
+/**
+   \brief Sets up the output and threads for the lockstep integrators and
+   calls worker(q, work, out, count) on each thread.
+*/
+template <std::size_t Neq, std::size_t W, typename worker_type> inline
+ensemble_output run_lanes(std::size_t n_members,
+                          const std::vector<vec_type> &y0s, double t0,
+                          const solver_options &solver_opts,
+                          worker_type worker)
+{
+	my_timer timer;
+	assert( !y0s.empty() && "Need at least one initial value!" );
+	assert( (y0s.size() == 1 || y0s.size() == n_members) &&
+	        "Number of initial values and parameters do not match!" );
+
+	ensemble_output out;
+	init_output(out, n_members, Neq, t0, false);
+	if (!solver_opts.abs_tols_match(Neq)) {
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: abs_tols needs one entry per "
+			          << "equation!\n";
+		}
+		// All members keep their initial GENERAL_ERROR status:
+		finish_output(out, std::vector<ensemble_output::counters>());
+		return out;
+	}
+
+	// Every thread should have at least one full set of lanes:
+	std::size_t n_threads = pool_size(solver_opts, (n_members + W - 1) / W);
+	work_queues work(n_members, n_threads);
+	std::vector<ensemble_output::counters> counts(n_threads);
+
+	run_pool(n_threads, [&](std::size_t q) {
+			worker(q, work, out, counts[q]);
+		});
+
+	finish_output(out, counts);
+	out.elapsed_time = timer.toc();
+	return out;
+}
+
+
+/**
+   \brief Time-integrate an ensemble of small ODEs from t0 to t1, W members
+   at a time in lockstep.
+
+   The method is given by the tableau (solver_opts.method is ignored) and
+   has to have an embedded pair. Only the final states are kept, so
+   solver_opts.store_solutions is ignored too.
+
+   \tparam tableau     A tableau from erk::tableaux.
+   \tparam Neq         Number of equations of each member.
+   \tparam W           Number of lanes, e.g. 4 for AVX2 or 8 for AVX-512.
+
+   \param set_params   Callable as set_params(functor_type&, lane,
+                       const param_type&), which sets the parameters of
+                       the given lane.
+
+   See odeint for the other parameters.
+*/
+template <typename tableau, std::size_t Neq, std::size_t W,
+          typename functor_type, typename param_type,
+          typename param_setter> inline
+ensemble_output odeint_lanes(const functor_type &func, double t0, double t1,
+                             const std::vector<vec_type> &y0s,
+                             const std::vector<param_type> &params,
+                             param_setter set_params,
+                             const solver_options &solver_opts)
+{
+	static_assert(tableau::order2 > 0,
+	              "Lockstep integration needs an embedded method!");
+	static_assert(Neq > 0 && W > 0, "Need at least one equation and lane!");
+
+	std::size_t n_members = params.empty() ? y0s.size() : params.size();
+	return run_lanes<Neq, W>(n_members, y0s, t0, solver_opts,
+		[&](std::size_t q, work_queues &work, ensemble_output &out,
+		    ensemble_output::counters &count) {
+			run_lanes_worker<tableau, Neq, W>(q, work, func, t0, t1,
+			                                  y0s, params, set_params,
+			                                  solver_opts, out, count);
+		});
+}
+
+
+/**
+   \brief Time-integrate an ensemble of small ODEs that only differ in their
+   initial values from t0 to t1, W members at a time in lockstep.
+
+   See the other odeint_lanes for the parameters.
+*/
+template <typename tableau, std::size_t Neq, std::size_t W,
+          typename functor_type> inline
+ensemble_output odeint_lanes(const functor_type &func, double t0, double t1,
+                             const std::vector<vec_type> &y0s,
+                             const solver_options &solver_opts)
+{
+	std::vector<int> params;
+	return odeint_lanes<tableau, Neq, W>(func, t0, t1, y0s, params,
+	                                     no_lane_params(), solver_opts);
+}
+
+
+/**
+   \brief Time-integrate an ensemble of small stiff ODEs from t0 to t1, W
+   members at a time in lockstep, with an implicit method.
+
+   solver_opts.method has to be a fully implicit method with Ns stages and
+   an embedded pair, e.g. RADAU_IIA_53 with Ns = 3. Only the final states
+   are kept.
+
+   \tparam Neq         Number of equations of each member.
+   \tparam Ns          Number of stages of the method.
+   \tparam W           Number of lanes.
+
+   See odeint_lanes for the other parameters.
+*/
+template <std::size_t Neq, std::size_t Ns, std::size_t W,
+          typename functor_type, typename param_type,
+          typename param_setter> inline
+ensemble_output odeint_lanes_implicit(const functor_type &func,
+                                      double t0, double t1,
+                                      const std::vector<vec_type> &y0s,
+                                      const std::vector<param_type> &params,
+                                      param_setter set_params,
+                                      const solver_options &solver_opts)
+{
+	static_assert(Neq > 0 && Ns > 0 && W > 0,
+	              "Need at least one equation, stage and lane!");
+
+	std::size_t n_members = params.empty() ? y0s.size() : params.size();
+	return run_lanes<Neq, W>(n_members, y0s, t0, solver_opts,
+		[&](std::size_t q, work_queues &work, ensemble_output &out,
+		    ensemble_output::counters &count) {
+			run_lanes_implicit_worker<Neq, Ns, W>(q, work, func, t0,
+			                                      t1, y0s, params,
+			                                      set_params,
+			                                      solver_opts, out,
+			                                      count);
+		});
+}
+
+/**
+   @}
+*/
+
+
+} // namespace ensemble
+
+
+#endif // ENSEMBLE_HPP
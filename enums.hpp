@@ -54,7 +54,11 @@
 	METHOD(GAUSS_LEGENDRE_42,  240)   \
 	METHOD(GAUSS_LEGENDRE_63,  241)   \
 	METHOD(GAUSS_LEGENDRE_105, 242)   \
-	METHOD(GAUSS_LEGENDRE_147, 243)
+	METHOD(GAUSS_LEGENDRE_147, 243)   \
+	                                  \
+	METHOD(ESDIRK_23, 250)            \
+	METHOD(ESDIRK_34, 251)            \
+	METHOD(SDIRK_45,  252)
 
 
 #define FOREACH_ERK_METHOD(METHOD)        \
@@ -121,8 +125,14 @@ enum odeint_status_codes {
 	/// The error exceeded the absolute tolerance
 	ERROR_LARGER_THAN_ABSTOL = 64,
 
-	ERROR_MAX_STEPS_EXCEEDED = 128
-	
+	ERROR_MAX_STEPS_EXCEEDED = 128,
+
+	/// The explicit integrator detected stiffness and stopped early
+	STIFFNESS_DETECTED = 256,
+
+	/// The implicit integrator detected the problem is no longer stiff
+	/// and stopped early
+	NONSTIFFNESS_DETECTED = 512
 };
 
 static constexpr const double machine_precision = 1e-17;
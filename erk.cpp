@@ -9,203 +9,79 @@ using namespace erk;
 
 namespace erk {
 
+// Definitions of the static tableau members (see erk_tableaux.hpp):
+#define DEFINE_ERK_TABLEAU(METHOD, TABLEAU)                  \
+	constexpr int TABLEAU::method;                         \
+	constexpr std::size_t TABLEAU::Ns;                     \
+	constexpr int TABLEAU::order;                          \
+	constexpr int TABLEAU::order2;                         \
+	constexpr bool TABLEAU::FSAL;                          \
+	constexpr double TABLEAU::A[TABLEAU::Ns][TABLEAU::Ns]; \
+	constexpr double TABLEAU::b[TABLEAU::Ns];              \
+	constexpr double TABLEAU::b2[TABLEAU::Ns];             \
+	constexpr double TABLEAU::c[TABLEAU::Ns];
+
+FOREACH_ERK_TABLEAU(DEFINE_ERK_TABLEAU)
+
+#undef DEFINE_ERK_TABLEAU
+
+
+/**
+   \brief Converts a compile-time tableau to run-time solver coefficients.
+*/
+template <typename tableau>
+void tableau_to_coeffs( solver_coeffs &sc )
+{
+	const std::size_t Ns = tableau::Ns;
+	sc.A.zeros( Ns, Ns );
+	sc.b.set_size( Ns );
+	sc.c.set_size( Ns );
+	for( std::size_t i = 0; i < Ns; ++i ){
+		for( std::size_t j = 0; j < Ns; ++j ){
+			sc.A(i,j) = tableau::A[i][j];
+		}
+		sc.b(i) = tableau::b[i];
+		sc.c(i) = tableau::c[i];
+	}
+
+	// Methods without an embedded pair have an empty b2:
+	if( tableau::order2 > 0 ){
+		sc.b2.set_size( Ns );
+		for( std::size_t i = 0; i < Ns; ++i ){
+			sc.b2(i) = tableau::b2[i];
+		}
+	}
+
+	sc.order  = tableau::order;
+	sc.order2 = tableau::order2;
+	sc.FSAL   = tableau::FSAL;
+}
+
+
 solver_coeffs get_coefficients( int method )
 {
 	solver_coeffs sc;
-	double one_third = 1.0/3.0;
-	double one_six = 1.0/6.0;
 
 	sc.FSAL = false;
 	sc.name = method_to_name( method );
 	sc.gamma = 0.0;
 
+	// The coefficients themselves are in erk_tableaux.hpp:
+#define ERK_TABLEAU_CASE(METHOD, TABLEAU)       \
+	case METHOD:                            \
+		tableau_to_coeffs<TABLEAU>( sc ); \
+		break;
 
 	switch(method){
 	default:
 		std::cerr << "Method " << method << " not supported!\n";
 		break;
 
-	case EXPLICIT_EULER:
-		sc.A = { 0.0 };
-		sc.b = { 1.0 };
-		sc.c = { 0.0 };
-		sc.order = 1;
-		sc.order2 = 0;
-
-		break;
-
-	case RUNGE_KUTTA_4:
-		sc.A = { { 0.0, 0.0, 0.0, 0.0 },
-		         { 0.5, 0.0, 0.0, 0.0 },
-		         { 0.0, 0.5, 0.0, 0.0 },
-		         { 0.0, 0.0, 1.0, 0.0 } };
-		sc.b = { one_six, one_third, one_third, one_six };
-		sc.c = { 0.0, 0.5, 0.5, 1.0 };
-		sc.order = 4;
-		sc.order2 = 0;
-		break;
-		
-		
-	case BOGACKI_SHAMPINE_32:
-		sc.A  = { {  0.0,  0.0, 0.0, 0.0 },
-		          {  0.5,  0.0, 0.0, 0.0 },
-		          {  0.0, 0.75, 0.0, 0.0 },
-		          { 2.0/9.0, 1.0 / 3.0, 4.0 / 9.0, 0.0 } };
-		sc.b  =   { 2.0/9.0, 1.0 / 3.0, 4.0 / 9.0, 0.0 };
-		
-		sc.b2 = { 7.0/24.0, 0.25, 1.0/3.0, 1.0/8.0 };
-		
-		sc.c  = { 0.0, 0.5, 0.75, 1.0 };
-		
-		sc.FSAL = true;
-		sc.order  = 3;
-		sc.order2 = 2;
-		
-		break;
-		
-	case CASH_KARP_54:
-		sc.A.zeros( 6,6 );
-		
-		sc.A(1,0) =  1.0/5.0;
-		sc.A(2,0) =  3.0/40.0;
-		sc.A(3,0) =  3.0/10.0;
-		sc.A(4,0) = -11.0/54.0;
-		sc.A(5,0) =  1631.0/55296.0;
-		
-		sc.A(2,1) =  9.0/40.0;
-		sc.A(3,1) = -9.0/10.0;
-		sc.A(4,1) =  5.0/2.0;
-		sc.A(5,1) =  175.0/512.0;
-		
-		sc.A(3,2) =  6.0/5.0;
-		sc.A(4,2) = -70.0/27.0;
-		sc.A(5,2) =  575.0 / 13824.0;
-		
-		sc.A(4,3) =  35.0 / 27.0;
-		sc.A(5,3) =  44275.0 / 110592.0;
-		
-		sc.A(5,4) =  253.0 / 4096.0;
-		
-		sc.b = {37.0 / 378.0,
-		        0.0,
-		        250.0 / 621.0,
-		        125.0 / 594.0,
-		        0.0,
-		        512.0 / 1771.0 };
-		sc.b2 = {2825.0/27648.0,
-		         0.0,
-		         18575.0 / 48384.0,
-		         13525.0 / 55296.0,
-		         277.0 / 14336.0,
-		         1.0/4.0 };
-		
-		sc.c = { 0.0,
-		         0.2,
-		         0.3,
-		         0.6,
-		         1.0,
-		         7.0/8.0 };
-		
-		sc.order = 5;
-		sc.order2 = 4;
-		
-		break;
-	case DORMAND_PRINCE_54:
-		sc.A.zeros( 7,7 );
-		
-		sc.A(1,0) =  1.0/5.0;
-		sc.A(2,0) =  3.0/40.0;
-		sc.A(3,0) =  44.0/45.0;
-		sc.A(4,0) =  19372.0 / 6561.0;
-		sc.A(5,0) =  9017.0 / 3168.0;
-		sc.A(6,0) =  35.0/384.0;
-			
-		sc.A(2,1) =  9.0/40.0;
-		sc.A(3,1) = -56.0/15.0;
-		sc.A(4,1) = -25360.0/2187.0;
-		sc.A(5,1) =  -355.0/33.0;
-		sc.A(6,1) =  0.0;
-
-		sc.A(3,2) =  32.0/9.0;
-		sc.A(4,2) =  64448.0 / 6561.0;
-		sc.A(5,2) =  46732.0 / 5247.0;
-		sc.A(6,2) =  500.0 / 1113.0;
-
-		sc.A(4,3) = -212.0 / 729.0;
-		sc.A(5,3) =  49.0 / 176.0;
-		sc.A(6,3) =  125.0/192.0;
-
-		sc.A(5,4) = -5103.0 / 18656.0;
-		sc.A(6,4) = -2187.0 / 6784.0;
-
-		sc.A(6,5) =  11.0/84.0;
-
-		sc.c  = {0.0,
-		         0.2,
-		         0.3,
-		         0.8,
-		         8.0/9.0,
-		         1.0,
-		         1.0};
-		sc.b  = {35.0 / 384.0,
-		         0.0,
-		         500.0 / 1113.0,
-		         125.0/192.0,
-		         -2187.0 / 6784.0,
-		         11.0 / 84.0,
-		         0.0 };
-		sc.b2 = {5179.0/57600.0,
-		         0.0,
-		         7571.0 / 16695.0,
-		         393.0 / 640.0,
-		         -92097.0 / 339200.0,
-		         187.0/2100.0,
-		         1.0/40.0 };
-		sc.order = 5;
-		sc.order2 = 4;
-		sc.FSAL = true;
-		break;
-
-	case FEHLBERG_54:
-		sc.A.zeros( 6,6 );
-		sc.A(1,0) =  1.0/4.0;
-		sc.A(2,0) =  3.0/32.0;
-		sc.A(3,0) =  1932.0/2197.0;
-		sc.A(4,0) =  439.0/216.0;
-		sc.A(5,0) = -8.0/27.0;
-
-		sc.A(2,1) =  9.0/32.0;
-		sc.A(3,1) = -7200.0/2197.0;
-		sc.A(4,1) = -8.0;
-		sc.A(5,1) =  2.0;
-
-		sc.A(3,2) =  7296.0/2197.0;
-		sc.A(4,2) =  3680.0/513.0;
-		sc.A(5,2) = -3544.0/2565.0;
-
-		sc.A(4,3) = -845.0/4104.0;
-		sc.A(5,3) =  1859.0/4104.0;
-
-		sc.A(5,4) = -11.0/40.0;
-
-		sc.c = { 0.0,
-		         0.25,
-		         0.375,
-		         12.0/13.0,
-		         1.0,
-		         0.5 };
-
-		sc.b  = { 16.0/135.0, 0.0, 6656.0/12825.0,
-		          28561.0 / 56430.0, -9.0/50.0, 2.0/55.0 };
-		sc.b2 = { 25.0 / 216.0, 0.0, 1408.0/2565.0,
-		          2197.0/4104.0, -1.0/5.0, 0.0 };
-
-		sc.order  = 5;
-		sc.order2 = 4;
-
-		break;
+	FOREACH_ERK_TABLEAU(ERK_TABLEAU_CASE)
 	}
 
+#undef ERK_TABLEAU_CASE
+
 	// Some checks:
 	for( std::size_t i = 0; i < sc.c.size(); ++i ){
 		double ci = sc.c(i);
@@ -266,7 +142,10 @@ bool verify_solver_coeffs( const erk::solver_coeffs &sc )
 
 const char *method_to_name( int method )
 {
-	return erk::rk_method_to_string[method].c_str();
+	// Use find, so that concurrent calls never modify the map:
+	auto it = erk::rk_method_to_string.find( method );
+	if( it == erk::rk_method_to_string.end() ) return "";
+	return it->second.c_str();
 }
 
 
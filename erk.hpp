@@ -34,10 +34,13 @@
 
 #include "arma_include.hpp"
 #include "enums.hpp"
+#include "erk_tableaux.hpp"
 #include "my_timer.hpp"
 #include "newton.hpp"
 #include "options.hpp"
 #include "output.hpp"
+#include "step_size.hpp"
+#include "workspace.hpp"
 
 
 
@@ -94,7 +97,9 @@ struct solver_options : common_solver_options {
 
 	/// \brief Constructor with default values.
 	solver_options() : adaptive_step_size(true),
-	                   extrapolate_stage(false)
+	                   extrapolate_stage(false),
+	                   detect_stiffness(false),
+	                   stiffness_bound(3.25)
 	{ }
 
 	~solver_options()
@@ -108,6 +113,15 @@ struct solver_options : common_solver_options {
 	/// \note This is hard for RK-methods not based on quadrature, so is
 	/// generally not supported.
 	bool extrapolate_stage;
+
+	/// If true, stop with status STIFFNESS_DETECTED once the problem
+	/// seems to have become stiff (see \ref stiffness_bound).
+	bool detect_stiffness;
+
+	/// The problem is deemed stiff if dt*rho, with rho an estimate of the
+	/// dominant eigenvalue of the Jacobi matrix, exceeds this repeatedly.
+	/// 3.25 is roughly the stability boundary of DORMAND_PRINCE_54.
+	double stiffness_bound;
 };
 
 
@@ -127,10 +141,16 @@ static std::map<std::string,int> rk_string_to_method = {
 struct rk_output : basic_output
 {
 	struct counters {
-		counters() : attempt(0), reject_err(0), fun_evals(0) {}
+		counters() : attempt(0), reject_err(0), max_reject_streak(0),
+		             fun_evals(0), workspace_resizes(0) {}
 
 		std::size_t attempt, reject_err;
+		/// Longest sequence of consecutive steps rejected on error.
+		std::size_t max_reject_streak;
 		std::size_t fun_evals;
+		/// Times the per-step workspace of the integrator had to be
+		/// resized. This does not count other heap allocations.
+		std::size_t workspace_resizes;
 	};
 
 	std::vector<vec_type> stages;
@@ -140,6 +160,9 @@ struct rk_output : basic_output
 
 	double elapsed_time, accept_frac;
 
+	/// The time step size the integrator would have attempted next.
+	double next_dt;
+
 	counters count;
 };
 
@@ -227,7 +250,7 @@ vec_type project_b( double theta, const erk::solver_coeffs &sc );
    \param Ks stage matrix
    \param Ns number of stages.
 */
-void apply_fsal(mat_type &Ks, std::size_t Ns)
+inline void apply_fsal(mat_type &Ks, std::size_t Ns)
 {
 	Ks.col(0) = std::move(Ks.col(Ns-1));
 }
@@ -239,13 +262,227 @@ void apply_fsal(mat_type &Ks, std::size_t Ns)
    \param Ks stage matrix
    \param Ns number of stages.
 */
-void no_apply_fsal_dummy(mat_type &Ks, std::size_t Ns)
+inline void no_apply_fsal_dummy(mat_type &Ks, std::size_t Ns)
 { }
 
 
 
 /**
-   \brief Guts of the explicit RK integrator.
+   \brief Computes the stages and the update for a run-time tableau.
+
+   The stage values are accumulated in place, skipping zero coefficients.
+*/
+struct runtime_stepper
+{
+	typedef vec_type state_type;  ///< Type of y and the stage values
+	typedef mat_type stages_type; ///< Type of the stage matrix
+
+	explicit runtime_stepper(const solver_coeffs &sc) : sc(sc) {}
+
+	/**
+	   \brief Computes the stages k_i = f(t + c_i*dt, Y_i) for i >= start.
+
+	   \param eval     Evaluates the ODE RHS.
+	   \param Ks       Contains the stages as columns.
+	   \param Y_prev   If not null, will contain Y_{Ns-2}.
+	   \param Y_last   If not null, will contain Y_{Ns-1}.
+	*/
+	template <typename eval_type>
+	void stages(eval_type &eval, double t, double dt, const vec_type &y,
+	            mat_type &Ks, std::size_t start,
+	            vec_type *Y_prev, vec_type *Y_last)
+	{
+		std::size_t Ns = sc.b.size();
+		for (std::size_t i = start; i < Ns; ++i) {
+			tmp = y;
+			for (std::size_t j = 0; j < i; ++j) {
+				if (sc.A(i,j) == 0.0) continue;
+				tmp += (dt*sc.A(i,j))*Ks.col(j);
+			}
+			Ks.col(i) = eval(t + sc.c(i)*dt, tmp);
+
+			if (Y_prev && i + 2 == Ns) *Y_prev = tmp;
+			if (Y_last && i + 1 == Ns) *Y_last = tmp;
+		}
+	}
+
+	/**
+	   \brief Forms the updates Ks*b and, if delta_alt is not null, Ks*b2.
+	*/
+	void combine(const mat_type &Ks, vec_type &delta_y,
+	             vec_type *delta_alt) const
+	{
+		delta_y = Ks*sc.b;
+		if (delta_alt) *delta_alt = Ks*sc.b2;
+	}
+
+	const solver_coeffs &sc;
+	vec_type tmp;
+};
+
+
+/**
+   \brief Storage for a state of Nc components and Ns stages. For Nc > 0
+   this uses Armadillo's fixed-size types, which live on the stack. Nc = 0
+   means the size is only known at run-time.
+*/
+template <std::size_t Nc, std::size_t Ns>
+struct state_storage
+{
+	typedef arma::vec::fixed<Nc> state_type;
+	typedef arma::mat::fixed<Nc,Ns> stages_type;
+};
+
+template <std::size_t Ns>
+struct state_storage<0, Ns>
+{
+	typedef vec_type state_type;
+	typedef mat_type stages_type;
+};
+
+
+/**
+   \brief Sum of coeffs::value(j)*x[j*stride] for j < J, unrolled at
+   compile time. Terms with a zero coefficient vanish.
+*/
+template <typename coeffs, std::size_t J>
+struct unrolled_sum
+{
+	static double apply(const double *x, std::size_t stride)
+	{
+		return unrolled_sum<coeffs, J-1>::apply(x, stride)
+			+ (coeffs::value(J-1) == 0.0 ? 0.0
+			   : coeffs::value(J-1) * x[(J-1)*stride]);
+	}
+};
+
+template <typename coeffs>
+struct unrolled_sum<coeffs, 0>
+{
+	static double apply(const double *, std::size_t)
+	{ return 0.0; }
+};
+
+
+/// Row i of the A matrix of a tableau, for use with unrolled_sum.
+template <typename tableau, std::size_t i>
+struct tableau_row_A
+{
+	static constexpr double value(std::size_t j) { return tableau::A[i][j]; }
+};
+
+/// The weights b of a tableau, for use with unrolled_sum.
+template <typename tableau>
+struct tableau_row_b
+{
+	static constexpr double value(std::size_t j) { return tableau::b[j]; }
+};
+
+/// The embedded weights b2 of a tableau, for use with unrolled_sum.
+template <typename tableau>
+struct tableau_row_b2
+{
+	static constexpr double value(std::size_t j) { return tableau::b2[j]; }
+};
+
+
+/**
+   \brief Computes stages 0 to i-1 of a compile-time tableau.
+
+   For each component the stage value is a single fused sum over the
+   non-zero coefficients, which for small systems is a lot cheaper than a
+   vector operation per coefficient. If Nc > 0, it is the number of
+   equations, which allows unrolling the loop over the components too.
+*/
+template <typename tableau, std::size_t i, std::size_t Nc = 0>
+struct unrolled_stages
+{
+	template <typename eval_type>
+	static void apply(eval_type &eval, double t, double dt,
+	                  const vec_type &y, mat_type &Ks, std::size_t start,
+	                  vec_type &tmp, vec_type *Y_prev, vec_type *Y_last)
+	{
+		unrolled_stages<tableau, i-1, Nc>::apply(eval, t, dt, y, Ks,
+		                                         start, tmp,
+		                                         Y_prev, Y_last);
+		const std::size_t s = i - 1;
+		if (s < start) return;
+
+		const std::size_t Neq = Nc > 0 ? Nc : y.size();
+		const double *K = Ks.memptr();
+		for (std::size_t n = 0; n < Neq; ++n) {
+			tmp(n) = y(n) + dt*unrolled_sum<tableau_row_A<tableau,s>, s>
+				::apply(K + n, Neq);
+		}
+		Ks.col(s) = eval(t + tableau::c[s]*dt, tmp);
+
+		if (Y_prev && s + 2 == tableau::Ns) *Y_prev = tmp;
+		if (Y_last && s + 1 == tableau::Ns) *Y_last = tmp;
+	}
+};
+
+template <typename tableau, std::size_t Nc>
+struct unrolled_stages<tableau, 0, Nc>
+{
+	template <typename eval_type>
+	static void apply(eval_type &, double, double, const vec_type &,
+	                  mat_type &, std::size_t, vec_type &,
+	                  vec_type *, vec_type *)
+	{ }
+};
+
+
+/**
+   \brief Computes the stages and the update for a compile-time tableau
+   (see erk_tableaux.hpp). Has the same interface as runtime_stepper.
+
+   If Nc > 0, the system has Nc equations and all vectors have a fixed
+   size (see state_storage).
+*/
+template <typename tableau, std::size_t Nc = 0>
+struct static_stepper
+{
+	typedef typename state_storage<Nc, tableau::Ns>::state_type state_type;
+	typedef typename state_storage<Nc, tableau::Ns>::stages_type stages_type;
+
+	template <typename eval_type>
+	void stages(eval_type &eval, double t, double dt, const vec_type &y,
+	            mat_type &Ks, std::size_t start,
+	            vec_type *Y_prev, vec_type *Y_last)
+	{
+		tmp.set_size(y.size());
+		unrolled_stages<tableau, tableau::Ns, Nc>::apply(eval, t, dt, y,
+		                                                 Ks, start, tmp,
+		                                                 Y_prev, Y_last);
+	}
+
+	void combine(const mat_type &Ks, vec_type &delta_y,
+	             vec_type *delta_alt) const
+	{
+		const std::size_t Neq = Nc > 0 ? Nc : Ks.n_rows;
+		const double *K = Ks.memptr();
+		delta_y.set_size(Neq);
+		for (std::size_t n = 0; n < Neq; ++n) {
+			delta_y(n) = unrolled_sum<tableau_row_b<tableau>, tableau::Ns>
+				::apply(K + n, Neq);
+		}
+		if (!delta_alt) return;
+
+		delta_alt->set_size(Neq);
+		for (std::size_t n = 0; n < Neq; ++n) {
+			(*delta_alt)(n) =
+				unrolled_sum<tableau_row_b2<tableau>, tableau::Ns>
+				::apply(K + n, Neq);
+		}
+	}
+
+	state_type tmp;
+};
+
+
+
+/**
+   \brief Guts of the explicit RK integrator, for any stepper.
    Time-integrates a given ODE from t0 to t1, starting at y0
 
    t_vals and y_vals shall be unmodified upon failure.
@@ -255,26 +492,56 @@ void no_apply_fsal_dummy(mat_type &Ks, std::size_t Ns)
    \param t1           Final time
    \param y0           Initial values
    \param solver_opts  Options for the internal solver.
-   \param dt           Initial time step size.
+   \param dt           Initial time step size. If <= 0, it is estimated.
    \param sc           Coefficients of the solver.
+   \param stepper      Computes the stages and update (see runtime_stepper)
 
    \returns an output struct with the solution.
 */
-template <typename functor_type> inline
-rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
-                   const solver_options &solver_opts, double dt,
-                   const solver_coeffs &sc )
+template <typename functor_type, typename stepper_type> inline
+rk_output erk_guts_impl(functor_type &func, double t0, double t1,
+                        const vec_type &y0,
+                        const solver_options &solver_opts, double dt,
+                        const solver_coeffs &sc, stepper_type &stepper)
 {
+	if (!solver_opts.abs_tols_match(y0.size())) {
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: abs_tols needs one entry per "
+			          << "equation!\n";
+		}
+		rk_output sol;
+		sol.status = GENERAL_ERROR;
+		return sol;
+	}
+
+	// If no initial time step is given, estimate one. With constant
+	// time steps this is also the step size used throughout:
+	std::size_t init_fun_evals = 0;
+	if (dt <= 0.0) {
+		int order = step_size_order(sc.order, sc.order2);
+		dt = initial_dt(func, t0, t1, y0, order, solver_opts.abs_tol,
+		                solver_opts.rel_tol, solver_opts.max_dt,
+		                init_fun_evals, solver_opts.abs_tols);
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: Estimated initial dt = "
+			          << dt << "\n";
+		}
+	}
+
 	if( t0 + dt > t1 ){
-		std::cerr << "    Rehuel: Initial dt (" << dt;
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: Initial dt (" << dt
+			          << ") too large for interval! Reducing to "
+			          << t1 - t0 << "\n";
+		}
 		dt = t1 - t0;
-		std::cerr << ") too large for interval! Reducing to "
-		          << dt << "\n";
 	}
 
-	std::cerr << "    Rehuel: Integrating over interval [ "
-	          << t0 << ", " << t1 << " ]...\n"
-	          << "            Method = " << sc.name << "\n";
+	if (!solver_opts.quiet) {
+		std::cerr << "    Rehuel: Integrating over interval [ "
+		          << t0 << ", " << t1 << " ]...\n"
+		          << "            Method = " << sc.name << "\n";
+	}
 
 
 	// Explicit RK methods are a lot simpler.
@@ -284,32 +551,41 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 	double t = t0;
 	rk_output sol;
 	sol.status = SUCCESS;
+	sol.count.fun_evals += init_fun_evals;
 
 	assert(dt > 0 && "Cannot use time step size <= 0!");
 	std::size_t Neq = y0.size();
 	std::size_t Ns  = sc.b.size();
 
-	vec_type y = y0;
+	typedef typename stepper_type::state_type state_type;
+	typedef typename stepper_type::stages_type stages_type;
+
+	state_type y = y0;
 	// Ks is the stages at the new time step.
-	mat_type Ks(Neq,Ns);
+	stages_type Ks;
+	Ks.zeros(Neq,Ns);
 	long long int step = 0;
-	// For time step size control.
-	double dts[3] = {dt, dt, dt}, errs[3] = {0.9,0.9,0.9};
 
 	if( solver_opts.out_interval > 0 ){
 		std::cerr  << "    Rehuel: step  t  dt   err\n";
 	}
 
 	double err = 0.0;
-	vec_type err_est = arma::zeros(Neq);
+	state_type err_est;
+	err_est.zeros(Neq);
 	sol.t_vals.push_back(t);
 	sol.y_vals.push_back(y);
 	sol.stages.push_back(vectorise(Ks));
 	sol.err_est.push_back( err_est );
 	sol.err.push_back( err );
 
-	// This will keep track of error estimates during integration.
-	std::size_t min_order = std::min( sc.order, sc.order2 );
+	// For time step size control:
+	int ctrl_type = solver_opts.step_controller;
+	if (ctrl_type == common_solver_options::DEFAULT_CONTROLLER) {
+		ctrl_type = common_solver_options::PI_GUSTAFSSON;
+	}
+	step_controller ctrl(ctrl_type, step_size_order(sc.order, sc.order2),
+	                     4.0);
 
 	// If your method has FSAL, you never have to compute the first stage
 	// after the first step.
@@ -326,6 +602,17 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 		fsal_hook_fptr = apply_fsal;
 	}
 
+	// For stiffness detection (Hairer & Wanner, Solving ODEs II, IV.2):
+	// The last two stages estimate the dominant eigenvalue as
+	// rho = |k_s - k_{s-1}| / |Y_s - Y_{s-1}|, with Y_i the stage values.
+	const bool detect_stiffness = solver_opts.detect_stiffness && (Ns > 1);
+	state_type Y_last, Y_prev;
+	int n_stiff = 0, n_nonstiff = 0;
+
+	// The temporaries of each step are kept in a workspace:
+	enum workspace_vecs { WS_DELTA_Y = 0, WS_DELTA_ALT, WS_Y_N, N_WS_VECS };
+	workspace<state_type, stages_type> ws(N_WS_VECS, 0);
+
 	while( t < t1 ) {
 		// ****************  Calculate stages:   ************
 		// Make sure you stop exactly at t = t1.
@@ -336,78 +623,50 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 
 		if (solver_opts.max_steps >= 0 &&
 		    step > solver_opts.max_steps) {
-			std::cerr << "    Rehuel: Maximum number of attempts exceeded.\n";
+			if (!solver_opts.quiet) {
+				std::cerr << "    Rehuel: Maximum number of "
+				          << "attempts exceeded.\n";
+			}
 			sol.status = ERROR_MAX_STEPS_EXCEEDED;
-			return sol;
+			break;
 		}
 
 		int integrator_status = 0;
 
 		// Formula for explicit stages are
 		// k_i = f(t + ci*dt, y0 + sum_{j=1}^{i-1} A(i,j)*k_j)
-		for (std::size_t i = stage_iter_start; i < Ns; ++i) {
-			vec_type tmp = y;
-			for (std::size_t j = 0; j < i; ++j) {
-				tmp += dt*sc.A(i,j)*Ks.col(j);
-			}
-			Ks.col(i) = eval_fun(t + sc.c(i)*dt, tmp);
-		}
+		stepper.stages(eval_fun, t, dt, y, Ks, stage_iter_start,
+		               detect_stiffness ? &Y_prev : nullptr,
+		               detect_stiffness ? &Y_last : nullptr);
 	
 		// ************* Form solution at t + dt: ***********
-		vec_type delta_y = Ks*sc.b;
-		vec_type y_n     = y + dt*delta_y;
+		state_type &delta_y   = ws.vec(WS_DELTA_Y, Neq);
+		state_type &delta_alt = ws.vec(WS_DELTA_ALT, Neq);
+		state_type &y_n       = ws.vec(WS_Y_N, Neq);
+		stepper.combine(Ks, delta_y, solver_opts.adaptive_step_size ?
+		                &delta_alt : nullptr);
+		y_n = y + dt*delta_y;
 		double new_dt    = dt;
 		
 		// If you have no adaptive step size, error calculation
 		// might not be very sensible.
 		if (solver_opts.adaptive_step_size) {
-			vec_type delta_alt = Ks*sc.b2;
-		
 			// ************* Error estimate: ***********
-			double err_tot = 0.0;
-			double atol = solver_opts.abs_tol, rtol = solver_opts.rel_tol;
 			// err_est is ||y1 - yhat1|| in Wanner & Hairer.
 			err_est = dt*(delta_alt - delta_y);
-			double n = Neq;
-			for (std::size_t i = 0; i < Neq; ++i) {
-				double erri = err_est(i);
-				double y0i  = std::fabs(y(i));
-				double y1i  = std::fabs(y_n(i));
-				double sci  = atol + rtol * std::max(y0i, y1i);
-				double add = erri / sci;
-				err_tot += add*add;
-			}
-			err = std::sqrt(err_tot / n);
-			assert( err_tot >= 0.0 && "Error cannot be negative!" );
+			err = error_norm(err_est, y, y_n, solver_opts);
 			
 			if (err < machine_precision) {
 				err = machine_precision;
 			}
-			errs[2] = errs[1];
-			errs[1] = errs[0];
-			errs[0] = err;
 
 			// ************* Adaptive time step size control: ***********
-			// TODO: This might need optimization geared
-			//       to explicit methods.
 			// Error is too large to tolerate:
-			if (solver_opts.adaptive_step_size && (err >= 1.0)) {
+			if (err >= 1.0) {
 				integrator_status = 1;
 				sol.count.reject_err++;
 			}
-			
-			double fac  = 0.9;
-			double expt = 1.0 / (1.0 + min_order);
-			double err_inv = 1.0 / err;
-			double scale_27 = std::pow(err_inv, expt);
-			// double dt_rat = dts[0] / dts[1];
-			// double err_frac = errs[1] / errs[0];
-			// if (errs[1] == 0 || errs[0] == 0) {
-			// 	err_frac = 1.0;
-			// }
-			// double err_rat = std::pow(err_frac, expt);
-			double min_scale = scale_27; // std::min(scale_27, scale_28);
-			new_dt = fac * dt * std::min(4.0, min_scale);
+			new_dt = ctrl.next_dt(dt, err, integrator_status == 0);
 
 			if (solver_opts.max_dt > 0) {
 				new_dt = std::min(solver_opts.max_dt, new_dt);
@@ -434,6 +693,18 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 			sol.err_est.push_back(err_est);
 			sol.err.push_back(err);
 
+			if (detect_stiffness) {
+				double dY = arma::norm(Y_last - Y_prev);
+				double dK = arma::norm(Ks.col(Ns-1) - Ks.col(Ns-2));
+				if (dY > 0 && dt*dK > solver_opts.stiffness_bound*dY) {
+					n_nonstiff = 0;
+					++n_stiff;
+				} else {
+					++n_nonstiff;
+					if (n_nonstiff == 6) n_stiff = 0;
+				}
+			}
+
 			// If you reach here, your new time step has been
 			// accepted and your last stage can now be uesd
 			// as your first stage:
@@ -444,19 +715,29 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 		if (solver_opts.adaptive_step_size) {
 			dt = new_dt;
 		}
-		dts[2] = dts[1];
-		dts[1] = dts[0];
-		dts[0] = dt;
+
+		if (n_stiff >= 15) {
+			if (!solver_opts.quiet) {
+				std::cerr << "    Rehuel: Problem seems stiff at t = "
+				          << t << ".\n";
+			}
+			sol.status = STIFFNESS_DETECTED;
+			break;
+		}
 	}
 	double elapsed = timer.toc();
 	sol.elapsed_time = elapsed;
 	sol.accept_frac = static_cast<double>(step) / sol.count.attempt;
+	sol.next_dt = dt;
+	sol.count.max_reject_streak = ctrl.max_reject_streak;
+	sol.count.workspace_resizes = ws.resizes;
 	return sol;
 }
 
 	
 /**
-   \brief Time-integrate a given ODE from t0 to t1, starting at y0
+   \brief Guts of the explicit RK integrator.
+   Time-integrates a given ODE from t0 to t1, starting at y0
 
    t_vals and y_vals shall be unmodified upon failure.
 
@@ -464,28 +745,131 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
    \param t0           Starting time
    \param t1           Final time
    \param y0           Initial values
-   \param dt           Initial time step size.
    \param solver_opts  Options for the internal solver.
+   \param dt           Initial time step size. If <= 0, it is estimated.
+   \param sc           Coefficients of the solver.
 
-   \returns a status code (see \ref odeint_status_codes)
+   \returns an output struct with the solution.
 */
 template <typename functor_type> inline
-rk_output odeint(functor_type &func, double t0, double t1, const vec_type &y0,
-                 solver_options solver_opts,
-                 int method = erk::DORMAND_PRINCE_54, double dt = 1e-6)
+rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
+                   const solver_options &solver_opts, double dt,
+                   const solver_coeffs &sc )
+{
+	runtime_stepper stepper(sc);
+	return erk_guts_impl(func, t0, t1, y0, solver_opts, dt, sc, stepper);
+}
+
+
+/**
+   \brief Time-integrates a given ODE with the unrolled stepper for a
+   compile-time tableau (see erk_tableaux.hpp).
+
+   \param func         Functor of the ODE to integrate
+   \param t0           Starting time
+   \param t1           Final time
+   \param y0           Initial values
+   \param solver_opts  Options for the internal solver.
+   \param dt           Initial time step size. If <= 0, it is estimated.
+
+   \tparam Nc          If > 0, the number of equations, which makes all
+                       vectors fixed-size (see state_storage).
+
+   \returns an output struct with the solution.
+*/
+template <typename tableau, std::size_t Nc = 0, typename functor_type> inline
+rk_output erk_guts_static(functor_type &func, double t0, double t1,
+                          const vec_type &y0,
+                          const solver_options &solver_opts, double dt)
+{
+	assert((Nc == 0 || y0.size() == Nc) && "Wrong number of equations!");
+	solver_coeffs sc = get_coefficients(tableau::method);
+	static_stepper<tableau, Nc> stepper;
+	return erk_guts_impl(func, t0, t1, y0, solver_opts, dt, sc, stepper);
+}
+
+
+/**
+   \brief Sets up the coefficients for method and integrates with the
+   appropriate stepper. See odeint and odeint_fixed.
+*/
+template <std::size_t Nc, typename functor_type> inline
+rk_output odeint_dispatch(functor_type &func, double t0, double t1,
+                          const vec_type &y0, solver_options solver_opts,
+                          int method, double dt)
 {
 	solver_coeffs sc = get_coefficients(method);
 	if (solver_opts.adaptive_step_size && sc.b2.size() == 0) {
-		std::cerr << "    Rehuel: WARNING: Cannot have adaptive time "
-		          << "step with non-embedding method! Disabling "
-		          << "adaptive time step size!\n";
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: WARNING: Cannot have adaptive "
+			          << "time step with non-embedding method! "
+			          << "Disabling adaptive time step size!\n";
+		}
 		solver_opts.adaptive_step_size = false;
 	}
 
 	assert( verify_solver_coeffs( sc ) && "Invalid solver coefficients!" );
+
+	// The built-in methods use the unrolled stepper:
+#define ERK_STATIC_CASE(METHOD, TABLEAU)                                 \
+	case METHOD:                                                     \
+		return erk_guts_static<TABLEAU, Nc>(func, t0, t1, y0,    \
+		                                    solver_opts, dt);
+	switch (method) {
+		FOREACH_ERK_TABLEAU(ERK_STATIC_CASE)
+		default:
+			break;
+	}
+#undef ERK_STATIC_CASE
+
 	return erk_guts(func, t0, t1, y0, solver_opts, dt, sc);
 }
 
+
+/**
+   \brief Time-integrate a given ODE from t0 to t1, starting at y0
+
+   t_vals and y_vals shall be unmodified upon failure.
+
+   \param func         Functor of the ODE to integrate
+   \param t0           Starting time
+   \param t1           Final time
+   \param y0           Initial values
+   \param dt           Initial time step size. If <= 0, it is estimated.
+   \param solver_opts  Options for the internal solver.
+
+   \returns a status code (see \ref odeint_status_codes)
+*/
+template <typename functor_type> inline
+rk_output odeint(functor_type &func, double t0, double t1, const vec_type &y0,
+                 solver_options solver_opts,
+                 int method = erk::DORMAND_PRINCE_54, double dt = 0.0)
+{
+	return odeint_dispatch<0>(func, t0, t1, y0, solver_opts, method, dt);
+}
+
+
+/**
+   \brief Time-integrate a given ODE of Neq equations from t0 to t1,
+   starting at y0, with all internal vectors of fixed size.
+
+   For small systems this avoids most of the per-step overhead of
+   dynamically sized vectors. The functor is still called with and should
+   return an arma::vec.
+
+   \tparam Neq         Number of equations; must equal y0.size().
+
+   See odeint for the other parameters.
+*/
+template <std::size_t Neq, typename functor_type> inline
+rk_output odeint_fixed(functor_type &func, double t0, double t1,
+                       const vec_type &y0, solver_options solver_opts,
+                       int method = erk::DORMAND_PRINCE_54, double dt = 0.0)
+{
+	static_assert(Neq > 0, "Fixed-size systems need at least one equation!");
+	return odeint_dispatch<Neq>(func, t0, t1, y0, solver_opts, method, dt);
+}
+
 	
 /**
    \brief Time-integrate a given ODE from t0 to t1, starting at y0.
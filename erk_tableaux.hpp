@@ -0,0 +1,196 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file erk_tableaux.hpp
+
+   \brief Compile-time Butcher tableaux of the explicit RK methods.
+
+   These are the single source of the ERK coefficients. get_coefficients
+   converts them to a run-time solver_coeffs, and erk::odeint uses them
+   directly in an unrolled stepper (see erk::static_stepper).
+*/
+
+#ifndef ERK_TABLEAUX_HPP
+#define ERK_TABLEAUX_HPP
+
+#include <cstddef>
+
+#include "enums.hpp"
+
+
+namespace erk {
+
+/**
+   \brief Contains constexpr Butcher tableaux.
+
+   Each tableau has the method code, the number of stages Ns, the orders of
+   the main and embedded method, whether it is FSAL, and the coefficients
+   A, b, b2 and c. Methods without an embedded pair have b2 all zero and
+   order2 = 0. The static data members are defined in erk.cpp.
+*/
+namespace tableaux {
+
+struct explicit_euler {
+	static constexpr int method = EXPLICIT_EULER;
+	static constexpr std::size_t Ns = 1;
+	static constexpr int order  = 1;
+	static constexpr int order2 = 0;
+	static constexpr bool FSAL  = false;
+
+	static constexpr double A[Ns][Ns] = { { 0.0 } };
+	static constexpr double b[Ns]  = { 1.0 };
+	static constexpr double b2[Ns] = { 0.0 };
+	static constexpr double c[Ns]  = { 0.0 };
+};
+
+
+struct runge_kutta_4 {
+	static constexpr int method = RUNGE_KUTTA_4;
+	static constexpr std::size_t Ns = 4;
+	static constexpr int order  = 4;
+	static constexpr int order2 = 0;
+	static constexpr bool FSAL  = false;
+
+	static constexpr double A[Ns][Ns] = { { 0.0, 0.0, 0.0, 0.0 },
+	                                      { 0.5, 0.0, 0.0, 0.0 },
+	                                      { 0.0, 0.5, 0.0, 0.0 },
+	                                      { 0.0, 0.0, 1.0, 0.0 } };
+	static constexpr double b[Ns]  = { 1.0/6.0, 1.0/3.0, 1.0/3.0, 1.0/6.0 };
+	static constexpr double b2[Ns] = { 0.0, 0.0, 0.0, 0.0 };
+	static constexpr double c[Ns]  = { 0.0, 0.5, 0.5, 1.0 };
+};
+
+
+struct bogacki_shampine_32 {
+	static constexpr int method = BOGACKI_SHAMPINE_32;
+	static constexpr std::size_t Ns = 4;
+	static constexpr int order  = 3;
+	static constexpr int order2 = 2;
+	static constexpr bool FSAL  = true;
+
+	static constexpr double A[Ns][Ns] = {
+		{  0.0,  0.0, 0.0, 0.0 },
+		{  0.5,  0.0, 0.0, 0.0 },
+		{  0.0, 0.75, 0.0, 0.0 },
+		{ 2.0/9.0, 1.0 / 3.0, 4.0 / 9.0, 0.0 } };
+	static constexpr double b[Ns]  = { 2.0/9.0, 1.0 / 3.0, 4.0 / 9.0, 0.0 };
+	static constexpr double b2[Ns] = { 7.0/24.0, 0.25, 1.0/3.0, 1.0/8.0 };
+	static constexpr double c[Ns]  = { 0.0, 0.5, 0.75, 1.0 };
+};
+
+
+struct cash_karp_54 {
+	static constexpr int method = CASH_KARP_54;
+	static constexpr std::size_t Ns = 6;
+	static constexpr int order  = 5;
+	static constexpr int order2 = 4;
+	static constexpr bool FSAL  = false;
+
+	static constexpr double A[Ns][Ns] = {
+		{ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 1.0/5.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 3.0/40.0, 9.0/40.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 3.0/10.0, -9.0/10.0, 6.0/5.0, 0.0, 0.0, 0.0 },
+		{ -11.0/54.0, 5.0/2.0, -70.0/27.0, 35.0 / 27.0, 0.0, 0.0 },
+		{ 1631.0/55296.0, 175.0/512.0, 575.0 / 13824.0,
+		  44275.0 / 110592.0, 253.0 / 4096.0, 0.0 } };
+	static constexpr double b[Ns]  = { 37.0 / 378.0, 0.0, 250.0 / 621.0,
+	                                   125.0 / 594.0, 0.0, 512.0 / 1771.0 };
+	static constexpr double b2[Ns] = { 2825.0/27648.0, 0.0,
+	                                   18575.0 / 48384.0, 13525.0 / 55296.0,
+	                                   277.0 / 14336.0, 1.0/4.0 };
+	static constexpr double c[Ns]  = { 0.0, 0.2, 0.3, 0.6, 1.0, 7.0/8.0 };
+};
+
+
+struct dormand_prince_54 {
+	static constexpr int method = DORMAND_PRINCE_54;
+	static constexpr std::size_t Ns = 7;
+	static constexpr int order  = 5;
+	static constexpr int order2 = 4;
+	static constexpr bool FSAL  = true;
+
+	static constexpr double A[Ns][Ns] = {
+		{ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 1.0/5.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 3.0/40.0, 9.0/40.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 44.0/45.0, -56.0/15.0, 32.0/9.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 19372.0 / 6561.0, -25360.0/2187.0, 64448.0 / 6561.0,
+		  -212.0 / 729.0, 0.0, 0.0, 0.0 },
+		{ 9017.0 / 3168.0, -355.0/33.0, 46732.0 / 5247.0,
+		  49.0 / 176.0, -5103.0 / 18656.0, 0.0, 0.0 },
+		{ 35.0/384.0, 0.0, 500.0 / 1113.0, 125.0/192.0,
+		  -2187.0 / 6784.0, 11.0/84.0, 0.0 } };
+	static constexpr double b[Ns]  = { 35.0 / 384.0, 0.0, 500.0 / 1113.0,
+	                                   125.0/192.0, -2187.0 / 6784.0,
+	                                   11.0 / 84.0, 0.0 };
+	static constexpr double b2[Ns] = { 5179.0/57600.0, 0.0,
+	                                   7571.0 / 16695.0, 393.0 / 640.0,
+	                                   -92097.0 / 339200.0, 187.0/2100.0,
+	                                   1.0/40.0 };
+	static constexpr double c[Ns]  = { 0.0, 0.2, 0.3, 0.8, 8.0/9.0,
+	                                   1.0, 1.0 };
+};
+
+
+struct fehlberg_54 {
+	static constexpr int method = FEHLBERG_54;
+	static constexpr std::size_t Ns = 6;
+	static constexpr int order  = 5;
+	static constexpr int order2 = 4;
+	static constexpr bool FSAL  = false;
+
+	static constexpr double A[Ns][Ns] = {
+		{ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 1.0/4.0, 0.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 3.0/32.0, 9.0/32.0, 0.0, 0.0, 0.0, 0.0 },
+		{ 1932.0/2197.0, -7200.0/2197.0, 7296.0/2197.0, 0.0, 0.0, 0.0 },
+		{ 439.0/216.0, -8.0, 3680.0/513.0, -845.0/4104.0, 0.0, 0.0 },
+		{ -8.0/27.0, 2.0, -3544.0/2565.0, 1859.0/4104.0,
+		  -11.0/40.0, 0.0 } };
+	static constexpr double b[Ns]  = { 16.0/135.0, 0.0, 6656.0/12825.0,
+	                                   28561.0 / 56430.0, -9.0/50.0,
+	                                   2.0/55.0 };
+	static constexpr double b2[Ns] = { 25.0 / 216.0, 0.0, 1408.0/2565.0,
+	                                   2197.0/4104.0, -1.0/5.0, 0.0 };
+	static constexpr double c[Ns]  = { 0.0, 0.25, 0.375, 12.0/13.0,
+	                                   1.0, 0.5 };
+};
+
+
+/**
+   \brief Calls CALL(method, tableau) for every tableau.
+*/
+#define FOREACH_ERK_TABLEAU(CALL)                                   \
+	CALL(EXPLICIT_EULER,      erk::tableaux::explicit_euler)      \
+	CALL(RUNGE_KUTTA_4,       erk::tableaux::runge_kutta_4)       \
+	CALL(BOGACKI_SHAMPINE_32, erk::tableaux::bogacki_shampine_32) \
+	CALL(CASH_KARP_54,        erk::tableaux::cash_karp_54)        \
+	CALL(DORMAND_PRINCE_54,   erk::tableaux::dormand_prince_54)   \
+	CALL(FEHLBERG_54,         erk::tableaux::fehlberg_54)
+
+
+} // namespace tableaux
+
+} // namespace erk
+
+
+#endif // ERK_TABLEAUX_HPP
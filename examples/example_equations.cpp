@@ -39,7 +39,7 @@
 
 struct user_options {
 	user_options() : eq("exponential"), method("LOBATTO_IIIC_85"),
-	                 t0(0.0), t1(10.0), dt(1e-2),
+	                 t0(0.0), t1(10.0), dt(0.0),
 	                 rel_tol(1e-5), abs_tol(1e-4), out_interval(0) {}
 	std::string eq, method;
 
@@ -70,7 +70,8 @@ void print_usage()
 	          << "\t            Default is LOBATTO_IIIC_85\n\n"
 	          << "\t<t0>, <t1>: Initial and final time to integrate.\n\n"
 	          << "\t<dt>        Initial time step size to use. Adaptive\n"
-	          << "\t            integrators change this during integration\n\n"
+	          << "\t            integrators change this during integration.\n"
+	          << "\t            Default is 0, which estimates it.\n\n"
 	          << "\t<rtol>:     Relative error tolerance for integration\n\n"
 	          << "\t<atol>:     Absolute error tolerance for integration\n\n"
 	          << "\t<interval>: Output interval.\n\n"
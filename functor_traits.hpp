@@ -0,0 +1,133 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file functor_traits.hpp
+
+   \brief Detects optional extensions of ODE functors (see functor.hpp).
+*/
+
+#ifndef FUNCTOR_TRAITS_HPP
+#define FUNCTOR_TRAITS_HPP
+
+#include <type_traits>
+#include <utility>
+
+#include "arma_include.hpp"
+
+
+/**
+   \brief Tells whether a functor is marked thread-safe.
+
+   A functor whose fun may be called from several threads at once can
+   declare so with
+   \code{
+     static constexpr bool thread_safe = true;
+   \code}
+   The implicit integrators then may evaluate the stages concurrently (see
+   irk::solver_options::parallel_stages).
+*/
+template <typename functor_type, typename = void>
+struct functor_is_thread_safe : std::false_type {};
+
+template <typename functor_type>
+struct functor_is_thread_safe<functor_type,
+	typename std::enable_if<functor_type::thread_safe>::type>
+	: std::true_type {};
+
+
+/**
+   \brief Tells whether a functor can evaluate all stages of an implicit RK
+   step in one call.
+
+   Such a functor implements
+   \code{
+     void fun_stages(const arma::vec &t, const arma::mat &Y, arma::mat &F);
+   \code}
+   which sets F.col(i) = fun(t(i), Y.col(i)) for all columns of Y. This
+   allows the functor to vectorise over the stages.
+*/
+template <typename functor_type>
+struct functor_has_fun_stages
+{
+	template <typename F>
+	static auto test(int) -> decltype(
+		std::declval<F&>().fun_stages(std::declval<const arma::vec&>(),
+		                              std::declval<const arma::mat&>(),
+		                              std::declval<arma::mat&>()),
+		std::true_type());
+
+	template <typename F>
+	static std::false_type test(...);
+
+	static constexpr bool value = decltype(test<functor_type>(0))::value;
+};
+
+
+
+/**
+   \brief Tells whether a functor provides its Jacobi matrix with
+   \code{
+     jac_type jac(double t, const arma::vec &y);
+   \code}
+   If not, the implicit integrators approximate it with finite differences
+   (see jacobian::fd_functor).
+*/
+template <typename functor_type>
+struct functor_has_jac
+{
+	template <typename F>
+	static auto test(int) -> decltype(
+		std::declval<F&>().jac(std::declval<double>(),
+		                       std::declval<const arma::vec&>()),
+		std::true_type());
+
+	template <typename F>
+	static std::false_type test(...);
+
+	static constexpr bool value = decltype(test<functor_type>(0))::value;
+};
+
+
+/**
+   \brief Tells whether a functor can evaluate its RHS for complex y with
+   \code{
+     arma::cx_vec fun(double t, const arma::cx_vec &y);
+   \code}
+   Its Jacobi matrix then can be approximated with complex steps, which
+   is accurate to machine precision (see jacobian::cs_jacobian).
+*/
+template <typename functor_type>
+struct functor_has_complex_fun
+{
+	template <typename F>
+	static auto test(int) -> decltype(
+		std::declval<F&>().fun(std::declval<double>(),
+		                       std::declval<const arma::cx_vec&>()),
+		std::true_type());
+
+	template <typename F>
+	static std::false_type test(...);
+
+	static constexpr bool value = decltype(test<functor_type>(0))::value;
+};
+
+
+#endif // FUNCTOR_TRAITS_HPP
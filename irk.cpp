@@ -352,6 +352,11 @@ solver_coeffs get_coefficients( int method )
 
 		sc.b_interp = collocation_interpolate_coeffs( sc.c );
 
+		// Of the D that make I - inv(D)*A nilpotent, this one gives the
+		// smallest spectral radius (0.15) of the PIRK iteration matrix
+		// over all real z = dt*lambda < 0:
+		sc.pirk_d = { 0.2584183762028036, 0.6449489742783179 };
+
 		break;
 	}
 
@@ -381,6 +386,10 @@ solver_coeffs get_coefficients( int method )
 
 		sc.b_interp = collocation_interpolate_coeffs( sc.c );
 
+		// Chosen as for RADAU_IIA_32, spectral radius 0.18:
+		sc.pirk_d = { 0.3203827776857805, 0.1399668046773267,
+		              0.3716674595229118 };
+
 
 
 		break;
@@ -429,6 +438,11 @@ solver_coeffs get_coefficients( int method )
 
 		sc.b_interp = collocation_interpolate_coeffs( sc.c );
 
+		// Chosen as for RADAU_IIA_32, spectral radius 0.27:
+		sc.pirk_d = { 0.20305872415440468, 0.13595096202712373,
+		              0.06346726719772161, 0.17395343639056615,
+		              0.21700086219741466 };
+
 		break;
 	}
 
@@ -665,6 +679,63 @@ solver_coeffs get_coefficients( int method )
 		break;
 	}
 
+	// The (S)DIRK methods below use a classical embedded pair, so they
+	// leave sc.gamma at 0. Their stages are solved one at a time.
+	case ESDIRK_23: {
+		// TR-BDF2 (Hosea & Shampine), a trapezoidal stage followed by
+		// a BDF2 stage. The embedded method is of third order.
+		double g = 2.0 - std::sqrt(2.0);
+		double d = 0.25*std::sqrt(2.0);
+		sc.A = { {   0.0,   0.0,     0.0 },
+		         { 0.5*g, 0.5*g,     0.0 },
+		         {     d,     d,   0.5*g } };
+		sc.c  = { 0.0, g, 1.0 };
+		sc.b  = { d, d, 0.5*g };
+		sc.b2 = { (1.0 - d) / 3.0, (3.0*d + 1.0) / 3.0, g / 6.0 };
+
+		sc.order  = 2;
+		sc.order2 = 3;
+
+		break;
+	}
+
+	case ESDIRK_34: {
+		// Kvaerno's L-stable, stiffly accurate ESDIRK 3(2) method.
+		double g = 0.43586652150845899942;
+		double g2 = g*g;
+		sc.A = { { 0.0, 0.0, 0.0, 0.0 },
+		         { g, g, 0.0, 0.0 },
+		         { (-4*g2 + 6*g - 1) / (4*g), (1 - 2*g) / (4*g), g, 0.0 },
+		         { (6*g - 1) / (12*g), -1.0 / ((24*g - 12)*g),
+		           (-6*g2 + 6*g - 1) / (6*g - 3), g } };
+		sc.c  = { 0.0, 2*g, 1.0, 1.0 };
+		sc.b  = { sc.A(3,0), sc.A(3,1), sc.A(3,2), sc.A(3,3) };
+		sc.b2 = { sc.A(2,0), sc.A(2,1), sc.A(2,2), 0.0 };
+
+		sc.order  = 3;
+		sc.order2 = 2;
+
+		break;
+	}
+
+	case SDIRK_45: {
+		// The L-stable SDIRK method of Hairer & Wanner (SDIRK4 in
+		// Solving ODEs II, Table 6.5), with its third order embedding.
+		sc.A = { { 0.25, 0.0, 0.0, 0.0, 0.0 },
+		         { 0.5, 0.25, 0.0, 0.0, 0.0 },
+		         { 17.0/50.0, -1.0/25.0, 0.25, 0.0, 0.0 },
+		         { 371.0/1360.0, -137.0/2720.0, 15.0/544.0, 0.25, 0.0 },
+		         { 25.0/24.0, -49.0/48.0, 125.0/16.0, -85.0/12.0, 0.25 } };
+		sc.c  = { 0.25, 0.75, 11.0/20.0, 0.5, 1.0 };
+		sc.b  = { 25.0/24.0, -49.0/48.0, 125.0/16.0, -85.0/12.0, 0.25 };
+		sc.b2 = { 59.0/48.0, -17.0/96.0, 225.0/32.0, -85.0/12.0, 0.0 };
+
+		sc.order  = 4;
+		sc.order2 = 3;
+
+		break;
+	}
+
 	}
 
 	// Some checks:
@@ -685,6 +756,45 @@ solver_coeffs get_coefficients( int method )
 }
 
 
+bool is_method_explicit( const solver_coeffs &sc )
+{
+	std::size_t Ns = sc.b.size();
+	for( std::size_t i = 0; i < Ns; ++i ){
+		for( std::size_t j = i; j < Ns; ++j ){
+			if( sc.A(i,j) != 0.0 ) return false;
+		}
+	}
+	return true;
+}
+
+
+bool is_method_dirk( const solver_coeffs &sc )
+{
+	std::size_t Ns = sc.b.size();
+	for( std::size_t i = 0; i < Ns; ++i ){
+		for( std::size_t j = i+1; j < Ns; ++j ){
+			if( sc.A(i,j) != 0.0 ) return false;
+		}
+	}
+	return true;
+}
+
+
+bool is_method_sdirk( const solver_coeffs &sc )
+{
+	if( !is_method_dirk( sc ) ) return false;
+
+	// The first stage of an ESDIRK method is explicit, so
+	// only the remaining diagonal entries need to be equal.
+	std::size_t Ns = sc.b.size();
+	std::size_t i0 = ( Ns > 1 && sc.A(0,0) == 0.0 ) ? 1 : 0;
+	for( std::size_t i = i0 + 1; i < Ns; ++i ){
+		if( sc.A(i,i) != sc.A(i0,i0) ) return false;
+	}
+	return sc.A(i0,i0) != 0.0;
+}
+
+
 solver_options default_solver_options()
 {
 	solver_options s;
@@ -704,7 +814,10 @@ bool verify_solver_options( solver_options &opts )
 
 const char *method_to_name( int method )
 {
-	return irk::rk_method_to_string[method].c_str();
+	// Use find, so that concurrent calls never modify the map:
+	auto it = irk::rk_method_to_string.find( method );
+	if( it == irk::rk_method_to_string.end() ) return "";
+	return it->second.c_str();
 }
 
 
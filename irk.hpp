@@ -32,11 +32,18 @@
 #include <limits>
 #include <iomanip>
 
+#include "autodiff.hpp"
+#include "dense_lu.hpp"
 #include "enums.hpp"
+#include "functor_traits.hpp"
+#include "jacobian.hpp"
 #include "my_timer.hpp"
 #include "newton.hpp"
 #include "options.hpp"
 #include "output.hpp"
+#include "small_lu.hpp"
+#include "step_size.hpp"
+#include "workspace.hpp"
 
 
 /**
@@ -84,6 +91,10 @@ struct solver_coeffs
 
 	/// This matrix defines the interpolating polynomial, if available.
 	mat_type b_interp;
+
+	/// Diagonal matrix D for solving the stages with PIRK, if available.
+	/// It is chosen such that I - inv(D)*A is nilpotent.
+	vec_type pirk_d;
 };
 
 
@@ -93,15 +104,22 @@ struct solver_coeffs
 struct solver_options : common_solver_options {
 	/// \brief Enumerates the possible internal non-linear solvers
 	enum internal_solvers {
-		BROYDEN = 0, ///< Broyden's method
-		NEWTON = 1   ///< Newton's method
+		BROYDEN = 0, ///< Broyden's method (see broyden_solve_stages)
+		NEWTON = 1,  ///< Newton's method
+		PIRK = 2,    ///< Parallel iteration (see pirk_solve_stages)
+		ANDERSON = 3 ///< Accelerated fixed point (see anderson_solve_stages)
 	};
 
 	/// \brief Constructor with default values.
 	solver_options() : adaptive_step_size(true),
 	                   use_newton_iters_adaptive_step(true),
 	                   verbose_newton(false),
-	                   extrapolate_stage(false)
+	                   extrapolate_stage(false),
+	                   detect_nonstiffness(false),
+	                   stiffness_bound(3.25),
+	                   jac_reuse_contraction(1e-3),
+	                   parallel_stages(false),
+	                   mixed_precision_lu(false)
 	{ }
 
 	~solver_options()
@@ -119,6 +137,42 @@ struct solver_options : common_solver_options {
 
 	/// If true, use the current stages and extrapolate to the next time level.
 	bool extrapolate_stage;
+
+	/// If true, stop with status NONSTIFFNESS_DETECTED once the problem
+	/// seems to be no longer stiff (see \ref stiffness_bound).
+	bool detect_nonstiffness;
+
+	/// The problem is deemed non-stiff if dt*rho stays below this, with rho
+	/// an estimate of the spectral radius of J from the last two stages,
+	/// i.e., if an explicit method could take the same time step.
+	double stiffness_bound;
+
+	/// If the Newton iteration contracted faster than this, the Jacobi
+	/// matrix is re-used for the next time step. If Newton then fails,
+	/// the step is first retried with a fresh one. Set to 0 to always
+	/// evaluate the Jacobi matrix.
+	double jac_reuse_contraction;
+
+	/// If true, evaluate the RHS at the stages concurrently with OpenMP.
+	/// This only happens if the functor is marked thread-safe (see
+	/// functor_is_thread_safe) and does not implement fun_stages.
+	/// Only worth it if the RHS is expensive.
+	bool parallel_stages;
+
+	/// If true, the simplified Newton iteration of fully implicit methods
+	/// factorises I - dt*kron(A,J) in single precision and refines each
+	/// increment with double precision residuals (see
+	/// newton_solve_stages). This roughly doubles the speed of the LU
+	/// decomposition of large systems. odeint_fixed ignores it.
+	bool mixed_precision_lu;
+
+	/// Options for the Jacobi matrix if the functor has no jac (see
+	/// functor_has_jac). It is then computed with automatic differentiation
+	/// if the functor implements fun_generic (see autodiff.hpp), which
+	/// uses only pattern and detect_pattern, with complex steps if it can
+	/// evaluate its RHS for complex y (see functor_has_complex_fun), and
+	/// with finite differences otherwise.
+	jacobian::options fd_jac;
 };
 
 
@@ -138,17 +192,28 @@ static std::map<std::string,int> rk_string_to_method = {
 struct rk_output : basic_output
 {
 	struct counters {
-		counters() : attempt(0), reject_newton(0), reject_err(0),
+		counters() : attempt(0), steps(0), reject_newton(0),
+		             reject_err(0), max_reject_streak(0),
 		             newton_success(0), newton_incr_diverge(0),
 		             newton_iter_error_too_large(0),
-		             newton_maxit_exceed(0),
-		             fun_evals(0), jac_evals(0) {}
+		             newton_maxit_exceed(0), newton_jac_refresh(0),
+		             fun_evals(0), jac_evals(0), workspace_resizes(0) {}
 
-		std::size_t attempt, reject_newton, reject_err;
+		std::size_t attempt;
+		/// Accepted steps. Not every step is stored in the output.
+		std::size_t steps;
+		std::size_t reject_newton, reject_err;
+		/// Longest sequence of consecutive steps rejected on error.
+		std::size_t max_reject_streak;
 
 		std::size_t newton_success, newton_incr_diverge,
 			newton_iter_error_too_large, newton_maxit_exceed;
+		/// Newton failures retried with a fresh Jacobi matrix.
+		std::size_t newton_jac_refresh;
 		std::size_t fun_evals, jac_evals;
+		/// Times the per-step workspace of the integrator had to be
+		/// resized. This does not count other heap allocations.
+		std::size_t workspace_resizes;
 	};
 
 	std::vector<vec_type> stages;
@@ -157,6 +222,9 @@ struct rk_output : basic_output
 
 	double elapsed_time, accept_frac;
 
+	/// The time step size the integrator would have attempted next.
+	double next_dt;
+
 	counters count;
 };
 
@@ -350,25 +418,103 @@ inline void print_timing_breakdown(const std::vector<double> &timings)
 }
 
 
+/**
+   \brief Buffers for evaluating the stages. The stage solvers keep one for
+   all their iterations, so that evaluating the residual does not allocate
+   once the sizes are set.
+*/
+struct stage_buffers
+{
+	mat_type F;   ///< The RHS at the stages, as columns.
+	mat_type YY;  ///< The stage values y + Y_i, for fun_stages.
+	vec_type ts;  ///< The stage times, for fun_stages.
+};
+
+
+/**
+   \brief Evaluates the stages one by one, concurrently if parallel is true.
+*/
 template <typename functor_type> inline
-void construct_R(functor_type &func,
-                 const vec_type &y, double t, double dt,
+void eval_stages(functor_type &func, const vec_type &y, double t, double dt,
                  const solver_coeffs &sc, const vec_type &Y,
-                 const mat_type &I_neq, vec_type &R)
+                 stage_buffers &buf, bool parallel, std::false_type)
 {
-	vec_type F(Y.size());
 	std::size_t Ns = sc.b.size();
 	std::size_t Neq = y.size();
-	vec_type e = arma::ones(Ns);
-	R = Y;
+	mat_type &F = buf.F;
+	if (F.n_rows != Neq || F.n_cols != Ns) F.set_size(Neq, Ns);
+#pragma omp parallel for if (parallel) schedule(static, 1)
 	for (std::size_t i = 0; i < Ns; ++i) {
 		std::size_t i0 = Neq*i;
 		std::size_t i1 = i0 + Neq - 1;
-		
-		auto Yi = Y.subvec(i0,i1);
-		F.subvec(i0, i1) = func.fun(t + sc.c(i)*dt, y + Yi);
+		F.col(i) = func.fun(t + sc.c(i)*dt, y + Y.subvec(i0, i1));
+	}
+}
+
+
+/**
+   \brief Evaluates all stages with one call to func.fun_stages.
+*/
+template <typename functor_type> inline
+void eval_stages(functor_type &func, const vec_type &y, double t, double dt,
+                 const solver_coeffs &sc, const vec_type &Y,
+                 stage_buffers &buf, bool, std::true_type)
+{
+	std::size_t Ns = sc.b.size();
+	std::size_t Neq = y.size();
+	if (buf.ts.n_elem != Ns) buf.ts.set_size(Ns);
+	if (buf.YY.n_rows != Neq || buf.YY.n_cols != Ns) {
+		buf.YY.set_size(Neq, Ns);
+	}
+	if (buf.F.n_rows != Neq || buf.F.n_cols != Ns) {
+		buf.F.set_size(Neq, Ns);
+	}
+	const double *Yp = Y.memptr();
+	double *YYp = buf.YY.memptr();
+	for (std::size_t i = 0; i < Ns; ++i) {
+		buf.ts(i) = t + dt*sc.c(i);
+		for (std::size_t p = 0; p < Neq; ++p) {
+			YYp[i*Neq + p] = y(p) + Yp[i*Neq + p];
+		}
+	}
+	func.fun_stages(buf.ts, buf.YY, buf.F);
+}
+
+
+/**
+   \brief Constructs the residual R = Y - dt*kron(A,I)*F(Y) of the stage
+   equations.
+
+   The RHS at the stages is evaluated with func.fun_stages if the functor
+   has it (see functor_has_fun_stages), and otherwise with func.fun, stage
+   by stage, which is done concurrently if parallel is true. A is applied
+   block by block, so kron(A,I) is never formed.
+
+   \param buf  Buffers for the stage evaluations, kept between calls.
+*/
+template <typename functor_type> inline
+void construct_R(functor_type &func,
+                 const vec_type &y, double t, double dt,
+                 const solver_coeffs &sc, const vec_type &Y,
+                 stage_buffers &buf, vec_type &R, bool parallel = false)
+{
+	eval_stages(func, y, t, dt, sc, Y, buf, parallel,
+	            std::integral_constant<bool,
+	                functor_has_fun_stages<functor_type>::value>());
+	std::size_t Ns  = sc.b.size();
+	std::size_t Neq = y.size();
+	R = Y;
+	double *Rp = R.memptr();
+	const double *Fp = buf.F.memptr();
+	for (std::size_t i = 0; i < Ns; ++i) {
+		for (std::size_t j = 0; j < Ns; ++j) {
+			double a = dt*sc.A(i,j);
+			if (a == 0.0) continue;
+			for (std::size_t p = 0; p < Neq; ++p) {
+				Rp[i*Neq + p] -= a*Fp[j*Neq + p];
+			}
+		}
 	}
-	R -= dt*arma::kron(sc.A, I_neq)*F;
 }
 
 
@@ -382,6 +528,15 @@ void construct_R(functor_type &func,
 
 
    \param Y Contains the stages
+   \param J Contains the Jacobi matrix. It is evaluated at (t,y) unless
+            reuse_jac is true, in which case the given one is used.
+   \param parallel_stages  If true, evaluate the stages concurrently (see
+                           construct_R).
+   \param mixed_precision  If true, factorise the iteration matrix in
+                           single precision and refine the increments
+                           with double precision residuals. If the
+                           refinement stalls, the matrix is factorised in
+                           double precision after all.
 */
 template <typename functor_type> inline
 int newton_solve_stages(functor_type &func, const vec_type &y, double t,
@@ -389,13 +544,15 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
                         int maxit, int refresh_jac,
                         double xtol, double Rtol, vec_type &Y, mat_type &J,
                         newton::status &stats,
-                        std::size_t &fun_evals, std::size_t &jac_evals)
+                        std::size_t &fun_evals, std::size_t &jac_evals,
+                        bool reuse_jac = false, bool parallel_stages = false,
+                        bool mixed_precision = false)
 {
 	std::size_t Neq = y.size();
 	std::size_t Ns  = sc.b.size();
 	std::size_t NN  = Ns*Neq;
 	
-	mat_type I_neq   = arma::eye(Neq, Neq);
+	stage_buffers stage_buf;
 
 
 	// Construct the initial system:
@@ -404,29 +561,57 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
 	// Jacobi matrix:
 	// Idea: Refresh Jacobi matrix after every so many iterations.
 	mat_type J_Y;
-	mat_type L, U, P;
+	dense_lu<double> lu;
+	dense_lu<float> lu_f;
+	bool single = mixed_precision;
+
+	// Since we re-use the same Jacobi matrix,
+	// pre-construct the LU decomposition:
+	auto factorise = [&J_Y, &lu, &lu_f, &single]()
+		{
+			if (single) {
+				single = lu_f.factor(
+					arma::conv_to<arma::fmat>::from(J_Y));
+			}
+			return single || lu.factor(J_Y);
+		};
 
 	auto refresh_jacobi_matrix =
-		[&func, &J, &J_Y, NN, &L, &U, &P, t, dt, y, sc, &jac_evals]()
+		[&func, &J, &J_Y, NN, &factorise, t, dt, y, sc, &jac_evals]
+		(bool eval_jac)
 		{
-			J = func.jac(t,y);
+			if (eval_jac) {
+				J = func.jac(t,y);
+				++jac_evals;
+			}
 			J_Y = arma::eye(NN,NN);	
 			J_Y -= dt*kron(sc.A,J);
-			
-			// Since we re-use the same Jacobi matrix,
-			// pre-construct the LU decomposition:
-			assert(arma::lu(L,U,P, J_Y) &&
-			       "LU decomposition of Jacobi matrix failed!");
-			++jac_evals;
+			return factorise();
 		};
-	
-	refresh_jacobi_matrix();
+
+	// Returns -inv(J_Y)*R with the LU decomposition:
+	auto lu_solve = [&lu, &lu_f, &single](const vec_type &R) -> vec_type
+		{
+			if (single) {
+				arma::fvec dYf = arma::conv_to<arma::fvec>::from(R);
+				lu_f.solve(dYf);
+				return -arma::conv_to<vec_type>::from(dYf);
+			}
+			vec_type dY = R;
+			lu.solve(dY);
+			return -dY;
+		};
+
+	if (!refresh_jacobi_matrix(!reuse_jac)) {
+		stats.conv_status = newton::GENERIC_ERROR;
+		return newton::GENERIC_ERROR;
+	}
 	
 	// Start iterating:
 	double xtol2 = xtol*xtol;
 	double Rtol2 = Rtol*Rtol;
 	vec_type R(Y.size());
-	construct_R(func, y, t, dt, sc, Y, I_neq, R);
+	construct_R(func, y, t, dt, sc, Y, stage_buf, R, parallel_stages);
 	fun_evals += Ns;
 	double Rnorm2 = arma::dot(R,R);
 	double step = 1.0 / sqrt(1.0 + Rnorm2);
@@ -435,11 +620,34 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
 	
 	int status = newton::MAXIT_EXCEEDED;
 	stats.iters = 1;
+	stats.contraction = 0.0;
 	for ( ; stats.iters < maxit; ++stats.iters) {
-		vec_type tmp = arma::solve(arma::trimatl(-L), P*R);
-		vec_type dY  = arma::solve(arma::trimatu(U), tmp);
+		vec_type dY = lu_solve(R);
+		// Iterative refinement of J_Y*dY = -R, with the residual in
+		// double precision:
+		double res_norm_o = std::numeric_limits<double>::max();
+		for (int k = 0; single && k < 4; ++k) {
+			vec_type res = -R - J_Y*dY;
+			double res_norm = arma::norm(res);
+			if (res_norm <= 1e-12*arma::norm(R)) break;
+			if (res_norm > 0.5*res_norm_o) {
+				// J_Y is too ill-conditioned for single precision:
+				single = false;
+				if (!factorise()) {
+					stats.conv_status = newton::GENERIC_ERROR;
+					return newton::GENERIC_ERROR;
+				}
+				dY = lu_solve(R);
+				break;
+			}
+			res_norm_o = res_norm;
+			dY -= lu_solve(res);
+		}
 		xnorm2_o = xnorm2;
 		xnorm2   = arma::dot(dY,dY);
+		if (stats.iters > 1 && xnorm2_o > 0) {
+			stats.contraction = std::sqrt(xnorm2 / xnorm2_o);
+		}
 
 		if (stats.iters > 1 && (xnorm2_o < 0.81*xnorm2)) {
 			status = newton::INCREMENT_DIVERGE;
@@ -447,7 +655,7 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
 		}
 		
 		Y += step*dY;
-		construct_R(func, y, t, dt, sc, Y, I_neq, R);
+		construct_R(func, y, t, dt, sc, Y, stage_buf, R, parallel_stages);
 		
 		fun_evals += Ns;
 		Rnorm2 = arma::dot(R,R);
@@ -461,13 +669,717 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
 		}
 		step = 1.0 / sqrt(1.0 + Rnorm2);
 
+		if (stats.iters % refresh_jac == 0 &&
+		    !refresh_jacobi_matrix(true)) {
+			status = newton::GENERIC_ERROR;
+			break;
+		}
+	}
+	stats.res = Rnorm2;
+	stats.conv_status = status;
+
+	return status;
+}
+
+
+
+/**
+   \brief Solves for the stages with limited-memory Broyden iteration.
+
+   The stage equations are the same as for newton_solve_stages, but the
+   iteration matrix I - dt*kron(A,J) only serves as the initial inverse
+   Jacobian of newton::limited_broyden, whose rank-one updates make up for
+   J being outdated. The Jacobi matrix can then be re-used for many more
+   steps than with simplified Newton, which pays off if jac is expensive
+   (e.g., if it is approximated with finite differences).
+
+   \param memory  Number of Broyden steps to keep.
+
+   See newton_solve_stages for the other parameters.
+*/
+template <typename functor_type> inline
+int broyden_solve_stages(functor_type &func, const vec_type &y, double t,
+                         double dt, const solver_coeffs &sc,
+                         int maxit, int memory,
+                         double xtol, double Rtol, vec_type &Y, mat_type &J,
+                         newton::status &stats,
+                         std::size_t &fun_evals, std::size_t &jac_evals,
+                         bool reuse_jac = false, bool parallel_stages = false)
+{
+	std::size_t Neq = y.size();
+	std::size_t Ns  = sc.b.size();
+	std::size_t NN  = Ns*Neq;
+
+	stage_buffers stage_buf;
+	Y = arma::zeros(NN);
+
+	if (!reuse_jac) {
+		J = func.jac(t,y);
+		++jac_evals;
+	}
+	mat_type J_Y = arma::eye(NN,NN);
+	J_Y -= dt*kron(sc.A,J);
+	dense_lu<double> lu;
+	if (!lu.factor(J_Y)) {
+		stats.conv_status = newton::GENERIC_ERROR;
+		return newton::GENERIC_ERROR;
+	}
+
+	double xtol2 = xtol*xtol;
+	double Rtol2 = Rtol*Rtol;
+	vec_type R(NN);
+	construct_R(func, y, t, dt, sc, Y, stage_buf, R, parallel_stages);
+	fun_evals += Ns;
+	double Rnorm2 = arma::dot(R,R);
+	double xnorm2_o = 0;
+	double xnorm2   = 0;
+
+	newton::limited_broyden broyden(std::max(memory, 1));
+	int status = newton::MAXIT_EXCEEDED;
+	stats.iters = 1;
+	stats.contraction = 0.0;
+	for ( ; stats.iters < maxit; ++stats.iters) {
+		vec_type z = -R;
+		lu.solve(z);
+		vec_type dY = broyden.next_step(z);
+		xnorm2_o = xnorm2;
+		xnorm2   = arma::dot(dY,dY);
+		if (stats.iters > 1 && xnorm2_o > 0) {
+			stats.contraction = std::sqrt(xnorm2 / xnorm2_o);
+		}
+		// Broyden steps do not shrink monotonically, so only give up
+		// once they grow considerably:
+		if (stats.iters > 2 && (xnorm2_o < 0.25*xnorm2)) {
+			status = newton::INCREMENT_DIVERGE;
+			break;
+		}
+		if (!std::isfinite(xnorm2)) {
+			status = newton::GENERIC_ERROR;
+			break;
+		}
+
+		Y += dY;
+		construct_R(func, y, t, dt, sc, Y, stage_buf, R, parallel_stages);
+		fun_evals += Ns;
+		Rnorm2 = arma::dot(R,R);
+		if (Rnorm2 < Rtol2 || xnorm2 < xtol2) {
+			status = newton::SUCCESS;
+			break;
+		}
+	}
+	stats.res = Rnorm2;
+	stats.conv_status = status;
+
+	return status;
+}
+
+
+
+/**
+   \brief Solves for the stages with fixed-point iteration, accelerated with
+   Anderson mixing (Walker & Ni, 2011).
+
+   The stage equations Y = G(Y) := dt*kron(A,I)*F(y + Y) are iterated on
+   directly, so neither the Jacobi matrix nor an LU decomposition is
+   needed. Each new iterate is the combination of the last memory + 1
+   values of G that minimises the linearised residual. This converges
+   only if dt times the Lipschitz constant of the RHS is small, so it is
+   meant for non-stiff problems, e.g. Hamiltonian systems integrated
+   with the symplectic Gauss-Legendre methods.
+
+   \param memory  Number of earlier iterates to mix in.
+
+   See newton_solve_stages for the other parameters.
+*/
+template <typename functor_type> inline
+int anderson_solve_stages(functor_type &func, const vec_type &y, double t,
+                          double dt, const solver_coeffs &sc,
+                          int maxit, int memory,
+                          double xtol, double Rtol, vec_type &Y,
+                          newton::status &stats, std::size_t &fun_evals,
+                          bool parallel_stages = false)
+{
+	std::size_t Neq = y.size();
+	std::size_t Ns  = sc.b.size();
+	std::size_t NN  = Ns*Neq;
+	std::size_t m   = std::max(memory, 0);
+
+	stage_buffers stage_buf;
+	Y = arma::zeros(NN);
+
+	double xtol2 = xtol*xtol;
+	double Rtol2 = Rtol*Rtol;
+	vec_type R(NN);
+	construct_R(func, y, t, dt, sc, Y, stage_buf, R, parallel_stages);
+	fun_evals += Ns;
+	double Rnorm2 = arma::dot(R,R);
+	double xnorm2_o = 0;
+	double xnorm2   = 0;
+
+	// f = G(Y) - Y is the fixed-point residual. The differences of f and
+	// G between consecutive iterates are kept for the mixing:
+	vec_type f = -R;
+	vec_type g = Y + f;
+	std::vector<vec_type> dF, dG;
+
+	int status = newton::MAXIT_EXCEEDED;
+	stats.iters = 1;
+	stats.contraction = 0.0;
+	for ( ; stats.iters < maxit; ++stats.iters) {
+		vec_type Y_new = g;
+		std::size_t mk = dF.size();
+		if (mk > 0) {
+			// Least squares min |f - dF*gamma| by the normal equations,
+			// which are tiny and slightly regularised:
+			mat_type M(mk, mk);
+			vec_type rhs(mk);
+			for (std::size_t i = 0; i < mk; ++i) {
+				for (std::size_t j = 0; j <= i; ++j) {
+					M(i,j) = M(j,i) = arma::dot(dF[i], dF[j]);
+				}
+				M(i,i) *= 1.0 + 1e-10;
+				rhs(i) = arma::dot(dF[i], f);
+			}
+			vec_type gamma;
+			if (arma::solve(gamma, M, rhs)) {
+				for (std::size_t i = 0; i < mk; ++i) {
+					Y_new -= gamma(i)*dG[i];
+				}
+			}
+		}
+
+		vec_type dY = Y_new - Y;
+		xnorm2_o = xnorm2;
+		xnorm2   = arma::dot(dY,dY);
+		if (stats.iters > 1 && xnorm2_o > 0) {
+			stats.contraction = std::sqrt(xnorm2 / xnorm2_o);
+		}
+		if (!std::isfinite(xnorm2)) {
+			status = newton::GENERIC_ERROR;
+			break;
+		}
+		if (stats.iters > 2 && (xnorm2_o < 0.25*xnorm2)) {
+			status = newton::INCREMENT_DIVERGE;
+			break;
+		}
+
+		Y = Y_new;
+		construct_R(func, y, t, dt, sc, Y, stage_buf, R, parallel_stages);
+		fun_evals += Ns;
+		Rnorm2 = arma::dot(R,R);
+		if (Rnorm2 < Rtol2 || xnorm2 < xtol2) {
+			status = newton::SUCCESS;
+			break;
+		}
+
+		vec_type f_new = -R;
+		vec_type g_new = Y + f_new;
+		if (m > 0) {
+			if (dF.size() == m) {
+				dF.erase(dF.begin());
+				dG.erase(dG.begin());
+			}
+			dF.push_back(f_new - f);
+			dG.push_back(g_new - g);
+		}
+		f = f_new;
+		g = g_new;
+	}
+	stats.res = Rnorm2;
+	stats.conv_status = status;
+
+	return status;
+}
+
+
+
+/**
+   \brief Solves for the stages of a fully implicit method with a parallel
+   diagonally implicit iteration (PDIRK, van der Houwen & Sommeijer, 1990).
+
+   This is simplified Newton on the same stage equations as
+   newton_solve_stages, but with the Newton matrix I - dt*kron(A,J)
+   replaced by the block diagonal I - dt*kron(D,J). The stages then
+   decouple into Ns systems of size Neq, which are factorised and solved
+   concurrently with OpenMP. D = sc.pirk_d makes I - inv(D)*A nilpotent, so
+   that the iteration contracts well also for very stiff components. It
+   needs more iterations than Newton, but each one is much cheaper and
+   parallel over the stages, which pays off for systems that are too small
+   for a parallel BLAS to help.
+
+   \param Y Contains the stages
+   \param J Contains the Jacobi matrix. It is evaluated at (t,y) unless
+            reuse_jac is true, in which case the given one is used.
+   \param parallel_stages  If true, evaluate the RHS at the stages
+                           concurrently too (see construct_R).
+*/
+template <typename functor_type> inline
+int pirk_solve_stages(functor_type &func, const vec_type &y, double t,
+                      double dt, const solver_coeffs &sc,
+                      int maxit, int refresh_jac,
+                      double xtol, double Rtol, vec_type &Y, mat_type &J,
+                      newton::status &stats,
+                      std::size_t &fun_evals, std::size_t &jac_evals,
+                      bool reuse_jac = false, bool parallel_stages = false)
+{
+	std::size_t Neq = y.size();
+	std::size_t Ns  = sc.b.size();
+	std::size_t NN  = Ns*Neq;
+	assert(sc.pirk_d.size() == Ns && "Method does not support PIRK!");
+
+	// Forking threads for the solves costs more than it saves for tiny
+	// systems:
+	const bool parallel = Neq >= 16;
+
+	stage_buffers stage_buf;
+	mat_type I_neq = arma::eye(Neq, Neq);
+	Y = arma::zeros(NN);
+
+	std::vector<dense_lu<double> > lu(Ns);
+	bool lu_success = true;
+	auto refresh_jacobi_matrix = [&](bool eval_jac)
+		{
+			if (eval_jac) {
+				J = func.jac(t,y);
+				++jac_evals;
+			}
+			int n_failed = 0;
+#pragma omp parallel for if (parallel) schedule(static, 1) \
+	reduction(+:n_failed)
+			for (std::size_t i = 0; i < Ns; ++i) {
+				mat_type M = I_neq - dt*sc.pirk_d(i)*J;
+				if (!lu[i].factor(M)) {
+					++n_failed;
+				}
+			}
+			lu_success = n_failed == 0;
+		};
+
+	refresh_jacobi_matrix(!reuse_jac);
+
+	double xtol2 = xtol*xtol;
+	double Rtol2 = Rtol*Rtol;
+	vec_type R(NN), dY(NN);
+	construct_R(func, y, t, dt, sc, Y, stage_buf, R, parallel_stages);
+	fun_evals += Ns;
+	double Rnorm2 = arma::dot(R,R);
+	double step = 1.0 / sqrt(1.0 + Rnorm2);
+	double xnorm2_o = 0;
+	double xnorm2   = 0;
+
+	int status = newton::MAXIT_EXCEEDED;
+	stats.iters = 1;
+	stats.contraction = 0.0;
+	for ( ; stats.iters < maxit; ++stats.iters) {
+		if (!lu_success) {
+			status = newton::INCREMENT_DIVERGE;
+			break;
+		}
+#pragma omp parallel for if (parallel) schedule(static, 1)
+		for (std::size_t i = 0; i < Ns; ++i) {
+			std::size_t i0 = Neq*i;
+			std::size_t i1 = i0 + Neq - 1;
+			vec_type dYi = -R.subvec(i0, i1);
+			lu[i].solve(dYi);
+			dY.subvec(i0, i1) = dYi;
+		}
+		xnorm2_o = xnorm2;
+		xnorm2   = arma::dot(dY,dY);
+		if (stats.iters > 1 && xnorm2_o > 0) {
+			stats.contraction = std::sqrt(xnorm2 / xnorm2_o);
+		}
+
+		// I - inv(D)*A is nilpotent rather than small, so the increments
+		// can grow in the first Ns iterations before they shrink:
+		if (stats.iters > static_cast<int>(Ns) &&
+		    (xnorm2_o < 0.81*xnorm2)) {
+			status = newton::INCREMENT_DIVERGE;
+			break;
+		}
+
+		Y += step*dY;
+		construct_R(func, y, t, dt, sc, Y, stage_buf, R, parallel_stages);
+
+		fun_evals += Ns;
+		Rnorm2 = arma::dot(R,R);
+		if (Rnorm2 < Rtol2) {
+			status = newton::SUCCESS;
+			break;
+		}
+		if (xnorm2 < xtol2) {
+			status = newton::SUCCESS;
+			break;
+		}
+		step = 1.0 / sqrt(1.0 + Rnorm2);
+
 		if (stats.iters % refresh_jac == 0) {
-			refresh_jacobi_matrix();
+			refresh_jacobi_matrix(true);
 		}
 	}
 	stats.res = Rnorm2;
 	stats.conv_status = status;
-	
+
+	return status;
+}
+
+
+
+/**
+   \brief Performs the same iteration as newton_solve_stages, but for a
+   system of N equations and Ns stages known at compile time.
+
+   All work arrays are on the stack, the Newton matrix is factorised with
+   small_lu and kron(A, I) is never formed explicitly.
+*/
+template <std::size_t N, std::size_t Ns, typename functor_type> inline
+int newton_solve_stages_fixed(functor_type &func, const vec_type &y, double t,
+                              double dt, const solver_coeffs &sc,
+                              int maxit, int refresh_jac,
+                              double xtol, double Rtol, vec_type &Y,
+                              mat_type &J, newton::status &stats,
+                              std::size_t &fun_evals,
+                              std::size_t &jac_evals,
+                              bool reuse_jac = false)
+{
+	const std::size_t NN = N*Ns;
+	assert(y.size() == N && sc.b.size() == Ns &&
+	       "Wrong size for fixed-size stage solver!");
+
+	double A[Ns][Ns], c[Ns];
+	for (std::size_t i = 0; i < Ns; ++i) {
+		c[i] = sc.c(i);
+		for (std::size_t j = 0; j < Ns; ++j) {
+			A[i][j] = dt*sc.A(i,j);
+		}
+	}
+
+	small_lu<NN> lu;
+	auto refresh_jacobi_matrix =
+		[&func, &J, &lu, &A, t, &y, &jac_evals](bool eval_jac)
+		{
+			if (eval_jac) {
+				J = func.jac(t,y);
+				++jac_evals;
+			}
+			// M = I - kron(dt*A, J), column-major:
+			double M[NN*NN];
+			for (std::size_t bj = 0; bj < Ns; ++bj) {
+				for (std::size_t q = 0; q < N; ++q) {
+					std::size_t col = bj*N + q;
+					for (std::size_t bi = 0; bi < Ns; ++bi) {
+						for (std::size_t p = 0; p < N; ++p) {
+							std::size_t row = bi*N + p;
+							M[row + col*NN] = (row == col)
+								- A[bi][bj]*J(p,q);
+						}
+					}
+				}
+			}
+			return lu.factor(M);
+		};
+
+	// R = Y - kron(dt*A, I)*F(Y):
+	arma::vec::fixed<N> Yi;
+	double F[NN], R[NN], Yv[NN];
+	auto construct_R = [&]()
+		{
+			for (std::size_t i = 0; i < Ns; ++i) {
+				for (std::size_t p = 0; p < N; ++p) {
+					Yi(p) = y(p) + Yv[i*N + p];
+				}
+				vec_type Fi = func.fun(t + c[i]*dt, Yi);
+				for (std::size_t p = 0; p < N; ++p) {
+					F[i*N + p] = Fi(p);
+				}
+			}
+			for (std::size_t i = 0; i < Ns; ++i) {
+				for (std::size_t p = 0; p < N; ++p) {
+					double Ri = Yv[i*N + p];
+					for (std::size_t j = 0; j < Ns; ++j) {
+						Ri -= A[i][j]*F[j*N + p];
+					}
+					R[i*N + p] = Ri;
+				}
+			}
+			fun_evals += Ns;
+		};
+	auto dot_R = [&R]()
+		{
+			double s = 0.0;
+			for (std::size_t k = 0; k < NN; ++k) s += R[k]*R[k];
+			return s;
+		};
+
+	for (std::size_t k = 0; k < NN; ++k) Yv[k] = 0.0;
+	if (!refresh_jacobi_matrix(!reuse_jac)) {
+		stats.conv_status = newton::GENERIC_ERROR;
+		return newton::GENERIC_ERROR;
+	}
+
+	double xtol2 = xtol*xtol;
+	double Rtol2 = Rtol*Rtol;
+	construct_R();
+	double Rnorm2 = dot_R();
+	double step = 1.0 / sqrt(1.0 + Rnorm2);
+	double xnorm2_o = 0;
+	double xnorm2   = 0;
+
+	int status = newton::MAXIT_EXCEEDED;
+	stats.iters = 1;
+	stats.contraction = 0.0;
+	for ( ; stats.iters < maxit; ++stats.iters) {
+		// The Newton increment solves M*dY = -R:
+		double dY[NN];
+		for (std::size_t k = 0; k < NN; ++k) dY[k] = -R[k];
+		lu.solve(dY);
+
+		xnorm2_o = xnorm2;
+		xnorm2   = 0.0;
+		for (std::size_t k = 0; k < NN; ++k) xnorm2 += dY[k]*dY[k];
+		if (stats.iters > 1 && xnorm2_o > 0) {
+			stats.contraction = std::sqrt(xnorm2 / xnorm2_o);
+		}
+
+		if (stats.iters > 1 && (xnorm2_o < 0.81*xnorm2)) {
+			status = newton::INCREMENT_DIVERGE;
+			break;
+		}
+
+		for (std::size_t k = 0; k < NN; ++k) Yv[k] += step*dY[k];
+		construct_R();
+		Rnorm2 = dot_R();
+		if (Rnorm2 < Rtol2) {
+			status = newton::SUCCESS;
+			break;
+		}
+		if (xnorm2 < xtol2) {
+			status = newton::SUCCESS;
+			break;
+		}
+		step = 1.0 / sqrt(1.0 + Rnorm2);
+
+		if (stats.iters % refresh_jac == 0 &&
+		    !refresh_jacobi_matrix(true)) {
+			status = newton::GENERIC_ERROR;
+			break;
+		}
+	}
+	stats.res = Rnorm2;
+	stats.conv_status = status;
+
+	Y.set_size(NN);
+	for (std::size_t k = 0; k < NN; ++k) Y(k) = Yv[k];
+
+	return status;
+}
+
+
+/**
+   \brief Solves the stages of (fully) implicit methods with
+   newton_solve_stages. This is the default for irk_guts.
+*/
+struct dynamic_stage_solver
+{
+	template <typename functor_type>
+	static int solve(functor_type &func, const vec_type &y, double t,
+	                 double dt, const solver_coeffs &sc, int maxit,
+	                 int refresh_jac, double xtol, double Rtol,
+	                 vec_type &Y, mat_type &J, newton::status &stats,
+	                 std::size_t &fun_evals, std::size_t &jac_evals,
+	                 bool reuse_jac, bool parallel_stages)
+	{
+		return newton_solve_stages(func, y, t, dt, sc, maxit,
+		                           refresh_jac, xtol, Rtol, Y, J, stats,
+		                           fun_evals, jac_evals, reuse_jac,
+		                           parallel_stages);
+	}
+};
+
+
+/**
+   \brief Solves the stages of (fully) implicit methods with
+   newton_solve_stages, factorising in single precision (see
+   solver_options::mixed_precision_lu).
+*/
+struct mixed_precision_stage_solver
+{
+	template <typename functor_type>
+	static int solve(functor_type &func, const vec_type &y, double t,
+	                 double dt, const solver_coeffs &sc, int maxit,
+	                 int refresh_jac, double xtol, double Rtol,
+	                 vec_type &Y, mat_type &J, newton::status &stats,
+	                 std::size_t &fun_evals, std::size_t &jac_evals,
+	                 bool reuse_jac, bool parallel_stages)
+	{
+		return newton_solve_stages(func, y, t, dt, sc, maxit,
+		                           refresh_jac, xtol, Rtol, Y, J, stats,
+		                           fun_evals, jac_evals, reuse_jac,
+		                           parallel_stages, true);
+	}
+};
+
+
+/**
+   \brief Solves the stages of (fully) implicit methods for N equations
+   with newton_solve_stages_fixed. Methods with more than 5 stages fall
+   back to newton_solve_stages. For these small systems the stages are
+   always evaluated one by one.
+*/
+template <std::size_t N>
+struct fixed_stage_solver
+{
+	template <typename functor_type>
+	static int solve(functor_type &func, const vec_type &y, double t,
+	                 double dt, const solver_coeffs &sc, int maxit,
+	                 int refresh_jac, double xtol, double Rtol,
+	                 vec_type &Y, mat_type &J, newton::status &stats,
+	                 std::size_t &fun_evals, std::size_t &jac_evals,
+	                 bool reuse_jac, bool parallel_stages)
+	{
+#define FIXED_STAGES_CASE(NS)                                            \
+		case NS:                                                 \
+			return newton_solve_stages_fixed<N,NS>(func, y, t, dt, \
+			              sc, maxit, refresh_jac, xtol, Rtol, Y, J,\
+			              stats, fun_evals, jac_evals, reuse_jac);
+		switch (sc.b.size()) {
+			FIXED_STAGES_CASE(1)
+			FIXED_STAGES_CASE(2)
+			FIXED_STAGES_CASE(3)
+			FIXED_STAGES_CASE(4)
+			FIXED_STAGES_CASE(5)
+			default:
+				break;
+		}
+#undef FIXED_STAGES_CASE
+		return newton_solve_stages(func, y, t, dt, sc, maxit,
+		                           refresh_jac, xtol, Rtol, Y, J, stats,
+		                           fun_evals, jac_evals, reuse_jac,
+		                           parallel_stages);
+	}
+};
+
+
+
+/**
+   \brief Solves for the stages of a diagonally implicit RK method.
+
+   Because A is lower triangular, stage i only depends on the stages j < i,
+   so instead of one Ns*Neq system we solve Ns systems of size Neq in turn.
+   The Jacobi matrix is evaluated once at (t,y). For SDIRK methods the
+   diagonal of A is constant, so the LU decomposition of I - dt*a_ii*J is
+   constructed once and re-used for all stages. Explicit stages (a_ii = 0)
+   are evaluated directly.
+
+   \param Y Will contain the stages Y_i = dt*(a_i1*k_1 + a_i2*k_2 + ...)
+   \param K Will contain the stage derivatives k_i as columns.
+   \param J Will contain the Jacobi matrix at (t,y). If reuse_jac is true,
+            the given one is used instead.
+*/
+template <typename functor_type> inline
+int dirk_solve_stages(functor_type &func, const vec_type &y, double t,
+                      double dt, const solver_coeffs &sc, int maxit,
+                      double xtol, double Rtol, vec_type &Y, mat_type &K,
+                      mat_type &J, newton::status &stats,
+                      std::size_t &fun_evals, std::size_t &jac_evals,
+                      bool reuse_jac = false)
+{
+	std::size_t Neq = y.size();
+	std::size_t Ns  = sc.b.size();
+
+	Y = arma::zeros(Ns*Neq);
+	K.zeros(Neq, Ns);
+
+	if (!reuse_jac) {
+		J = func.jac(t, y);
+		++jac_evals;
+	}
+
+	dense_lu<double> lu;
+	double a_lu = 0.0;
+
+	double xtol2 = xtol*xtol;
+	double Rtol2 = Rtol*Rtol;
+	double Rnorm2 = 0.0;
+
+	int status = newton::SUCCESS;
+	stats.iters = 0;
+	stats.contraction = 0.0;
+	for (std::size_t i = 0; i < Ns; ++i) {
+		double aii = sc.A(i,i);
+		double ti  = t + sc.c(i)*dt;
+
+		// The part of the stage that is already known:
+		vec_type base = arma::zeros(Neq);
+		for (std::size_t j = 0; j < i; ++j) {
+			if (sc.A(i,j) != 0.0) {
+				base += (dt*sc.A(i,j))*K.col(j);
+			}
+		}
+
+		if (aii == 0.0) {
+			K.col(i) = func.fun(ti, y + base);
+			++fun_evals;
+			Y.subvec(i*Neq, i*Neq + Neq - 1) = base;
+			continue;
+		}
+
+		double h = dt*aii;
+		if (h != a_lu) {
+			mat_type M = arma::eye(Neq, Neq) - h*J;
+			if (!lu.factor(M)) {
+				status = newton::GENERIC_ERROR;
+				break;
+			}
+			a_lu = h;
+		}
+
+		// Use the previous stage derivative as initial guess:
+		vec_type Z = base;
+		if (i > 0) Z += h*K.col(i-1);
+
+		status = newton::MAXIT_EXCEEDED;
+		double xnorm2_o = 0.0, xnorm2 = 0.0;
+		int iters = 0;
+		for (iters = 1; iters < maxit; ++iters) {
+			vec_type F = func.fun(ti, y + Z);
+			++fun_evals;
+			vec_type R = Z - base - h*F;
+			Rnorm2 = arma::dot(R,R);
+			if (Rnorm2 < Rtol2) {
+				status = newton::SUCCESS;
+				break;
+			}
+
+			vec_type dZ = -R;
+			lu.solve(dZ);
+			xnorm2_o = xnorm2;
+			xnorm2   = arma::dot(dZ,dZ);
+			if (iters > 1 && xnorm2_o > 0) {
+				stats.contraction = std::max(stats.contraction,
+				                             std::sqrt(xnorm2 / xnorm2_o));
+			}
+			if (iters > 1 && (xnorm2_o < 0.81*xnorm2)) {
+				status = newton::INCREMENT_DIVERGE;
+				break;
+			}
+
+			Z += dZ;
+			if (xnorm2 < xtol2) {
+				status = newton::SUCCESS;
+				break;
+			}
+		}
+		stats.iters = std::max(stats.iters, iters);
+
+		if (status != newton::SUCCESS) break;
+
+		// From the definition of Z_i, k_i follows without evaluating f:
+		K.col(i) = (Z - base) / h;
+		Y.subvec(i*Neq, i*Neq + Neq - 1) = Z;
+	}
+	stats.res = Rnorm2;
+	stats.conv_status = status;
+
 	return status;
 }
 
@@ -482,25 +1394,58 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
    \param y0           Initial values
    \param sc           Solver coefficients
    \param solver_opts  Options for the internal solver.
+   \param dt           Initial time step size. If <= 0, it is estimated.
+
+   \tparam stage_solver Solves the stages of non-DIRK methods (see
+                       dynamic_stage_solver and fixed_stage_solver).
 
    \returns a struct that contains status, solution, etc. (see irk::rk_output).
 */
-template <typename functor_type> inline
+template <typename functor_type,
+          typename stage_solver = dynamic_stage_solver> inline
 rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0,
                     const solver_options &solver_opts, double dt,
                     const solver_coeffs &sc )
 {
+	if (!solver_opts.abs_tols_match(y0.size())) {
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: abs_tols needs one entry per "
+			          << "equation!\n";
+		}
+		rk_output sol;
+		sol.status = GENERAL_ERROR;
+		return sol;
+	}
+
+	// If no initial time step is given, estimate one. With constant
+	// time steps this is also the step size used throughout:
+	std::size_t init_fun_evals = 0;
+	if (dt <= 0.0) {
+		int order = step_size_order(sc.order, sc.order2);
+		dt = initial_dt(func, t0, t1, y0, order, solver_opts.abs_tol,
+		                solver_opts.rel_tol, solver_opts.max_dt,
+		                init_fun_evals, solver_opts.abs_tols);
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: Estimated initial dt = "
+			          << dt << "\n";
+		}
+	}
+
 	if( t0 + dt > t1 ){
-		std::cerr << "    Rehuel: Initial dt (" << dt;
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: Initial dt (" << dt
+			          << ") too large for interval! Reducing to "
+			          << t1 - t0 << "\n";
+		}
 		dt = t1 - t0;
-		std::cerr << ") too large for interval! Reducing to "
-		          << dt << "\n";
 
 	}
 
-	std::cerr << "    Rehuel: Integrating over interval [ "
-	          << t0 << ", " << t1 << " ]...\n"
-	          << "            Method = " << sc.name << "\n";
+	if (!solver_opts.quiet) {
+		std::cerr << "    Rehuel: Integrating over interval [ "
+		          << t0 << ", " << t1 << " ]...\n"
+		          << "            Method = " << sc.name << "\n";
+	}
 
 	const bool time_internals = solver_opts.time_internals;
 	my_timer timer;
@@ -524,6 +1469,7 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 	double t = t0;
 	rk_output sol;
 	sol.status = SUCCESS;
+	sol.count.fun_evals += init_fun_evals;
 
 	assert( solver_opts.newton_opts && "Newton solver options not set!" );
 	assert( dt > 0 && "Cannot use time step size <= 0!" );
@@ -542,18 +1488,21 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 	if (time_internals) timings[VECTOR_SETUP] += timer.toc();
 	long long int step = 0;
 
-	double dts[3];
-	double errs[3];
 	double err = 0.0;
 	double new_dt = dt;
-	dts[0] = dts[1] = dts[2] = dt;
-	errs[0] = errs[1] = errs[2] = 0.9;
 
 	if( solver_opts.out_interval > 0 ){
 		std::cerr  << "    Rehuel: step  t  dt   err   iters\n";
 	}
 
 	vec_type err_est = arma::zeros( y.size() );
+	dense_lu<double> err_lu;
+
+	// The temporaries of each step are kept in a workspace:
+	enum workspace_vecs { WS_DELTA_Y = 0, WS_DELTA_ALT, WS_Y_N, WS_DY_ALT,
+	                      WS_Y_TMP, WS_DK, N_WS_VECS };
+	enum workspace_mats { WS_ERR_MAT = 0, N_WS_MATS };
+	workspace<vec_type, mat_type> ws(N_WS_VECS, N_WS_MATS);
 	if (time_internals) timer.tic();
         //-EDIT--------------------------------------------------------------------------------
         if (t-t0 - capture_dt * sol.t_vals.size() > capture_dt) {
@@ -565,9 +1514,16 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
         }
 	if (time_internals) timings[STORE_SOL] += timer.toc();
 	bool alternative_error_formula = true;
-	std::size_t min_order = std::min( sc.order, sc.order2 );
         //--------------------------------------------------------------------------------------
 
+	// For time step size control:
+	int ctrl_type = solver_opts.step_controller;
+	if (ctrl_type == common_solver_options::DEFAULT_CONTROLLER) {
+		ctrl_type = common_solver_options::PREDICTIVE_GUSTAFSSON;
+	}
+	step_controller ctrl(ctrl_type, step_size_order(sc.order, sc.order2),
+	                     8.0);
+
 
 	// Variables/parameters for Newton iteration:
 	vec_type Y; // Contains the stages.
@@ -576,10 +1532,53 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 	double Rtol = newton_opts.tol;
 	newton::status newton_stats;
 
-	// Construct the alternative weights:
-	mat_type Ai = arma::inv(sc.A);
-	vec_type d_weights  = (Ai.t())*sc.b;
-	vec_type d2_weights = (Ai.t())*sc.b2;
+	// Diagonally implicit methods have their stages solved one by one:
+	const bool dirk = is_method_dirk(sc);
+	mat_type K; // Contains the stage derivatives for DIRK methods.
+
+	// Fully implicit methods can have their stages solved in parallel:
+	bool pirk = !dirk && solver_opts.internal_solver == solver_options::PIRK;
+	if (pirk && sc.pirk_d.size() != sc.b.size()) {
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: " << sc.name << " does not "
+			          << "support PIRK, using Newton instead.\n";
+		}
+		pirk = false;
+	}
+	const bool broyden = !dirk && !pirk &&
+		solver_opts.internal_solver == solver_options::BROYDEN;
+	// Fixed-point iteration needs no Jacobi matrix at all:
+	const bool fixed_point = !dirk && !pirk &&
+		solver_opts.internal_solver == solver_options::ANDERSON;
+
+	// Construct the alternative weights. For DIRK methods A can be
+	// singular, so there the update is formed from K directly.
+	vec_type d_weights, d2_weights;
+	if (!dirk) {
+		mat_type Ai = arma::inv(sc.A);
+		d_weights  = (Ai.t())*sc.b;
+		d2_weights = (Ai.t())*sc.b2;
+	}
+
+	// For detecting that the problem is no longer stiff:
+	int n_stiff = 0, n_nonstiff = 0;
+
+	// Whether J was evaluated at the current (t,y), and whether it may be
+	// re-used on the next step because the Newton iteration converged fast:
+	bool jac_current = false, jac_reusable = false;
+
+	// Only evaluate stages concurrently if the functor allows it:
+	const bool parallel_stages = solver_opts.parallel_stages &&
+		functor_is_thread_safe<functor_type>::value;
+
+	// Forms I - h*J in the workspace, for filtering the error estimate:
+	auto error_matrix = [&ws, &J, Neq](double h) -> const mat_type &
+		{
+			mat_type &M = ws.mat(WS_ERR_MAT, Neq, Neq);
+			M = (-h)*J;
+			for (std::size_t i = 0; i < Neq; ++i) M(i,i) += 1.0;
+			return M;
+		};
 	
 	
 	while( t < t1 ){
@@ -592,22 +1591,68 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 
 		if (solver_opts.max_steps >= 0 &&
 		    step > solver_opts.max_steps) {
-			std::cerr << "    Rehuel: Maximum number of attempts exceeded.\n";
+			if (!solver_opts.quiet) {
+				std::cerr << "    Rehuel: Maximum number of "
+				          << "attempts exceeded.\n";
+			}
 			sol.status = ERROR_MAX_STEPS_EXCEEDED;
-			return sol;
+			break;
 		}
 
 		int integrator_status = 0;
 		
 		// Use newton iteration to find the Ks for the next level:
 
-		int newton_status = newton_solve_stages(func, y, t, dt, sc,
-		                                        newton_opts.maxit,
-		                                        newton_opts.refresh_jac,
-		                                        xtol, Rtol, Y, J,
-		                                        newton_stats,
-		                                        sol.count.fun_evals,
-		                                        sol.count.jac_evals);
+		int newton_status = 0;
+		bool reuse_jac = jac_current || jac_reusable;
+		if (dirk) {
+			newton_status = dirk_solve_stages(func, y, t, dt, sc,
+			                                  newton_opts.maxit,
+			                                  xtol, Rtol, Y, K, J,
+			                                  newton_stats,
+			                                  sol.count.fun_evals,
+			                                  sol.count.jac_evals,
+			                                  reuse_jac);
+		} else if (fixed_point) {
+			newton_status = anderson_solve_stages(func, y, t, dt, sc,
+			                                      newton_opts.maxit,
+			                                      newton_opts.anderson_memory,
+			                                      xtol, Rtol, Y,
+			                                      newton_stats,
+			                                      sol.count.fun_evals,
+			                                      parallel_stages);
+		} else if (broyden) {
+			newton_status = broyden_solve_stages(func, y, t, dt, sc,
+			                                     newton_opts.maxit,
+			                                     newton_opts.broyden_memory,
+			                                     xtol, Rtol, Y, J,
+			                                     newton_stats,
+			                                     sol.count.fun_evals,
+			                                     sol.count.jac_evals,
+			                                     reuse_jac,
+			                                     parallel_stages);
+		} else if (pirk) {
+			newton_status = pirk_solve_stages(func, y, t, dt, sc,
+			                                  newton_opts.maxit,
+			                                  newton_opts.refresh_jac,
+			                                  xtol, Rtol, Y, J,
+			                                  newton_stats,
+			                                  sol.count.fun_evals,
+			                                  sol.count.jac_evals,
+			                                  reuse_jac,
+			                                  parallel_stages);
+		} else {
+			newton_status = stage_solver::solve(func, y, t, dt, sc,
+			                                    newton_opts.maxit,
+			                                    newton_opts.refresh_jac,
+			                                    xtol, Rtol, Y, J,
+			                                    newton_stats,
+			                                    sol.count.fun_evals,
+			                                    sol.count.jac_evals,
+			                                    reuse_jac,
+			                                    parallel_stages);
+		}
+		if (!reuse_jac) jac_current = true;
 
 
 		
@@ -615,18 +1660,6 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 
 		// *********** Verify Newton iteration convergence ************
 		if( newton_status != newton::SUCCESS ){
-			if( !solver_opts.adaptive_step_size ){
-				// In this case, you can do nothing but error.
-				sol.status = GENERAL_ERROR;
-				std::cerr << "   Rehuel: Newton iteration "
-				          << "failed for constant time step "
-				          << "size! Aborting!\n";
-				return sol;
-			}
-
-			//std::cerr << "   Rehuel: Newton iteration failed! "
-			//          << "Retrying with dt = " << dt << "\n";
-			dt *= 0.5;
 			sol.count.reject_newton++;
 			if( newton_status == newton::INCREMENT_DIVERGE ){
 				sol.count.newton_incr_diverge++;
@@ -635,6 +1668,38 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 			}else if( newton_status == newton::MAXIT_EXCEEDED ){
 				sol.count.newton_maxit_exceed++;
 			}
+
+			if( !jac_current ){
+				// The Jacobi matrix is from an earlier step, so it
+				// might just be stale. Retry with the same dt first:
+				jac_reusable = false;
+				sol.count.newton_jac_refresh++;
+				continue;
+			}
+
+			if( !solver_opts.adaptive_step_size ){
+				// In this case, you can do nothing but error.
+				sol.status = GENERAL_ERROR;
+				if (!solver_opts.quiet) {
+					std::cerr << "   Rehuel: Newton iteration "
+					          << "failed for constant time "
+					          << "step size! Aborting!\n";
+				}
+				break;
+			}
+
+			// The Jacobi matrix is fresh, so dt is too large. The
+			// contraction rate of simplified Newton scales roughly
+			// with dt, so aim for a rate of about 0.5. Without a rate
+			// (failure in the first iteration), just halve dt:
+			double theta = newton_stats.contraction;
+			double dt_fac = 0.5;
+			if( theta > 0 ){
+				dt_fac = std::max(0.1, std::min(0.7, 0.4 / theta));
+			}
+			//std::cerr << "   Rehuel: Newton iteration failed! "
+			//          << "Retrying with dt = " << dt << "\n";
+			dt *= dt_fac;
 			continue;
 		}else{
 			sol.count.newton_success++;
@@ -647,76 +1712,97 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 		// At this point, Y contains the stages defined by
 		// Y_i = dt*(a_i1*k1 + a_i2*k2)...
 		// The update to y is given by d := b*inv(A);
-		
-
-		vec_type delta_y, delta_alt;
-		std::size_t Neq = y.size();
+		vec_type &delta_y   = ws.vec(WS_DELTA_Y, Neq);
+		vec_type &delta_alt = ws.vec(WS_DELTA_ALT, Neq);
+		vec_type &y_n       = ws.vec(WS_Y_N, Neq);
+		vec_type &dy_alt    = ws.vec(WS_DY_ALT, Neq);
+		vec_type &y_tmp     = ws.vec(WS_Y_TMP, Neq);
 		double gam = sc.gamma*dt;
+		// Whether the error estimate could be filtered:
+		bool err_filtered = true;
+
+		if (dirk) {
+			// The classical embedded pair is formed from the k_i:
+			delta_y = dt*(K*sc.b);
+			if (solver_opts.adaptive_step_size) {
+				delta_alt = dt*(K*sc.b2);
+			}
+			y_n = y + delta_y;
+			if (time_internals) timings[UPDATE_Y] += timer.toc();
 
-		// Vectorized version of the loop below:
-		mat_type YYs = arma::reshape(Y, Neq, Ns);
-		delta_y = YYs*d_weights;
-		
-		if (solver_opts.adaptive_step_size) {
-			delta_alt = YYs*d2_weights;
-		}
-
-		vec_type dy_alt = gam * func.fun(t,y) + delta_alt;
-		++sol.count.fun_evals;
-		
-		vec_type y_n    = y + delta_y;
-		vec_type yp     = y + dy_alt;
-		vec_type delta_delta = dy_alt - delta_y;
-		if (time_internals) timings[UPDATE_Y] += timer.toc();
+			// **************      Estimate error:    **********************
+			if (time_internals) timer.tic();
 
-		// **************      Estimate error:    **********************
-		if (time_internals) timer.tic();
+			// Filter the error estimate with the last stage matrix to
+			// keep it bounded for stiff components:
+			if (solver_opts.adaptive_step_size) {
+				double h = dt*sc.A(Ns-1,Ns-1);
+				err_est = delta_alt - delta_y;
+				err_filtered = err_lu.factor(error_matrix(h));
+				if (err_filtered) err_lu.solve(err_est);
+			}
+		} else {
+			// Form y_n and the embedded update in one pass over Y:
+			const bool embedded = solver_opts.adaptive_step_size;
+			const double *Yp = Y.memptr();
+			for (std::size_t i = 0; i < Neq; ++i) {
+				double d = 0.0, d2 = 0.0;
+				for (std::size_t j = 0; j < Ns; ++j) {
+					d += d_weights(j)*Yp[j*Neq + i];
+					if (embedded) d2 += d2_weights(j)*Yp[j*Neq + i];
+				}
+				delta_y(i)   = d;
+				delta_alt(i) = d2;
+				y_n(i)       = y(i) + d;
+			}
+			if (time_internals) timings[UPDATE_Y] += timer.toc();
+		}
 
-		// Formula 8.19:
-		// J0 = func.jac( t, y );
-		// J was already calculated for us in newton_solve_stages:
-		mat_type solve_tmp = arma::eye(Neq,Neq) - gam*J;
-		vec_type err_8_19 = dt*arma::solve(solve_tmp, delta_delta);
-		err_est = err_8_19;
-
-		// Alternative formula 8.20:
-		if( alternative_error_formula ){
-			// Use the alternative formulation:
-			// vec_type dy_alt_alt = gamma*func.fun(t, y+err_est);
-			vec_type dy_alt_alt = gam*func.fun(t, y + err_est);
+		// With constant steps there is no embedded solution to
+		// estimate the error with:
+		if (!dirk && solver_opts.adaptive_step_size) {
+			dy_alt = func.fun(t,y);
 			++sol.count.fun_evals;
-		
-			dy_alt_alt += delta_alt;
-			vec_type err_alt = dy_alt_alt - delta_y;
-			err_est = dt*arma::solve(solve_tmp, err_alt);
-		}
+			dy_alt *= gam;
+			dy_alt += delta_alt;
 
-		double err_tot = 0.0;
-		double n = 0.0;
-		double atol = solver_opts.abs_tol;
-		double rtol = solver_opts.rel_tol;
-		for( std::size_t i = 0; i < err_est.size(); ++i ){
-			double erri = err_est[i];
-			double y0i  = std::fabs( y[i] );
-			double y1i  = std::fabs( y_n[i] );
-			double sci  = atol + rtol * std::max( y0i, y1i );
+			// **************      Estimate error:    **********************
+			if (time_internals) timer.tic();
 
-			double add = erri / sci;
-			err_tot += add * add;
-			n += 1.0;
+			// Formula 8.19:
+			// J0 = func.jac( t, y );
+			// J was already calculated for us in newton_solve_stages.
+			// Without one, the problem should be non-stiff, so the
+			// estimate needs no filtering:
+			err_est = dt*(dy_alt - delta_y);
+			if (!fixed_point) {
+				// Both formulas share the same matrix, so factor it once:
+				err_filtered = err_lu.factor(error_matrix(gam));
+				if (err_filtered) err_lu.solve(err_est);
+
+				// Alternative formula 8.20:
+				if( alternative_error_formula ){
+					// Use the alternative formulation:
+					// vec_type dy_alt_alt = gamma*func.fun(t, y+err_est);
+					y_tmp = y + err_est;
+					dy_alt = func.fun(t, y_tmp);
+					++sol.count.fun_evals;
+					dy_alt *= gam;
+					dy_alt += delta_alt;
+
+					err_est = dt*(dy_alt - delta_y);
+					if (err_filtered) err_lu.solve(err_est);
+				}
+			}
 		}
 
-		assert( err_tot >= 0.0 && "Error cannot be negative!" );
-		err = std::sqrt( err_tot / n );
+		err = error_norm( err_est, y, y_n, solver_opts );
 
 
 		if( err < machine_precision ){
 			err = machine_precision;
 		}
 
-		errs[2] = errs[1];
-		errs[1] = errs[0];
-		errs[0] = err;
 		if (time_internals) timings[ESTIMATE_ERROR] += timer.toc();
 
 		if( solver_opts.adaptive_step_size && (err > 1.0) ){
@@ -724,39 +1810,27 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 			alternative_error_formula = true;
 			integrator_status = 1;
 			sol.count.reject_err++;
+		}else if( !err_filtered ){
+			// The unfiltered estimate cannot be trusted for stiff
+			// components, so retry with a smaller step instead:
+			if (!solver_opts.quiet) {
+				std::cerr << "    Rehuel: Singular error matrix at t = "
+				          << t << ", rejecting step.\n";
+			}
+			integrator_status = 1;
+			sol.count.reject_err++;
 		}
 
 
 		// **************      Find new dt:    **********************
 		if (time_internals) timer.tic();
-		double fac = 0.9 * ( newton_opts.maxit + 1.0 );
-		fac /= ( newton_opts.maxit + newton_stats.iters );
-
-		double expt = 1.0 / ( 1.0 + min_order );
-		double err_inv = 1.0 / err;
-		double scale_27 = std::pow( err_inv, expt );
-		double dt_rat = dts[0] / dts[1];
-		double err_frac = errs[1] / errs[0];
-		if( errs[1] == 0 || errs[0] == 0 ){
-			err_frac = 1.0;
-		}
-		double err_rat = std::pow( err_frac, expt );
-		double scale_28 = scale_27 * dt_rat * err_rat;
-
-		/*
-		std::cerr << "    Rehuel: Time step controller:\n"
-		          << "            err      = " << err << "\n"
-		          << "            err_inv  = " << err_inv << "\n"
-		          << "            dt_rat   = " << dt_rat << "\n"
-		          << "            err_frac = " << err_frac << "\n"
-		          << "            err_rat  = " << err_rat << "\n"
-		          << "            scale_27 = " << scale_27 << "\n"
-		          << "            scale_28 = " << scale_28 << "\n\n";
-		*/
-
-		double min_scales = std::min( scale_27, scale_28 );
-		// When growing dt, don't grow more than a factor 4:
-		new_dt = fac * dt * std::min( 8.0, min_scales );
+		// Take smaller steps if the Newton iteration needed many iterations:
+		ctrl.fac = 0.9 * ( newton_opts.maxit + 1.0 );
+		ctrl.fac /= ( newton_opts.maxit + newton_stats.iters );
+		new_dt = ctrl.next_dt( dt, err, integrator_status == 0 );
+		if( !err_filtered ){
+			new_dt = std::min( 0.5*dt, new_dt );
+		}
 		if( solver_opts.max_dt > 0 ){
 			new_dt = std::min( solver_opts.max_dt, new_dt );
 		}
@@ -777,6 +1851,15 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 			y  = y_n;
 			t += dt;
 			++step;
+
+			// Only re-use J if dt does not grow too much, else a
+			// Newton failure is more likely caused by dt than by J.
+			// Broyden iteration corrects for an old J by itself:
+			jac_current  = false;
+			jac_reusable = new_dt < 2.0*dt && !fixed_point &&
+				(newton_stats.contraction <
+				 solver_opts.jac_reuse_contraction ||
+				 (broyden && solver_opts.jac_reuse_contraction > 0));
 			
 			if (time_internals) {
 				timings[UPDATE_Y] += timer.toc();
@@ -794,6 +1877,41 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 			//-------------------------------------------------------------------------------------
 			
 			alternative_error_formula = false;
+
+			if (solver_opts.detect_nonstiffness && Ns > 1) {
+				// J is not refreshed every step, so estimate the
+				// spectral radius from the last two stages instead:
+				const double *Z1 = Y.memptr() + (Ns-2)*Neq;
+				const double *Z2 = Y.memptr() + (Ns-1)*Neq;
+				vec_type &dk = ws.vec(WS_DK, Neq);
+				if (dirk) {
+					dk = K.col(Ns-1) - K.col(Ns-2);
+				} else {
+					double tp = t - dt;
+					for (std::size_t i = 0; i < Neq; ++i) {
+						y_tmp(i) = yo(i) + Z2[i];
+					}
+					dk = func.fun(tp + sc.c(Ns-1)*dt, y_tmp);
+					for (std::size_t i = 0; i < Neq; ++i) {
+						y_tmp(i) = yo(i) + Z1[i];
+					}
+					dk -= func.fun(tp + sc.c(Ns-2)*dt, y_tmp);
+					sol.count.fun_evals += 2;
+				}
+				double dz2 = 0.0;
+				for (std::size_t i = 0; i < Neq; ++i) {
+					dz2 += (Z2[i] - Z1[i])*(Z2[i] - Z1[i]);
+				}
+				double dz  = std::sqrt(dz2);
+				double rho = dz > 0 ? arma::norm(dk) / dz : 0.0;
+				if (dt*rho < solver_opts.stiffness_bound) {
+					n_stiff = 0;
+					++n_nonstiff;
+				} else {
+					++n_stiff;
+					if (n_stiff == 6) n_nonstiff = 0;
+				}
+			}
 		}
 		
 		// **************      Actually set the new dt:    **********************
@@ -801,18 +1919,38 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 		if( solver_opts.adaptive_step_size ) {
 			dt = new_dt;
 		}
-		dts[2] = dts[1];
-		dts[1] = dts[0];
-		dts[0] = dt;
 
 		if( solver_opts.extrapolate_stage && (integrator_status == 0) ){
 			// TODO
 		}
+
+		if (n_nonstiff >= 15) {
+			if (!solver_opts.quiet) {
+				std::cerr << "    Rehuel: Problem seems no longer "
+				          << "stiff at t = " << t << ".\n";
+			}
+			sol.status = NONSTIFFNESS_DETECTED;
+			break;
+		}
+	}
+
+	// All exits end up here. Make sure the final state is always
+	// available, so that the integration can be resumed from it:
+	if (sol.t_vals.empty() || sol.t_vals.back() != t) {
+		sol.t_vals.push_back(t);
+		sol.y_vals.push_back(y);
+		sol.stages.push_back(K_np);
+		sol.err_est.push_back( err_est );
+		sol.err.push_back( err );
 	}
 
 	double elapsed = timer.get_elapsed(irk_start);
 	sol.elapsed_time = elapsed;
 	sol.accept_frac = static_cast<double>(step) / sol.count.attempt;
+	sol.next_dt = dt;
+	sol.count.max_reject_streak = ctrl.max_reject_streak;
+	sol.count.workspace_resizes = ws.resizes;
+	sol.count.steps = step;
 
 	if (time_internals) print_timing_breakdown(timings);
 
@@ -820,6 +1958,76 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 }
 
 
+/**
+   \brief Calls irk_guts with func, which has a jac member.
+*/
+template <typename stage_solver, typename functor_type> inline
+rk_output irk_guts_jac( functor_type &func, double t0, double t1,
+                        const vec_type &y0, const solver_options &solver_opts,
+                        double dt, const solver_coeffs &sc, std::true_type )
+{
+	return irk_guts<functor_type, stage_solver>( func, t0, t1, y0,
+	                                             solver_opts, dt, sc );
+}
+
+
+/**
+   \brief Calls irk_guts with func, which has no jac member but implements
+   fun_generic, so its Jacobi matrix is computed with automatic
+   differentiation (see autodiff::ad_functor).
+*/
+template <typename stage_solver, typename functor_type> inline
+rk_output irk_guts_approx_jac( functor_type &func, double t0, double t1,
+                               const vec_type &y0,
+                               const solver_options &solver_opts,
+                               double dt, const solver_coeffs &sc,
+                               std::true_type )
+{
+	typedef autodiff::ad_functor<functor_type> ad_functor_type;
+	ad_functor_type ad_func( func, solver_opts.fd_jac.pattern,
+	                         solver_opts.fd_jac.detect_pattern );
+	rk_output sol = irk_guts<ad_functor_type, stage_solver>(
+		ad_func, t0, t1, y0, solver_opts, dt, sc );
+	sol.count.fun_evals += ad_func.fun_evals;
+	return sol;
+}
+
+
+/**
+   \brief Calls irk_guts with func, which has no jac member, so its Jacobi
+   matrix is approximated with finite differences (see solver_options::fd_jac).
+*/
+template <typename stage_solver, typename functor_type> inline
+rk_output irk_guts_approx_jac( functor_type &func, double t0, double t1,
+                               const vec_type &y0,
+                               const solver_options &solver_opts,
+                               double dt, const solver_coeffs &sc,
+                               std::false_type )
+{
+	typedef jacobian::fd_functor<functor_type> fd_functor_type;
+	fd_functor_type fd_func( func, solver_opts.fd_jac );
+	rk_output sol = irk_guts<fd_functor_type, stage_solver>(
+		fd_func, t0, t1, y0, solver_opts, dt, sc );
+	sol.count.fun_evals += fd_func.fun_evals;
+	return sol;
+}
+
+
+/**
+   \brief Calls irk_guts with func, which has no jac member.
+*/
+template <typename stage_solver, typename functor_type> inline
+rk_output irk_guts_jac( functor_type &func, double t0, double t1,
+                        const vec_type &y0, const solver_options &solver_opts,
+                        double dt, const solver_coeffs &sc, std::false_type )
+{
+	return irk_guts_approx_jac<stage_solver>(
+		func, t0, t1, y0, solver_opts, dt, sc,
+		std::integral_constant<bool,
+		    autodiff::has_fun_generic<functor_type>::value>() );
+}
+
+
 /**
    \brief Time-integrate a given ODE from t0 to t1, starting at y0
 
@@ -827,7 +2035,7 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
    \param t0           Starting time
    \param t1           Final time
    \param y0           Initial values
-   \param dt           Initial time step size.
+   \param dt           Initial time step size. If <= 0, it is estimated.
    \param solver_opts  Options for the internal solver.
 
    \returns a struct with the solution and info about the solution quality.
@@ -835,17 +2043,64 @@ rk_output irk_guts( functor_type &func, double t0, double t1, const vec_type &y0
 template <typename functor_type> inline
 rk_output odeint( functor_type &func, double t0, double t1, const vec_type &y0,
                   solver_options solver_opts,
-                  int method = irk::RADAU_IIA_53, double dt = 1e-6 )
+                  int method = irk::RADAU_IIA_53, double dt = 0.0 )
+{
+	solver_coeffs sc = get_coefficients( method );
+	if (solver_opts.adaptive_step_size && sc.b2.size() == 0) {
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: WARNING: Cannot have adaptive "
+			          << "time step with non-embedding method! "
+			          << "Disabling adaptive time step size!\n";
+		}
+		solver_opts.adaptive_step_size = false;
+	}
+	assert( verify_solver_coeffs( sc ) && "Invalid solver coefficients!" );
+	if (solver_opts.mixed_precision_lu) {
+		return irk_guts_jac<mixed_precision_stage_solver>(
+			func, t0, t1, y0, solver_opts, dt, sc,
+			std::integral_constant<bool,
+			    functor_has_jac<functor_type>::value>() );
+	}
+	return irk_guts_jac<dynamic_stage_solver>(
+		func, t0, t1, y0, solver_opts, dt, sc,
+		std::integral_constant<bool,
+		    functor_has_jac<functor_type>::value>() );
+}
+
+
+/**
+   \brief Time-integrate a given ODE of Neq equations from t0 to t1,
+   starting at y0, solving the stages with fixed-size work arrays.
+
+   For small systems this avoids the overhead of the dynamically sized
+   Newton iteration (see newton_solve_stages_fixed). DIRK methods are
+   solved as usual.
+
+   \tparam Neq         Number of equations; must equal y0.size().
+
+   See odeint for the other parameters.
+*/
+template <std::size_t Neq, typename functor_type> inline
+rk_output odeint_fixed( functor_type &func, double t0, double t1,
+                        const vec_type &y0, solver_options solver_opts,
+                        int method = irk::RADAU_IIA_53, double dt = 0.0 )
 {
+	static_assert(Neq > 0, "Fixed-size systems need at least one equation!");
+	assert( y0.size() == Neq && "Wrong number of equations!" );
 	solver_coeffs sc = get_coefficients( method );
 	if (solver_opts.adaptive_step_size && sc.b2.size() == 0) {
-		std::cerr << "    Rehuel: WARNING: Cannot have adaptive time "
-		          << "step with non-embedding method! Disabling "
-		          << "adaptive time step size!\n";
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: WARNING: Cannot have adaptive "
+			          << "time step with non-embedding method! "
+			          << "Disabling adaptive time step size!\n";
+		}
 		solver_opts.adaptive_step_size = false;
 	}
 	assert( verify_solver_coeffs( sc ) && "Invalid solver coefficients!" );
-	return irk_guts( func, t0, t1, y0, solver_opts, dt, sc );
+	return irk_guts_jac<fixed_stage_solver<Neq> >(
+		func, t0, t1, y0, solver_opts, dt, sc,
+		std::integral_constant<bool,
+		    functor_has_jac<functor_type>::value>() );
 }
 
 
@@ -868,7 +2123,7 @@ rk_output odeint( functor_type &func, double t0, double t1, const vec_type &y0)
 {
 	solver_options s_opts = default_solver_options();
 	newton::options n_opts;
-	n_opts.tol = 0.1*std::min(s_opts.abs_tol, s_opts.rel_tol);
+	n_opts.tol = 0.1*std::min(s_opts.min_abs_tol(), s_opts.rel_tol);
 	s_opts.newton_opts = &n_opts;
 	return odeint(func, t0, t1, y0, s_opts);
 }
@@ -0,0 +1,541 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file jacobian.hpp
+
+   \brief Finite difference approximations of Jacobi matrices that exploit
+   sparsity.
+*/
+
+#ifndef JACOBIAN_HPP
+#define JACOBIAN_HPP
+
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "arma_include.hpp"
+#include "functor_traits.hpp"
+
+
+/**
+   \brief Contains finite difference Jacobi matrices with column colouring
+   (Curtis, Powell & Reid, 1974).
+
+   Columns of the Jacobi matrix that have no non-zero row in common can be
+   perturbed at the same time, so a matrix with such a colouring of n_colours
+   groups of columns costs n_colours instead of N extra RHS evaluations. A
+   banded matrix, for example, only needs as many as its band is wide.
+*/
+namespace jacobian {
+
+
+/**
+   \brief The (structurally) non-zero entries of a Jacobi matrix.
+*/
+struct sparsity_pattern
+{
+	sparsity_pattern() : N(0) {}
+
+	/// Number of equations.
+	std::size_t N;
+
+	/// For every column, the rows that can be non-zero.
+	std::vector<std::vector<std::size_t> > col_rows;
+
+	/// \brief Returns the number of non-zero entries.
+	std::size_t n_nonzero() const
+	{
+		std::size_t nnz = 0;
+		for (const std::vector<std::size_t> &rows : col_rows) {
+			nnz += rows.size();
+		}
+		return nnz;
+	}
+};
+
+
+/**
+   \brief Returns the pattern of a dense N x N matrix.
+*/
+inline sparsity_pattern dense_pattern(std::size_t N)
+{
+	sparsity_pattern p;
+	p.N = N;
+	p.col_rows.resize(N);
+	for (std::size_t j = 0; j < N; ++j) {
+		for (std::size_t i = 0; i < N; ++i) {
+			p.col_rows[j].push_back(i);
+		}
+	}
+	return p;
+}
+
+
+/**
+   \brief Returns the pattern of an N x N matrix with lower sub-diagonals
+   and upper super-diagonals.
+*/
+inline sparsity_pattern banded_pattern(std::size_t N, std::size_t lower,
+                                       std::size_t upper)
+{
+	sparsity_pattern p;
+	p.N = N;
+	p.col_rows.resize(N);
+	for (std::size_t j = 0; j < N; ++j) {
+		std::size_t i0 = j > upper ? j - upper : 0;
+		std::size_t i1 = std::min(N - 1, j + lower);
+		for (std::size_t i = i0; i <= i1; ++i) {
+			p.col_rows[j].push_back(i);
+		}
+	}
+	return p;
+}
+
+
+/**
+   \brief Colours the columns of pattern greedily such that no two columns
+   of the same colour share a non-zero row.
+
+   \param pattern  The sparsity pattern.
+   \param colours  Will contain the colour of every column.
+
+   \returns the number of colours.
+*/
+inline std::size_t colour_columns(const sparsity_pattern &pattern,
+                                  std::vector<std::size_t> &colours)
+{
+	std::size_t N = pattern.N;
+	const std::size_t none = std::numeric_limits<std::size_t>::max();
+	colours.assign(N, none);
+
+	// Columns that have a non-zero in each row:
+	std::vector<std::vector<std::size_t> > row_cols(N);
+	for (std::size_t j = 0; j < N; ++j) {
+		for (std::size_t i : pattern.col_rows[j]) {
+			row_cols[i].push_back(j);
+		}
+	}
+
+	std::size_t n_colours = 0;
+	// taken[c] == j marks colour c as used by a neighbour of column j:
+	std::vector<std::size_t> taken;
+	for (std::size_t j = 0; j < N; ++j) {
+		for (std::size_t i : pattern.col_rows[j]) {
+			for (std::size_t k : row_cols[i]) {
+				if (colours[k] != none) taken[colours[k]] = j;
+			}
+		}
+		std::size_t c = 0;
+		while (c < n_colours && taken[c] == j) ++c;
+		if (c == n_colours) {
+			++n_colours;
+			taken.push_back(none);
+		}
+		colours[j] = c;
+	}
+	return n_colours;
+}
+
+
+/**
+   \brief Returns the columns of pattern grouped by their colour (see
+   colour_columns).
+*/
+inline std::vector<std::vector<std::size_t> >
+colour_groups(const sparsity_pattern &pattern)
+{
+	std::vector<std::size_t> colours;
+	std::size_t n_colours = colour_columns(pattern, colours);
+	std::vector<std::vector<std::size_t> > groups(n_colours);
+	for (std::size_t j = 0; j < pattern.N; ++j) {
+		groups[colours[j]].push_back(j);
+	}
+	return groups;
+}
+
+
+/**
+   \brief Determines the bandwidth of pattern.
+
+   \param pattern  The sparsity pattern.
+   \param lower    Will contain the number of sub-diagonals.
+   \param upper    Will contain the number of super-diagonals.
+*/
+inline void bandwidth(const sparsity_pattern &pattern,
+                      std::size_t &lower, std::size_t &upper)
+{
+	lower = upper = 0;
+	for (std::size_t j = 0; j < pattern.N; ++j) {
+		for (std::size_t i : pattern.col_rows[j]) {
+			if (i > j) lower = std::max(lower, i - j);
+			else       upper = std::max(upper, j - i);
+		}
+	}
+}
+
+
+/**
+   \brief Detects which entries of the Jacobi matrix of func.fun can be
+   non-zero, by perturbing one component of y at a time and observing
+   which components of the RHS change.
+
+   To avoid missing entries that happen to vanish at y (think of
+   y(i)*y(j) with y(j) = 0), this is repeated around n_probes - 1
+   pseudo-random points close to y. The diagonal is always included.
+   This costs n_probes*(N+1) RHS evaluations, so the result should be
+   kept and passed as options::pattern (fd_functor does this by itself).
+
+   \param func       Functor of the ODE.
+   \param t          Time to probe at.
+   \param y          State to probe around.
+   \param fun_evals  Is increased by the number of RHS evaluations.
+   \param n_probes   Number of points to probe at.
+
+   \returns the detected sparsity pattern.
+*/
+template <typename functor_type> inline
+sparsity_pattern detect_pattern(functor_type &func, double t,
+                                const arma::vec &y, std::size_t &fun_evals,
+                                int n_probes = 2)
+{
+	std::size_t N = y.size();
+	std::vector<std::vector<char> > nonzero(N, std::vector<char>(N, 0));
+	for (std::size_t j = 0; j < N; ++j) nonzero[j][j] = 1;
+
+	// A fixed linear congruential sequence in [-1,1), so that the
+	// detected pattern is reproducible:
+	std::uint64_t state = 88172645463325252ull;
+	auto next_random = [&state]()
+		{
+			state = 6364136223846793005ull*state + 1442695040888963407ull;
+			return std::ldexp(static_cast<double>(state >> 11), -52) - 1.0;
+		};
+
+	arma::vec yb = y;
+	for (int probe = 0; probe < n_probes; ++probe) {
+		if (probe > 0) {
+			for (std::size_t j = 0; j < N; ++j) {
+				yb(j) = y(j) + 1e-2*next_random()
+					* std::max(std::fabs(y(j)), 1.0);
+			}
+		}
+		arma::vec fb = func.fun(t, yb);
+		++fun_evals;
+		for (std::size_t j = 0; j < N; ++j) {
+			double yj = yb(j);
+			yb(j) += 1e-4*std::max(std::fabs(yj), 1.0);
+			arma::vec fp = func.fun(t, yb);
+			++fun_evals;
+			yb(j) = yj;
+			for (std::size_t i = 0; i < N; ++i) {
+				if (fp(i) != fb(i)) nonzero[j][i] = 1;
+			}
+		}
+	}
+
+	sparsity_pattern p;
+	p.N = N;
+	p.col_rows.resize(N);
+	for (std::size_t j = 0; j < N; ++j) {
+		for (std::size_t i = 0; i < N; ++i) {
+			if (nonzero[j][i]) p.col_rows[j].push_back(i);
+		}
+	}
+	return p;
+}
+
+
+/**
+   \brief Options for the finite difference Jacobi matrix.
+*/
+struct options
+{
+	options() : central(false), parallel(false), pattern(nullptr),
+	            detect_pattern(false), complex_step(true) {}
+
+	/// If true, use central differences, which are more accurate but need
+	/// twice as many RHS evaluations.
+	bool central;
+
+	/// If true, evaluate the colours concurrently with OpenMP. This only
+	/// happens if the functor is marked thread-safe (see
+	/// functor_is_thread_safe).
+	bool parallel;
+
+	/// The sparsity pattern of the Jacobi matrix. If nullptr, it is dense,
+	/// unless detect_pattern is true.
+	const sparsity_pattern *pattern;
+
+	/// If true and pattern is nullptr, fd_functor detects the pattern
+	/// with detect_pattern the first time it needs the Jacobi matrix.
+	bool detect_pattern;
+
+	/// If true, fd_functor uses cs_jacobian instead of finite differences
+	/// for functors that can evaluate their RHS for complex y (see
+	/// functor_has_complex_fun).
+	bool complex_step;
+};
+
+
+/**
+   \brief Approximates the Jacobi matrix of func.fun at (t,y) with finite
+   differences, perturbing the columns in each group together.
+
+   Every column gets its own step size, relative to the magnitude of its
+   y-component, so that badly scaled components are differenced as
+   accurately as the others.
+
+   \param func       Functor of the ODE.
+   \param t          Time to evaluate the Jacobi matrix at.
+   \param y          State to evaluate the Jacobi matrix at.
+   \param f0         Must equal func.fun(t,y). Not used for central
+                     differences.
+   \param pattern    The sparsity pattern of the Jacobi matrix.
+   \param groups     Columns that share no rows (see colour_groups).
+   \param opts       Options (see \ref options). pattern is ignored.
+   \param fun_evals  Is increased by the number of RHS evaluations.
+
+   \returns the approximate Jacobi matrix.
+*/
+template <typename functor_type> inline
+arma::mat fd_jacobian(functor_type &func, double t, const arma::vec &y,
+                      const arma::vec &f0, const sparsity_pattern &pattern,
+                      const std::vector<std::vector<std::size_t> > &groups,
+                      const options &opts, std::size_t &fun_evals)
+{
+	std::size_t N = y.size();
+	std::size_t n_colours = groups.size();
+	assert(pattern.N == N && "Sparsity pattern has the wrong size!");
+
+	const double eps = std::numeric_limits<double>::epsilon();
+	const double rel = opts.central ? std::cbrt(eps) : std::sqrt(eps);
+	arma::vec h(N);
+	for (std::size_t j = 0; j < N; ++j) {
+		double hj = rel * std::max(std::fabs(y(j)), 1.0);
+		if (y(j) < 0) hj = -hj;
+		// Make sure y + h - y is exactly h:
+		volatile double yh = y(j) + hj;
+		h(j) = yh - y(j);
+	}
+
+	arma::mat J(N, N);
+	J.zeros();
+
+	bool parallel = opts.parallel &&
+		functor_is_thread_safe<functor_type>::value;
+#pragma omp parallel for if (parallel) schedule(dynamic)
+	for (std::size_t c = 0; c < n_colours; ++c) {
+		const std::vector<std::size_t> &cols = groups[c];
+		arma::vec yp = y;
+		for (std::size_t j : cols) yp(j) += h(j);
+		arma::vec fp = func.fun(t, yp);
+		arma::vec fm;
+		if (opts.central) {
+			arma::vec ym = y;
+			for (std::size_t j : cols) ym(j) -= h(j);
+			fm = func.fun(t, ym);
+		}
+		// Colours do not share rows, so every entry is written once:
+		for (std::size_t j : cols) {
+			for (std::size_t i : pattern.col_rows[j]) {
+				if (opts.central) {
+					J(i,j) = (fp(i) - fm(i)) / (2.0*h(j));
+				} else {
+					J(i,j) = (fp(i) - f0(i)) / h(j);
+				}
+			}
+		}
+	}
+	fun_evals += opts.central ? 2*n_colours : n_colours;
+
+	return J;
+}
+
+
+/**
+   \brief Approximates the Jacobi matrix of func.fun at (t,y) with finite
+   differences, colouring opts.pattern (or a dense pattern) first.
+
+   See the other overload for the parameters.
+*/
+template <typename functor_type> inline
+arma::mat fd_jacobian(functor_type &func, double t, const arma::vec &y,
+                      const arma::vec &f0, const options &opts,
+                      std::size_t &fun_evals)
+{
+	if (opts.pattern) {
+		return fd_jacobian(func, t, y, f0, *opts.pattern,
+		                   colour_groups(*opts.pattern), opts, fun_evals);
+	}
+	sparsity_pattern dense = dense_pattern(y.size());
+	return fd_jacobian(func, t, y, f0, dense, colour_groups(dense),
+	                   opts, fun_evals);
+}
+
+
+/**
+   \brief Approximates the Jacobi matrix of func.fun at (t,y) with complex
+   steps, perturbing the columns in each group together.
+
+   The derivative of f in direction e_j is Im(f(y + i*h*e_j)) / h up to
+   O(h^2). There is no subtraction, so h can be tiny and the result is
+   accurate to machine precision with one RHS evaluation per colour.
+   func has to implement arma::cx_vec fun(double t, const arma::cx_vec &y)
+   without taking absolute values or real parts of y along the way.
+
+   \param func       Functor of the ODE.
+   \param t          Time to evaluate the Jacobi matrix at.
+   \param y          State to evaluate the Jacobi matrix at.
+   \param pattern    The sparsity pattern of the Jacobi matrix.
+   \param groups     Columns that share no rows (see colour_groups).
+   \param opts       Options (see \ref options). Only parallel is used.
+   \param fun_evals  Is increased by the number of RHS evaluations.
+   \param h          Size of the complex step.
+
+   \returns the Jacobi matrix.
+*/
+template <typename functor_type> inline
+arma::mat cs_jacobian(functor_type &func, double t, const arma::vec &y,
+                      const sparsity_pattern &pattern,
+                      const std::vector<std::vector<std::size_t> > &groups,
+                      const options &opts, std::size_t &fun_evals,
+                      double h = 1e-20)
+{
+	std::size_t N = y.size();
+	std::size_t n_colours = groups.size();
+	assert(pattern.N == N && "Sparsity pattern has the wrong size!");
+
+	arma::cx_vec yc(N);
+	for (std::size_t j = 0; j < N; ++j) yc(j) = y(j);
+
+	arma::mat J(N, N);
+	J.zeros();
+
+	bool parallel = opts.parallel &&
+		functor_is_thread_safe<functor_type>::value;
+#pragma omp parallel for if (parallel) schedule(dynamic)
+	for (std::size_t c = 0; c < n_colours; ++c) {
+		const std::vector<std::size_t> &cols = groups[c];
+		arma::cx_vec yp = yc;
+		for (std::size_t j : cols) yp(j) = std::complex<double>(y(j), h);
+		arma::cx_vec fp = func.fun(t, yp);
+		for (std::size_t j : cols) {
+			for (std::size_t i : pattern.col_rows[j]) {
+				J(i,j) = std::imag(fp(i)) / h;
+			}
+		}
+	}
+	fun_evals += n_colours;
+
+	return J;
+}
+
+
+/**
+   \brief Wraps a functor without a jac member so that it has one, which
+   uses fd_jacobian, or cs_jacobian if the functor can evaluate its RHS for
+   complex y and options::complex_step is set.
+
+   fun_stages and thread-safety are passed on from the wrapped functor.
+*/
+template <typename functor_type>
+struct fd_functor
+{
+	typedef arma::mat jac_type;
+
+	static constexpr bool thread_safe =
+		functor_is_thread_safe<functor_type>::value;
+
+	fd_functor(functor_type &func, const options &opts)
+		: func(func), opts(opts), fun_evals(0), have_pattern(false) {}
+
+	arma::vec fun(double t, const arma::vec &y)
+	{
+		return func.fun(t, y);
+	}
+
+	jac_type jac(double t, const arma::vec &y)
+	{
+		// The pattern and its colouring are set up once:
+		if (!have_pattern) {
+			if (opts.pattern) {
+				pattern = *opts.pattern;
+			} else if (opts.detect_pattern) {
+				pattern = detect_pattern(func, t, y, fun_evals);
+			} else {
+				pattern = dense_pattern(y.size());
+			}
+			groups = colour_groups(pattern);
+			have_pattern = true;
+		}
+
+		return approx_jac(t, y, std::integral_constant<bool,
+		                  functor_has_complex_fun<functor_type>::value>());
+	}
+
+	template <typename F = functor_type>
+	auto fun_stages(const arma::vec &t, const arma::mat &Y, arma::mat &FY)
+		-> decltype(std::declval<F&>().fun_stages(t, Y, FY))
+	{
+		return func.fun_stages(t, Y, FY);
+	}
+
+	jac_type approx_jac(double t, const arma::vec &y, std::true_type)
+	{
+		if (opts.complex_step) {
+			return cs_jacobian(func, t, y, pattern, groups, opts,
+			                   fun_evals);
+		}
+		return approx_jac(t, y, std::false_type());
+	}
+
+	jac_type approx_jac(double t, const arma::vec &y, std::false_type)
+	{
+		arma::vec f0;
+		if (!opts.central) {
+			f0 = func.fun(t, y);
+			++fun_evals;
+		}
+		return fd_jacobian(func, t, y, f0, pattern, groups, opts,
+		                   fun_evals);
+	}
+
+	functor_type &func;
+	const options &opts;
+
+	/// Number of RHS evaluations done for the Jacobi matrices.
+	std::size_t fun_evals;
+
+	/// The sparsity pattern used, set up by the first call to jac.
+	sparsity_pattern pattern;
+	std::vector<std::vector<std::size_t> > groups;
+	bool have_pattern;
+};
+
+
+} // namespace jacobian
+
+
+#endif // JACOBIAN_HPP
@@ -30,8 +30,14 @@
 #include "my_timer.hpp"
 
 #include "arma_include.hpp"
+#include "dense_lu.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
 #include <iomanip>
 #include <fstream>
+#include <utility>
+#include <vector>
 
 typedef arma::vec vec_type;
 typedef arma::mat mat_type;
@@ -51,13 +57,23 @@ enum newton_solve_ret_codes {
 };
 
 
+/// \brief Ways to safeguard Newton steps far from the root.
+enum globalisations {
+	NO_GLOBALISATION = 0,  ///< Always take the (damped) Newton step
+	LINE_SEARCH,           ///< Backtrack along the step (Armijo)
+	TRUST_REGION           ///< Dogleg steps in a trust region
+};
+
+
 /**
    \brief contains options for the solver.
 */
 struct options {
 	options() : tol(1e-4), dx_delta(1e-4), maxit(500),
 	            time_internals(false), max_step(-1), refresh_jac(10),
-	            precondition(false), limit_step(false) {}
+	            precondition(false), limit_step(false),
+	            globalisation(NO_GLOBALISATION), armijo_c(1e-4),
+	            trust_radius(-1), broyden_memory(20), anderson_memory(5) {}
 
 	double tol;           ///< Desired tolerance.
 	double dx_delta;      ///< Terminate if the increment is below this.
@@ -75,19 +91,45 @@ struct options {
 
 	/// If true, tries to limit the step to two extremes.
 	bool limit_step;
+
+	/// Safeguard for steps far from the root (see \ref globalisations).
+	/// Newton iteration then only accepts steps that decrease |F(x)|^2.
+	int globalisation;
+
+	/// Sufficient decrease parameter of the line search.
+	double armijo_c;
+
+	/// Initial radius of the trust region. If not positive, it is the
+	/// length of the first Newton step.
+	double trust_radius;
+
+	/// Number of steps kept by limited-memory Broyden iteration (see
+	/// limited_broyden).
+	int broyden_memory;
+
+	/// Number of earlier iterates mixed in by Anderson-accelerated
+	/// fixed-point iteration (see irk::anderson_solve_stages).
+	int anderson_memory;
 };
 
 /**
    \brief contains status for the solver.
 */
 struct status {
-	status() : conv_status(SUCCESS), res(0.0), iters(0), eta_final(0.0){}
+	status() : conv_status(SUCCESS), res(0.0), iters(0), eta_final(0.0),
+	           contraction(0.0), lu_decomps(0), backtracks(0),
+	           rejected_steps(0), trust_radius(0.0){}
 
 
 	int conv_status;  ///< Status code, see \ref newton_solve_ret_codes
 	double res;       ///< Final residual (F(x_root)^2)
 	int iters;        ///< Number of iterations actually used
 	double eta_final; ///< Last value of eta_k
+	double contraction; ///< Last contraction rate |dx_k| / |dx_{k-1}|
+	int lu_decomps;     ///< Number of LU decompositions of the Jacobi matrix
+	int backtracks;     ///< Number of step reductions in the line search
+	int rejected_steps; ///< Number of steps rejected by the trust region
+	double trust_radius; ///< Final radius of the trust region
 };
 
 
@@ -145,6 +187,15 @@ struct newton_functor_wrapper
 		return func.jac( t, Y );
 	}
 
+	/// Only exists if the wrapped functor can evaluate its RHS for
+	/// complex y (see complex_step_jacobi_matrix).
+	template <typename F = functor_type>
+	auto fun( const arma::cx_vec &Y )
+		-> decltype( std::declval<F&>().fun( 0.0, Y ) )
+	{
+		return func.fun( t, Y );
+	}
+
 	functor_type &func;
 	double t;
 };
@@ -182,6 +233,9 @@ std::string to_fixed_w_string( T t, std::size_t wide, char c = ' ' )
     \param y    Point about which to approximate Jacobi matrix
     \param fun  Function to determine Jacobi matrix for
     \param h    Finite difference step size.
+
+    \note For the Jacobi matrix of an ODE RHS, jacobian::fd_jacobian
+          is cheaper, especially for sparse matrices.
 */
 template <typename functor_type> inline
 mat_type approx_jacobi_matrix( const vec_type &y, functor_type &func,
@@ -202,12 +256,7 @@ mat_type approx_jacobi_matrix( const vec_type &y, functor_type &func,
 		vec_type fp = func.fun( new_yp );
 		vec_type fm = func.fun( new_ym );
 
-		vec_type delta = fp - fm;
-		delta /= (2.0*h);
-
-		for( std::size_t i = 0; i < N; ++i ){
-			J_approx(i,j) = delta(i);
-		}
+		J_approx.col(j) = (fp - fm) / (2.0*h);
 
 
 		new_yp(j) = old_y_j;
@@ -217,6 +266,45 @@ mat_type approx_jacobi_matrix( const vec_type &y, functor_type &func,
 	return J_approx;
 }
 
+/**
+    \brief Approximates the Jacobi matrix with complex steps.
+
+    The derivative of fun in direction e_j is Im(fun(y + i*h*e_j)) / h up
+    to O(h^2). Unlike finite differences there is no cancellation, so h
+    can be tiny and the Jacobi matrix is accurate to machine precision,
+    with N instead of 2N evaluations of fun.
+
+    \param y    Point about which to approximate Jacobi matrix
+    \param fun  Function to determine Jacobi matrix for. It has to
+                implement arma::cx_vec fun(const arma::cx_vec &y).
+    \param h    Size of the complex step.
+
+    \note For the Jacobi matrix of an ODE RHS, jacobian::cs_jacobian
+          is cheaper for sparse matrices.
+*/
+template <typename functor_type> inline
+mat_type complex_step_jacobi_matrix( const vec_type &y, functor_type &func,
+                                     double h = 1e-20 )
+{
+	std::size_t N = y.size();
+	mat_type J_approx;
+	J_approx.zeros(N,N);
+	arma::cx_vec new_y(N);
+	for( std::size_t j = 0; j < N; ++j ){
+		new_y(j) = y(j);
+	}
+
+	for( std::size_t j = 0; j < N; ++j ){
+		new_y(j) = std::complex<double>( y(j), h );
+		arma::cx_vec fp = func.fun( new_y );
+		for( std::size_t i = 0; i < N; ++i ){
+			J_approx(i,j) = std::imag( fp(i) ) / h;
+		}
+		new_y(j) = y(j);
+	}
+	return J_approx;
+}
+
 /**
     \brief Verifies that the function jac produces accurate Jacobi matrix at y.
 
@@ -349,6 +437,159 @@ vec_type broyden_iterate( functor_type &func, vec_type x,
 }
 
 
+/**
+   \brief Limited-memory form of Broyden's (good) method.
+
+   Instead of the dense N x N inverse Jacobi matrix of broyden_iterate,
+   this keeps only the last steps, which takes O(memory*N) storage. The
+   inverse satisfies H_{n+1} = (I + s_{n+1}*s_n^T / |s_n|^2) H_n for full
+   steps s_n (Kelley, 1995, ch. 7), so the next step follows from H_0 and
+   the stored steps alone. H_0 is applied by the caller, which makes it
+   cheap to start from, e.g., an old LU decomposition of the Jacobi matrix.
+
+   When the memory is full, the method restarts from H_0.
+*/
+struct limited_broyden
+{
+	explicit limited_broyden( std::size_t memory ) : memory(memory) {}
+
+	/// Forgets all steps, so that the next step is from H_0 again.
+	void reset()
+	{
+		steps.clear();
+		norms2.clear();
+	}
+
+	/**
+	   \brief Computes the next step.
+
+	   \param z  Must be -H_0*F(x_n), with x_n the current iterate,
+	             which was reached with the full previous step.
+
+	   \returns the step s_n = -H_n*F(x_n).
+	*/
+	vec_type next_step( vec_type z )
+	{
+		if( steps.size() >= memory ) reset();
+
+		if( !steps.empty() ){
+			vec_type z0 = z;
+			std::size_t n = steps.size();
+			for( std::size_t j = 0; j + 1 < n; ++j ){
+				z += steps[j+1] * ( dot( steps[j], z ) / norms2[j] );
+			}
+			double denom = 1.0 - dot( steps[n-1], z ) / norms2[n-1];
+			if( std::fabs( denom ) > 1e-8 ){
+				z /= denom;
+			}else{
+				// The update is degenerate, start over:
+				reset();
+				return next_step( z0 );
+			}
+		}
+		double z2 = dot( z, z );
+		if( z2 > 0 ){
+			steps.push_back( z );
+			norms2.push_back( z2 );
+		}
+		return z;
+	}
+
+	std::size_t memory;            ///< Maximum number of steps to keep
+	std::vector<vec_type> steps;   ///< Previous steps s_0, s_1, ...
+	std::vector<double> norms2;    ///< |s_j|^2
+};
+
+
+/**
+   \brief Backtracks along the Newton step until |F|^2 decreases enough.
+
+   Finds lambda such that phi(x + lambda*dx) <= phi(x) + c*lambda*slope,
+   with phi = |F|^2 / 2 and slope = F^T J dx its directional derivative,
+   by minimising a quadratic model of phi along dx.
+
+   \param func    The functor whose root is to be found
+   \param x       Current iterate
+   \param r       F(x)
+   \param dx      Newton step
+   \param slope   Directional derivative of phi along dx, has to be < 0.
+   \param c       Sufficient decrease parameter
+   \param r_new   Will contain F(x + lambda*dx)
+   \param stats   Counts the backtracks
+
+   \returns lambda.
+*/
+template <typename functor_type> inline
+double armijo_backtrack( functor_type &func, const vec_type &x,
+                         const vec_type &r, const vec_type &dx,
+                         double slope, double c, vec_type &r_new,
+                         status &stats )
+{
+	double phi0 = 0.5*dot( r, r );
+	double lambda = 1.0;
+	while( true ){
+		r_new = func.fun( x + lambda*dx );
+		double phi = 0.5*dot( r_new, r_new );
+		if( (std::isfinite( phi ) && phi <= phi0 + c*lambda*slope)
+		    || lambda < 1e-4 ){
+			return lambda;
+		}
+
+		// Minimiser of the quadratic through phi0, slope and phi,
+		// kept within [0.1,0.5]*lambda:
+		double lambda_q = std::isfinite( phi ) ?
+			-0.5*slope*lambda*lambda / (phi - phi0 - slope*lambda)
+			: 0.1*lambda;
+		lambda = std::min( std::max( lambda_q, 0.1*lambda ), 0.5*lambda );
+		++stats.backtracks;
+	}
+}
+
+
+/**
+   \brief Computes the dogleg step in a trust region of radius delta.
+
+   The step follows the steepest descent direction of |F|^2 up to the
+   Cauchy point and then turns to the Newton step, cut off at the
+   trust region boundary.
+
+   \param J       Jacobi matrix at the current iterate
+   \param r       F at the current iterate
+   \param dx      Newton step
+   \param delta   Radius of the trust region
+
+   \returns the dogleg step.
+*/
+template <typename jac_type> inline
+vec_type dogleg_step( const jac_type &J, const vec_type &r,
+                      const vec_type &dx, double delta )
+{
+	double dx_norm = arma::norm( dx );
+	if( dx_norm <= delta ) return dx;
+
+	vec_type g = J.t() * r;
+	vec_type Jg = J * g;
+	double g_norm = arma::norm( g );
+	double Jg2 = dot( Jg, Jg );
+	if( Jg2 == 0.0 || g_norm == 0.0 ){
+		return dx * (delta / dx_norm);
+	}
+	vec_type d_sd = -(g_norm*g_norm / Jg2) * g;
+	double sd_norm = arma::norm( d_sd );
+	if( sd_norm >= delta ){
+		return d_sd * (delta / sd_norm);
+	}
+
+	// Solve |d_sd + tau*(dx - d_sd)| = delta for tau in [0,1]:
+	vec_type diff = dx - d_sd;
+	double a = dot( diff, diff );
+	double b = 2.0*dot( d_sd, diff );
+	double c = sd_norm*sd_norm - delta*delta;
+	double tau = (-b + std::sqrt( b*b - 4.0*a*c )) / (2.0*a);
+	return d_sd + tau*diff;
+}
+
+
 /**
    \brief Templated implementation of Newton's method.
 
@@ -366,6 +607,7 @@ vec_type newton_iterate_impl( functor_type &func, vec_type x,
 {
 	stats.conv_status = SUCCESS;
 	stats.iters = 0;
+	stats.lu_decomps = 0;
 	vec_type r = func.fun(x);
 	double res2 = dot( r, r );
 
@@ -376,15 +618,24 @@ vec_type newton_iterate_impl( functor_type &func, vec_type x,
 
 	vec_type direction;
 
-	typename functor_type::jac_type L(N, N), U(N,N);
+	// J only changes if it is refreshed, so its LU decomposition is
+	// kept until then instead of redone in every iteration:
+	dense_lu<double> lu;
+	bool factorised = false;
 
 	double max_step2;
 	if( opts.max_step > 0 ) max_step2 = opts.max_step*opts.max_step;
 	else max_step2 = -1;
 
 	auto J = func.jac(x);
-	typename functor_type::jac_type P;
-	P.eye(N,N);
+	// Diagonal (Jacobi) preconditioner:
+	vec_type P;
+	P.ones(N);
+
+	stats.backtracks = 0;
+	stats.rejected_steps = 0;
+	stats.trust_radius = opts.trust_radius;
+	vec_type r_new;
 
 	double incr1 = 0;
 	double incr0 = 0;
@@ -422,19 +673,26 @@ vec_type newton_iterate_impl( functor_type &func, vec_type x,
 		}
 
 		try{
-			if( precondition ){
-				for( std::size_t i = 0; i < N; ++i ){
-					if( J(i,i) != 0.0 ){
-						P(i,i) = 1.0 / J(i,i);
-					}else{
-						P(i,i) = 1.0;
+			if( !factorised ){
+				mat_type M = J;
+				if( precondition ){
+					for( std::size_t i = 0; i < N; ++i ){
+						P(i) = J(i,i) != 0.0 ? 1.0 / J(i,i) : 1.0;
+						for( std::size_t j = 0; j < N; ++j ){
+							M(i,j) *= P(i);
+						}
 					}
 				}
-				direction = -arma::solve(P*J, P*r);
-
-			}else{
-				direction = -arma::solve(J,r);
+				if( !lu.factor( M ) ){
+					stats.conv_status = GENERIC_ERROR;
+					std::cerr << "Newton failed to decompose Jacobi matrix!\n";
+					return x;
+				}
+				factorised = true;
+				++stats.lu_decomps;
 			}
+			direction = precondition ? vec_type(-P % r) : vec_type(-r);
+			lu.solve( direction );
 		}catch( std::exception &e ){
 			stats.conv_status = GENERIC_ERROR;
 			std::cerr << "Newton caught generic error!\n";
@@ -449,13 +707,53 @@ vec_type newton_iterate_impl( functor_type &func, vec_type x,
 			}
 		}
 
-		xn = x0 + lambda*direction;
-		if( refresh_jac ){
-			J = func.jac(xn);
+		bool have_r_new = false;
+		bool accept = true;
+		vec_type step = lambda*direction;
+		if( opts.globalisation == LINE_SEARCH ){
+			// Only backtrack along descent directions, which a
+			// frozen Jacobi matrix does not guarantee:
+			double slope = lambda*dot( r, J*direction );
+			if( slope < 0 ){
+				step *= armijo_backtrack( func, x0, r, step, slope,
+				                          opts.armijo_c, r_new, stats );
+				have_r_new = true;
+			}
+		}else if( opts.globalisation == TRUST_REGION ){
+			if( stats.trust_radius <= 0 ){
+				stats.trust_radius = arma::norm( step );
+			}
+			step = dogleg_step( J, r, step, stats.trust_radius );
+			r_new = func.fun( x0 + step );
+			have_r_new = true;
+
+			vec_type r_model = r + J*step;
+			double pred = res2 - dot( r_model, r_model );
+			double actual = res2 - dot( r_new, r_new );
+			double rho = pred > 0 && std::isfinite( actual ) ?
+				actual / pred : -1.0;
+			double step_norm = arma::norm( step );
+			if( rho < 0.25 ){
+				stats.trust_radius = 0.25*step_norm;
+			}else if( rho > 0.75 &&
+			          step_norm > 0.99*stats.trust_radius ){
+				stats.trust_radius *= 2.0;
+			}
+			// A rejected step keeps x and J, so the LU
+			// decomposition is reused for the next try:
+			accept = rho > 1e-4;
+			if( !accept ) ++stats.rejected_steps;
 		}
 
-		r = func.fun(xn);
-		res2 = dot( r, r );
+		if( accept ){
+			xn = x0 + step;
+			if( refresh_jac ){
+				J = func.jac(xn);
+				factorised = false;
+			}
+			r = have_r_new ? r_new : vec_type(func.fun(xn));
+			res2 = dot( r, r );
+		}
 
 		f0 = r;
 		x0 = xn;
@@ -27,7 +27,10 @@
 #ifndef OPTIONS_HPP
 #define OPTIONS_HPP
 
+#include <algorithm>
+#include <cstddef>
 #include <iosfwd>
+#include <vector>
 
 
 namespace newton {
@@ -42,7 +45,18 @@ struct common_solver_options
 	/// \brief Enumerates the possible internal non-linear solvers
 	enum internal_solvers {
 		BROYDEN = 0, ///< Broyden's method
-		NEWTON = 1   ///< Newton's method
+		NEWTON = 1,  ///< Newton's method
+		PIRK = 2,    ///< Parallel iteration (implicit methods only)
+		ANDERSON = 3 ///< Accelerated fixed point (implicit methods only)
+	};
+
+	/// \brief Enumerates the possible time step size controllers.
+	enum step_controllers {
+		DEFAULT_CONTROLLER = -1, ///< Let the integrator pick one
+		I_CONTROLLER = 0,        ///< Elementary (integral) controller
+		PI_GUSTAFSSON = 1,       ///< Gustafsson's PI controller (1991)
+		PREDICTIVE_GUSTAFSSON = 2, ///< Gustafsson's predictive controller
+		H211B = 3                ///< Soederlind's H211b digital filter
 	};
 
 	/// \brief Constructor with default values.
@@ -54,20 +68,46 @@ struct common_solver_options
 		  max_steps(-1),
 		  newton_opts(nullptr),
 		  out_interval(0),
-		  time_internals(false)
+		  time_internals(false),
+		  step_controller(DEFAULT_CONTROLLER),
+		  quiet(false)
 	{ }
 
 	~common_solver_options()
 	{ }
 
+	/// Absolute tolerance of component i. See abs_tols_match.
+	double abs_tol_of(std::size_t i) const
+	{
+		return abs_tols.empty() ? abs_tol : abs_tols[i];
+	}
+
+	/// Smallest absolute tolerance of all components.
+	double min_abs_tol() const
+	{
+		if (abs_tols.empty()) return abs_tol;
+		return *std::min_element(abs_tols.begin(), abs_tols.end());
+	}
+
+	/// Whether abs_tols is empty or has one entry for each of Neq
+	/// equations. The integrators check this before they start.
+	bool abs_tols_match(std::size_t Neq) const
+	{
+		return abs_tols.empty() || abs_tols.size() == Neq;
+	}
+
 	/// Internal non-linear solver used (see \ref internal_solvers)
-	/// Broyden typically gives good results in less time.
+	/// Broyden needs fewer Jacobi matrices, which helps if they are
+	/// expensive, but typically more iterations.
 	int internal_solver;
 
 	/// Relative tolerance to satisfy when adaptive time stepping
 	double rel_tol;
 	/// Absolute tolerance to satisfy when adaptive time stepping
 	double abs_tol;
+	/// Absolute tolerance per component. If not empty, this replaces
+	/// abs_tol and needs one entry per equation.
+	std::vector<double> abs_tols;
 	/// Maximum time step size
 	double max_dt;
 
@@ -82,6 +122,15 @@ struct common_solver_options
 
 	/// Keep track of the timings of various parts in solver?
 	bool time_internals;
+
+	/// Time step size controller (see \ref step_controllers).
+	/// By default, explicit methods use PI_GUSTAFSSON and implicit
+	/// methods use PREDICTIVE_GUSTAFSSON.
+	int step_controller;
+
+	/// If true, do not print informational messages and warnings to
+	/// std::cerr. Output requested with out_interval is still printed.
+	bool quiet;
 };
 
 
@@ -0,0 +1,394 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file parareal.hpp
+
+   \brief Contains a parallel-in-time (Parareal) integrator.
+*/
+
+#ifndef PARAREAL_HPP
+#define PARAREAL_HPP
+
+#include <cmath>
+#include <vector>
+
+#include "enums.hpp"
+#include "ensemble.hpp"
+#include "erk.hpp"
+#include "irk.hpp"
+#include "my_timer.hpp"
+#include "newton.hpp"
+#include "options.hpp"
+#include "output.hpp"
+
+
+/**
+   \brief Contains the Parareal integrator of Lions, Maday & Turinici (2001).
+
+   The interval is split into time slices. A cheap coarse propagator G
+   sweeps over the slices serially, while an accurate fine propagator F
+   integrates all slices in parallel, starting from the current guesses at
+   the slice boundaries. These are corrected with
+   U_k <- G(U_{k-1}) + F(U_{k-1}^old) - G(U_{k-1}^old)
+   until they no longer change. After iteration i, the first i slices are
+   exact, so this converges in at most as many iterations as there are
+   slices, but the speed-up comes from converging in far fewer.
+*/
+namespace parareal {
+
+typedef arma::vec vec_type;
+
+
+/**
+   \brief options for the Parareal integrator.
+*/
+struct solver_options : common_solver_options {
+
+	/// \brief Constructor with default values.
+	solver_options() : coarse_method(irk::IMPLICIT_EULER),
+	                   fine_method(irk::RADAU_IIA_53),
+	                   coarse_steps(1),
+	                   coarse_tol(0.0),
+	                   n_slices(0),
+	                   n_threads(0),
+	                   max_iter(-1)
+	{ }
+
+	~solver_options()
+	{ }
+
+	/// Method of the coarse propagator, used with a constant time step.
+	/// Can be an explicit or implicit method.
+	int coarse_method;
+
+	/// Method of the fine propagator, used with an adaptive time step
+	/// with the tolerances of these options. Can be an explicit or
+	/// implicit method.
+	int fine_method;
+
+	/// Number of coarse time steps per slice.
+	int coarse_steps;
+
+	/// If > 0, the coarse propagator adapts its time step to satisfy
+	/// this (loose) tolerance, starting from the coarse_steps step size.
+	/// This is more robust if the constant step makes Newton fail.
+	double coarse_tol;
+
+	/// Number of time slices. If <= 0, use one per thread.
+	int n_slices;
+
+	/// Number of threads to use. If <= 0, use all hardware threads.
+	int n_threads;
+
+	/// Maximum number of iterations. If negative, n_slices, after which
+	/// the solution is the same as that of the fine propagator alone.
+	int max_iter;
+};
+
+
+/**
+   \brief The output of the Parareal integrator.
+
+   t_vals and y_vals contain the fine solutions of all slices.
+*/
+struct parareal_output : basic_output
+{
+	struct counters {
+		counters() : fine_solves(0), coarse_solves(0),
+		             fun_evals(0), jac_evals(0) {}
+
+		std::size_t fine_solves, coarse_solves;
+		std::size_t fun_evals, jac_evals;
+	};
+
+	/// Number of Parareal iterations performed.
+	int iterations;
+
+	/// Boundaries of the time slices.
+	std::vector<double> slice_times;
+
+	/// Solution at the slice boundaries.
+	std::vector<vec_type> slice_y;
+
+	/// Scaled change of the slice boundary values in every iteration.
+	std::vector<double> corrections;
+
+	/// Wall time of the whole integration (ms).
+	double elapsed_time;
+
+	/// Sum of the wall times of the last fine solve of each slice, which
+	/// estimates the time a serial fine integration would take (ms).
+	double serial_time;
+
+	/// serial_time / elapsed_time.
+	double speedup;
+
+	counters count;
+};
+
+
+/**
+   \brief The result of propagating over one slice.
+*/
+struct slice_output
+{
+	int status;
+	vec_type y;
+	/// The time step size the fine propagator would attempt next.
+	double next_dt;
+	double elapsed_time;
+	std::size_t fun_evals, jac_evals;
+	basic_output sol;
+};
+
+
+/**
+   \brief Integrates from ta to tb with method, which can be explicit or
+   implicit.
+
+   \param adaptive  If false, take constant steps of size dt.
+   \param keep      If true, keep the full solution in out.sol.
+*/
+template <typename functor_type> inline
+slice_output propagate(functor_type &func, int method, double ta, double tb,
+                       const vec_type &y, const common_solver_options &opts,
+                       double dt, bool adaptive, bool keep)
+{
+	my_timer timer;
+	slice_output out;
+
+	newton::options n_opts;
+	n_opts.tol = 0.1*std::min(opts.min_abs_tol(), opts.rel_tol);
+
+	if (erk::rk_method_to_string.count(method)) {
+		erk::solver_options e_opts;
+		static_cast<common_solver_options&>(e_opts) = opts;
+		e_opts.quiet = true;
+		e_opts.adaptive_step_size = adaptive;
+		erk::rk_output part = erk::odeint(func, ta, tb, y, e_opts,
+		                                  method, dt);
+		out.status    = part.status;
+		out.next_dt   = part.next_dt;
+		out.fun_evals = part.count.fun_evals;
+		out.jac_evals = 0;
+		out.y = part.y_vals.back();
+		if (keep) out.sol = part;
+	} else {
+		irk::solver_options i_opts;
+		static_cast<common_solver_options&>(i_opts) = opts;
+		if (!i_opts.newton_opts) i_opts.newton_opts = &n_opts;
+		i_opts.quiet = true;
+		i_opts.adaptive_step_size = adaptive;
+		irk::rk_output part = irk::odeint(func, ta, tb, y, i_opts,
+		                                  method, dt);
+		out.status    = part.status;
+		out.next_dt   = part.next_dt;
+		out.fun_evals = part.count.fun_evals;
+		out.jac_evals = part.count.jac_evals;
+		out.y = part.y_vals.back();
+		if (keep) out.sol = part;
+	}
+	out.elapsed_time = timer.toc();
+	return out;
+}
+
+
+/**
+   \brief Time-integrate a given ODE from t0 to t1, starting at y0, with
+   Parareal.
+
+   \param func         Functor of the ODE to integrate. Has to be copyable,
+                       since every thread uses its own copy.
+   \param t0           Starting time
+   \param t1           Final time
+   \param y0           Initial values
+   \param solver_opts  Options for the integrator.
+
+   \returns a struct with the solution and statistics.
+*/
+template <typename functor_type> inline
+parareal_output odeint(const functor_type &func, double t0, double t1,
+                       const vec_type &y0, const solver_options &solver_opts)
+{
+	my_timer timer;
+	parareal_output out;
+	out.status = SUCCESS;
+	out.iterations = 0;
+	if (!solver_opts.abs_tols_match(y0.size())) {
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: abs_tols needs one entry per "
+			          << "equation!\n";
+		}
+		out.status = GENERAL_ERROR;
+		return out;
+	}
+
+	ensemble::solver_options pool_opts;
+	pool_opts.n_threads = solver_opts.n_threads;
+	std::size_t n_threads = ensemble::pool_size(pool_opts, 1 << 30);
+	std::size_t K = solver_opts.n_slices > 0 ? solver_opts.n_slices
+	                                         : n_threads;
+	n_threads = std::min(n_threads, K);
+	int max_iter = solver_opts.max_iter >= 0 ? solver_opts.max_iter : K;
+
+	for (std::size_t k = 0; k <= K; ++k) {
+		out.slice_times.push_back(t0 + (t1 - t0)*k / K);
+	}
+	out.slice_times.back() = t1;
+	const std::vector<double> &T = out.slice_times;
+
+	functor_type f_coarse = func;
+	auto coarse = [&](std::size_t k, const vec_type &y) {
+		double dt = (T[k+1] - T[k]) / std::max(1, solver_opts.coarse_steps);
+		bool adaptive = solver_opts.coarse_tol > 0;
+		common_solver_options g_opts = solver_opts;
+		if (adaptive) {
+			g_opts.abs_tol = g_opts.rel_tol = solver_opts.coarse_tol;
+			g_opts.abs_tols.clear();
+		}
+		slice_output g = propagate(f_coarse, solver_opts.coarse_method,
+		                           T[k], T[k+1], y, g_opts, dt,
+		                           adaptive, false);
+		++out.count.coarse_solves;
+		out.count.fun_evals += g.fun_evals;
+		out.count.jac_evals += g.jac_evals;
+		if (g.status != SUCCESS) {
+			if (!solver_opts.quiet) {
+				std::cerr << "    Rehuel: Coarse propagator failed on "
+				          << "slice " << k << "! Increase coarse_steps "
+				          << "or set coarse_tol.\n";
+			}
+			out.status = g.status;
+		}
+		return g.y;
+	};
+
+	// The initial guess comes from one coarse sweep:
+	std::vector<vec_type> U(K+1), G(K);
+	U[0] = y0;
+	for (std::size_t k = 0; k < K && out.status == SUCCESS; ++k) {
+		G[k] = coarse(k, U[k]);
+		U[k+1] = G[k];
+	}
+
+	// The fine solve of each slice, and the dt it would take next, which
+	// is a good initial dt for the next fine solve of that slice:
+	std::vector<slice_output> fine(K);
+	std::vector<double> fine_dt(K, 0.0);
+
+	const double rtol = solver_opts.rel_tol;
+	bool converged = false;
+
+	// After iteration i, the first i slices are exact:
+	for (int it = 0; it < max_iter && out.status == SUCCESS; ++it) {
+		std::size_t first = it;
+		std::size_t n_todo = K - first;
+		if (n_todo == 0) break;
+
+		ensemble::work_queues work(n_todo, std::min(n_threads, n_todo));
+		std::vector<int> statuses(n_todo, SUCCESS);
+		ensemble::run_pool(std::min(n_threads, n_todo),
+			[&](std::size_t q) {
+				functor_type f = func;
+				std::size_t i = 0;
+				bool stolen = false;
+				while (work.next(q, i, stolen)) {
+					std::size_t k = first + i;
+					fine[k] = propagate(f, solver_opts.fine_method,
+					                    T[k], T[k+1], U[k],
+					                    solver_opts, fine_dt[k],
+					                    true, true);
+					fine_dt[k] = fine[k].next_dt;
+				}
+			});
+		for (std::size_t k = first; k < K; ++k) {
+			++out.count.fine_solves;
+			out.count.fun_evals += fine[k].fun_evals;
+			out.count.jac_evals += fine[k].jac_evals;
+			if (fine[k].status != SUCCESS) out.status = fine[k].status;
+		}
+		if (out.status != SUCCESS) break;
+		++out.iterations;
+
+		// Serial correction sweep. Slice first starts from an exact
+		// value, so its fine solution is exact too:
+		double change = 0.0;
+		U[first+1] = fine[first].y;
+		for (std::size_t k = first + 1; k < K; ++k) {
+			vec_type G_new = coarse(k, U[k]);
+			if (out.status != SUCCESS) break;
+			vec_type U_new = G_new + fine[k].y - G[k];
+			G[k] = G_new;
+
+			double err = 0.0;
+			for (std::size_t n = 0; n < U_new.size(); ++n) {
+				const double atol = solver_opts.abs_tol_of(n);
+				double sc = atol + rtol*std::fabs(U_new(n));
+				double e  = (U_new(n) - U[k+1](n)) / sc;
+				err += e*e;
+			}
+			change = std::max(change, std::sqrt(err / U_new.size()));
+			U[k+1] = U_new;
+		}
+		out.corrections.push_back(change);
+
+		if (change <= 1.0) {
+			converged = true;
+			break;
+		}
+	}
+
+	if (out.status == SUCCESS && !converged && out.iterations < (int)K) {
+		if (!solver_opts.quiet) {
+			std::cerr << "    Rehuel: Parareal did not converge in "
+			          << out.iterations << " iterations!\n";
+		}
+		out.status = GENERAL_ERROR;
+	}
+
+	out.slice_y = U;
+	out.serial_time = 0.0;
+	for (std::size_t k = 0; k < K; ++k) {
+		out.serial_time += fine[k].elapsed_time;
+		const basic_output &s = fine[k].sol;
+		for (std::size_t i = 0; i < s.t_vals.size(); ++i) {
+			// Do not repeat the slice boundaries:
+			if (!out.t_vals.empty() && s.t_vals[i] <= out.t_vals.back()) {
+				continue;
+			}
+			out.t_vals.push_back(s.t_vals[i]);
+			out.y_vals.push_back(s.y_vals[i]);
+		}
+	}
+	// The corrected value is more accurate than the last fine solve:
+	if (!out.y_vals.empty()) out.y_vals.back() = U[K];
+
+	out.elapsed_time = timer.toc();
+	out.speedup = out.elapsed_time > 0 ?
+		out.serial_time / out.elapsed_time : 0.0;
+	return out;
+}
+
+
+} // namespace parareal
+
+
+#endif // PARAREAL_HPP
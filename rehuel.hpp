@@ -30,6 +30,9 @@
 #include "enums.hpp"
 #include "irk.hpp"
 #include "erk.hpp"
+#include "auto_switch.hpp"
+#include "ensemble.hpp"
+#include "parareal.hpp"
 
 
 #endif // REHUEL_HPP
@@ -0,0 +1,268 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file small_lu.hpp
+
+   \brief LU decomposition for small matrices whose size is known at
+   compile time.
+
+   All storage is on the stack and all loop bounds are constants, so the
+   compiler can unroll the factorisation and the solves completely. This
+   avoids the overhead of LAPACK calls and heap allocations, which
+   dominates for systems of a handful of equations.
+*/
+
+#ifndef SMALL_LU_HPP
+#define SMALL_LU_HPP
+
+#include <cmath>
+#include <cstddef>
+
+
+/**
+   \brief LU decomposition with partial pivoting of an N x N matrix.
+
+   Matrices are stored column-major, like in Armadillo.
+*/
+template <std::size_t N>
+struct small_lu
+{
+	/**
+	   \brief Factorises the matrix M.
+
+	   \param M  Pointer to N*N doubles in column-major order.
+
+	   \returns false if M is singular.
+	*/
+	bool factor(const double *M)
+	{
+		for (std::size_t k = 0; k < N*N; ++k) LU[k] = M[k];
+
+		for (std::size_t k = 0; k < N; ++k) {
+			// Find the pivot:
+			std::size_t p = k;
+			double max_val = std::fabs(LU[k + k*N]);
+			for (std::size_t i = k+1; i < N; ++i) {
+				double v = std::fabs(LU[i + k*N]);
+				if (v > max_val) {
+					max_val = v;
+					p = i;
+				}
+			}
+			piv[k] = p;
+			if (max_val == 0.0) return false;
+
+			if (p != k) {
+				for (std::size_t j = 0; j < N; ++j) {
+					double tmp = LU[k + j*N];
+					LU[k + j*N] = LU[p + j*N];
+					LU[p + j*N] = tmp;
+				}
+			}
+
+			double inv_pivot = 1.0 / LU[k + k*N];
+			for (std::size_t i = k+1; i < N; ++i) {
+				LU[i + k*N] *= inv_pivot;
+			}
+			for (std::size_t j = k+1; j < N; ++j) {
+				double ukj = LU[k + j*N];
+				for (std::size_t i = k+1; i < N; ++i) {
+					LU[i + j*N] -= LU[i + k*N] * ukj;
+				}
+			}
+		}
+		return true;
+	}
+
+	/**
+	   \brief Solves M x = b in place.
+
+	   \param b  Pointer to N doubles. Will contain x.
+	*/
+	void solve(double *b) const
+	{
+		for (std::size_t k = 0; k < N; ++k) {
+			std::size_t p = piv[k];
+			if (p != k) {
+				double tmp = b[k];
+				b[k] = b[p];
+				b[p] = tmp;
+			}
+		}
+		// Forward substitution with unit lower triangle:
+		for (std::size_t j = 0; j < N; ++j) {
+			double bj = b[j];
+			for (std::size_t i = j+1; i < N; ++i) {
+				b[i] -= LU[i + j*N] * bj;
+			}
+		}
+		// Back substitution:
+		for (std::size_t jj = N; jj > 0; --jj) {
+			std::size_t j = jj - 1;
+			b[j] /= LU[j + j*N];
+			double bj = b[j];
+			for (std::size_t i = 0; i < j; ++i) {
+				b[i] -= LU[i + j*N] * bj;
+			}
+		}
+	}
+
+	double LU[N*N];
+	std::size_t piv[N];
+};
+
+
+/**
+   \brief LU decompositions with partial pivoting of W matrices of size
+   N x N at once.
+
+   The matrices are interleaved: element (i,j) of matrix l is at
+   (i + j*N)*W + l, and vector element i of matrix l at i*W + l. All loops
+   over the batch are innermost and vectorise. The pivot rows differ per
+   matrix, so the row swaps are gathers, but they are cheap compared to the
+   elimination.
+*/
+template <std::size_t N, std::size_t W>
+struct batched_small_lu
+{
+	/**
+	   \brief Factorises the W interleaved matrices in M.
+
+	   \param M  Pointer to N*N*W doubles.
+
+	   \returns false if any of the matrices is singular. Those are
+	            flagged in singular and give zero solutions.
+	*/
+	bool factor(const double *M)
+	{
+		for (std::size_t k = 0; k < N*N*W; ++k) LU[k] = M[k];
+		for (std::size_t l = 0; l < W; ++l) singular[l] = false;
+
+		for (std::size_t k = 0; k < N; ++k) {
+			// Find the pivots:
+			double max_val[W];
+			std::size_t p[W];
+#pragma omp simd
+			for (std::size_t l = 0; l < W; ++l) {
+				max_val[l] = std::fabs(LU[(k + k*N)*W + l]);
+				p[l] = k;
+			}
+			for (std::size_t i = k+1; i < N; ++i) {
+#pragma omp simd
+				for (std::size_t l = 0; l < W; ++l) {
+					double v = std::fabs(LU[(i + k*N)*W + l]);
+					if (v > max_val[l]) {
+						max_val[l] = v;
+						p[l] = i;
+					}
+				}
+			}
+			for (std::size_t l = 0; l < W; ++l) {
+				piv[k*W + l] = p[l];
+				if (max_val[l] == 0.0) singular[l] = true;
+				if (p[l] == k) continue;
+				for (std::size_t j = 0; j < N; ++j) {
+					double tmp = LU[(k + j*N)*W + l];
+					LU[(k + j*N)*W + l] = LU[(p[l] + j*N)*W + l];
+					LU[(p[l] + j*N)*W + l] = tmp;
+				}
+			}
+
+			double *inv_pivot = inv_diag + k*W;
+#pragma omp simd
+			for (std::size_t l = 0; l < W; ++l) {
+				double d = LU[(k + k*N)*W + l];
+				inv_pivot[l] = d == 0.0 ? 0.0 : 1.0 / d;
+			}
+			for (std::size_t i = k+1; i < N; ++i) {
+#pragma omp simd
+				for (std::size_t l = 0; l < W; ++l) {
+					LU[(i + k*N)*W + l] *= inv_pivot[l];
+				}
+			}
+			for (std::size_t j = k+1; j < N; ++j) {
+				for (std::size_t i = k+1; i < N; ++i) {
+#pragma omp simd
+					for (std::size_t l = 0; l < W; ++l) {
+						LU[(i + j*N)*W + l] -=
+							LU[(i + k*N)*W + l] *
+							LU[(k + j*N)*W + l];
+					}
+				}
+			}
+		}
+
+		for (std::size_t l = 0; l < W; ++l) {
+			if (singular[l]) return false;
+		}
+		return true;
+	}
+
+	/**
+	   \brief Solves M x = b in place for all W matrices.
+
+	   \param b  Pointer to N*W interleaved doubles. Will contain x.
+	*/
+	void solve(double *b) const
+	{
+		for (std::size_t k = 0; k < N; ++k) {
+			for (std::size_t l = 0; l < W; ++l) {
+				std::size_t p = piv[k*W + l];
+				if (p != k) {
+					double tmp = b[k*W + l];
+					b[k*W + l] = b[p*W + l];
+					b[p*W + l] = tmp;
+				}
+			}
+		}
+		// Forward substitution with unit lower triangle:
+		for (std::size_t j = 0; j < N; ++j) {
+			for (std::size_t i = j+1; i < N; ++i) {
+#pragma omp simd
+				for (std::size_t l = 0; l < W; ++l) {
+					b[i*W + l] -= LU[(i + j*N)*W + l] * b[j*W + l];
+				}
+			}
+		}
+		// Back substitution:
+		for (std::size_t jj = N; jj > 0; --jj) {
+			std::size_t j = jj - 1;
+#pragma omp simd
+			for (std::size_t l = 0; l < W; ++l) {
+				b[j*W + l] *= inv_diag[j*W + l];
+			}
+			for (std::size_t i = 0; i < j; ++i) {
+#pragma omp simd
+				for (std::size_t l = 0; l < W; ++l) {
+					b[i*W + l] -= LU[(i + j*N)*W + l] * b[j*W + l];
+				}
+			}
+		}
+	}
+
+	double LU[N*N*W];
+	double inv_diag[N*W];
+	std::size_t piv[N*W];
+	bool singular[W];
+};
+
+
+#endif // SMALL_LU_HPP
@@ -0,0 +1,294 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file step_size.hpp
+
+   \brief Contains time step size selection shared by the RK methods.
+*/
+
+#ifndef STEP_SIZE_HPP
+#define STEP_SIZE_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "arma_include.hpp"
+#include "options.hpp"
+
+
+/**
+   \brief Order to base step sizes on: the lowest of the main and the
+   embedded method, or that of the main method if there is no embedded one.
+*/
+inline int step_size_order(int order, int order2)
+{
+	return order2 > 0 ? std::min(order, order2) : order;
+}
+
+
+/**
+   \brief First guess for the initial time step size, from the scaled norms
+   d0 of y0 and d1 of f(t0,y0). See initial_dt.
+*/
+inline double initial_dt_guess(double d0, double d1, double interval)
+{
+	double dt0 = 1e-6;
+	if (d0 >= 1e-5 && d1 >= 1e-5) {
+		dt0 = 0.01 * d0 / d1;
+	}
+	return std::min(dt0, interval);
+}
+
+
+/**
+   \brief Initial time step size from the first guess dt0, the scaled norm
+   d1 of f(t0,y0) and the estimate d2 of the second derivative. See
+   initial_dt.
+*/
+inline double initial_dt_final(double dt0, double d1, double d2, int order,
+                               double interval, double max_dt)
+{
+	double d12 = std::max(d1, d2);
+	double dt1 = 0.0;
+	if (d12 <= 1e-15) {
+		dt1 = std::max(1e-6, dt0*1e-3);
+	} else {
+		dt1 = std::pow(0.01 / d12, 1.0 / (order + 1.0));
+	}
+
+	double dt = std::min(100*dt0, dt1);
+	dt = std::min(dt, interval);
+	if (max_dt > 0) dt = std::min(dt, max_dt);
+
+	return dt;
+}
+
+
+/**
+   \brief Estimates a good initial time step size.
+
+   This is the algorithm from Hairer, Norsett & Wanner (1993), Section II.4,
+   which uses f(t0,y0), one explicit Euler step and the tolerances. It costs
+   two evaluations of the RHS.
+
+   \param func       Functor of the ODE to integrate
+   \param t0         Starting time
+   \param t1         Final time
+   \param y0         Initial values
+   \param order      Order of the method (the lowest of main and embedded)
+   \param abs_tol    Absolute tolerance
+   \param rel_tol    Relative tolerance
+   \param max_dt     Maximum time step size (ignored if <= 0)
+   \param fun_evals  Is increased by the number of RHS evaluations.
+   \param abs_tols   Absolute tolerance per component. If not empty, it
+                     replaces abs_tol.
+
+   \returns an initial time step size.
+*/
+template <typename functor_type> inline
+double initial_dt(functor_type &func, double t0, double t1,
+                  const arma::vec &y0, int order,
+                  double abs_tol, double rel_tol, double max_dt,
+                  std::size_t &fun_evals,
+                  const std::vector<double> &abs_tols = std::vector<double>())
+{
+	std::size_t Neq = y0.size();
+	arma::vec sc = abs_tol + rel_tol * arma::abs(y0);
+	if (!abs_tols.empty()) {
+		assert(abs_tols.size() == Neq && "Wrong number of tolerances!");
+		for (std::size_t i = 0; i < Neq; ++i) {
+			sc(i) = abs_tols[i] + rel_tol * std::fabs(y0(i));
+		}
+	}
+	arma::vec f0 = func.fun(t0, y0);
+	++fun_evals;
+
+	double n  = Neq;
+	double d0 = std::sqrt(arma::dot(y0/sc, y0/sc) / n);
+	double d1 = std::sqrt(arma::dot(f0/sc, f0/sc) / n);
+
+	double dt0 = initial_dt_guess(d0, d1, t1 - t0);
+
+	// One explicit Euler step to estimate the second derivative:
+	arma::vec f1 = func.fun(t0 + dt0, y0 + dt0*f0);
+	++fun_evals;
+	arma::vec df = (f1 - f0) / sc;
+	double d2 = std::sqrt(arma::dot(df, df) / n) / dt0;
+
+	return initial_dt_final(dt0, d1, d2, order, t1 - t0, max_dt);
+}
+
+
+/// Systems with fewer components have their error norm computed serially.
+const std::size_t error_norm_parallel_min = 20000;
+
+
+/**
+   \brief Weighted RMS norm of an error estimate, in one pass.
+
+   Computes sqrt( sum_i (err_i / sc_i)^2 / N ), with the scale
+   sc_i = atol_i + rtol*max(|y0_i|, |y1_i|). The loop is vectorised, and
+   for large systems it is also split over OpenMP threads.
+
+   \param err    The error estimate
+   \param y0     The state at the start of the step
+   \param y1     The state at the end of the step
+   \param N      Number of components
+   \param atol   Absolute tolerance, used if atols is null
+   \param atols  Absolute tolerance per component, or null
+   \param rtol   Relative tolerance
+
+   \returns the weighted RMS norm of err.
+*/
+inline double error_norm(const double *err, const double *y0,
+                         const double *y1, std::size_t N, double atol,
+                         const double *atols, double rtol)
+{
+	if (N == 0) return 0.0;
+
+	double err_tot = 0.0;
+#pragma omp parallel for simd reduction(+:err_tot) \
+	if (N >= error_norm_parallel_min)
+	for (std::size_t i = 0; i < N; ++i) {
+		double atoli = atols ? atols[i] : atol;
+		double sci   = atoli + rtol*std::max(std::fabs(y0[i]),
+		                                     std::fabs(y1[i]));
+		double add   = err[i] / sci;
+		err_tot += add*add;
+	}
+	return std::sqrt(err_tot / N);
+}
+
+
+/**
+   \brief Weighted RMS norm of an error estimate, with the tolerances of
+   the solver options. See error_norm above.
+*/
+inline double error_norm(const arma::vec &err, const arma::vec &y0,
+                         const arma::vec &y1,
+                         const common_solver_options &solver_opts)
+{
+	const std::vector<double> &atols = solver_opts.abs_tols;
+	assert((atols.empty() || atols.size() == err.size()) &&
+	       "Wrong number of tolerances!");
+	return error_norm(err.memptr(), y0.memptr(), y1.memptr(), err.size(),
+	                  solver_opts.abs_tol,
+	                  atols.empty() ? nullptr : atols.data(),
+	                  solver_opts.rel_tol);
+}
+
+
+/**
+   \brief Proposes time step sizes from the error estimates of an embedded
+   pair. The type of controller is one of common_solver_options::
+   step_controllers. Only accepted steps enter the history, so after a
+   rejection all controllers fall back to the elementary one.
+*/
+class step_controller
+{
+public:
+	/**
+	   \brief Constructor.
+
+	   \param type        Type of controller (see common_solver_options::
+	                      step_controllers)
+	   \param order       Order of the error estimate (the lowest of main
+	                      and embedded method)
+	   \param max_growth  Maximum factor to grow dt by in one step.
+	*/
+	step_controller(int type, int order, double max_growth)
+		: fac(0.9), type(type), k(order + 1.0), max_growth(max_growth),
+		  err_old(1.0), dt_old(0.0), has_history(false),
+		  accepts(0), rejects(0), reject_streak(0), max_reject_streak(0)
+	{ }
+
+	/**
+	   \brief Proposes a new time step size.
+
+	   \param dt        The time step size that was attempted.
+	   \param err       The scaled error of the attempt (accept if <= 1).
+	   \param accepted  Whether the step was accepted.
+
+	   \returns the time step size to attempt next.
+	*/
+	double next_dt(double dt, double err, bool accepted)
+	{
+		double scale = std::pow(1.0 / err, 1.0 / k);
+
+		if (!accepted) {
+			++rejects;
+			++reject_streak;
+			max_reject_streak = std::max(max_reject_streak,
+			                             reject_streak);
+			return fac * dt * std::min(1.0, scale);
+		}
+
+		++accepts;
+		reject_streak = 0;
+
+		if (has_history) {
+			double dt_rat  = dt / dt_old;
+			double err_rat = err_old / err;
+			switch (type) {
+				default:
+				case common_solver_options::I_CONTROLLER:
+					break;
+				case common_solver_options::PI_GUSTAFSSON:
+					scale = std::pow(1.0 / err, 0.7 / k)
+						* std::pow(err_old, 0.4 / k);
+					break;
+				case common_solver_options::PREDICTIVE_GUSTAFSSON:
+					scale = std::min(scale, scale * dt_rat
+					                 * std::pow(err_rat, 1.0 / k));
+					break;
+				case common_solver_options::H211B:
+					// b = 4:
+					scale = std::pow(1.0 / err, 0.25 / k)
+						* std::pow(1.0 / err_old, 0.25 / k)
+						* std::pow(dt_rat, -0.25);
+					break;
+			}
+		}
+
+		err_old = err;
+		dt_old  = dt;
+		has_history = true;
+
+		return fac * dt * std::min(max_growth, scale);
+	}
+
+	/// Safety factor. Can be changed between steps.
+	double fac;
+
+	int type;
+	double k, max_growth;
+	double err_old, dt_old;
+	bool has_history;
+
+	/// Statistics on accepted and rejected steps.
+	std::size_t accepts, rejects, reject_streak, max_reject_streak;
+};
+
+
+#endif // STEP_SIZE_HPP
@@ -0,0 +1,92 @@
+// Tests parts of the ERK methods.
+
+#include "../arma_include.hpp"
+
+#include <catch2/catch.hpp>
+#include "erk.hpp"
+#include "test_equations.hpp"
+
+
+template <typename tableau>
+void check_static_stepper()
+{
+	using namespace erk;
+
+	solver_coeffs sc = get_coefficients(tableau::method);
+	std::cerr << "Checking " << sc.name << "\n";
+	REQUIRE( verify_solver_coeffs(sc) );
+	REQUIRE( sc.b.size() == tableau::Ns );
+	for (std::size_t i = 0; i < tableau::Ns; ++i) {
+		double ci = arma::accu(sc.A.row(i));
+		REQUIRE( ci == Approx(tableau::c[i]).margin(1e-12) );
+	}
+
+	// The unrolled stepper should give the same answer as the
+	// run-time one, up to round-off:
+	test_equations::vdpol vdp(1.0);
+	vec_type y0 = { 2.0, 0.0 };
+	solver_options so = default_solver_options();
+	so.adaptive_step_size = false;
+
+	rk_output sol_rt = erk_guts(vdp, 0.0, 2.0, y0, so, 1e-3, sc);
+	rk_output sol_st = erk_guts_static<tableau>(vdp, 0.0, 2.0, y0, so,
+	                                            1e-3);
+	REQUIRE( sol_rt.status == SUCCESS );
+	REQUIRE( sol_st.status == SUCCESS );
+	REQUIRE( sol_rt.t_vals.size() == sol_st.t_vals.size() );
+	for (std::size_t i = 0; i < sol_rt.t_vals.size(); ++i) {
+		REQUIRE( sol_rt.y_vals[i](0) ==
+		         Approx(sol_st.y_vals[i](0)).margin(1e-12) );
+		REQUIRE( sol_rt.y_vals[i](1) ==
+		         Approx(sol_st.y_vals[i](1)).margin(1e-12) );
+	}
+
+	if (tableau::order2 == 0) return;
+
+	// With adaptive time steps the steps can differ slightly:
+	so.adaptive_step_size = true;
+	so.rel_tol = so.abs_tol = 1e-8;
+	sol_rt = erk_guts(vdp, 0.0, 2.0, y0, so, 1e-3, sc);
+	sol_st = erk_guts_static<tableau>(vdp, 0.0, 2.0, y0, so, 1e-3);
+	REQUIRE( sol_rt.status == SUCCESS );
+	REQUIRE( sol_st.status == SUCCESS );
+	REQUIRE( sol_rt.y_vals.back()(0) ==
+	         Approx(sol_st.y_vals.back()(0)).margin(1e-7) );
+	REQUIRE( sol_rt.y_vals.back()(1) ==
+	         Approx(sol_st.y_vals.back()(1)).margin(1e-7) );
+}
+
+
+TEST_CASE("Unrolled steppers match the run-time ones.", "[erk_static]")
+{
+	using namespace erk::tableaux;
+
+	check_static_stepper<explicit_euler>();
+	check_static_stepper<runge_kutta_4>();
+	check_static_stepper<bogacki_shampine_32>();
+	check_static_stepper<cash_karp_54>();
+	check_static_stepper<dormand_prince_54>();
+	check_static_stepper<fehlberg_54>();
+}
+
+
+TEST_CASE("Explicit steps reuse the workspace of the integrator.",
+          "[erk_workspace]")
+{
+	using namespace erk;
+
+	test_equations::vdpol vdp(1.0);
+	vec_type y0 = { 2.0, 0.0 };
+	solver_options so = default_solver_options();
+	so.rel_tol = so.abs_tol = 1e-8;
+
+	solver_coeffs sc = get_coefficients(DORMAND_PRINCE_54);
+
+	rk_output sol_short = erk_guts(vdp, 0.0, 0.5, y0, so, 1e-3, sc);
+	rk_output sol_long  = erk_guts(vdp, 0.0, 5.0, y0, so, 1e-3, sc);
+	REQUIRE( sol_long.count.attempt > 2*sol_short.count.attempt );
+	// Only the first step sizes the workspace:
+	REQUIRE( sol_short.count.workspace_resizes > 0 );
+	REQUIRE( sol_long.count.workspace_resizes ==
+	         sol_short.count.workspace_resizes );
+}
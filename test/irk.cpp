@@ -290,3 +290,405 @@ TEST_CASE("Calculate stages for the robertson problem.", "[irk_calc_stages]")
 	
 
 }
+
+
+TEST_CASE("Diagonally implicit methods are detected and solved.", "[irk_dirk]")
+{
+	using namespace irk;
+
+	REQUIRE( is_method_sdirk(get_coefficients(IMPLICIT_EULER)) );
+	REQUIRE( !is_method_dirk(get_coefficients(RADAU_IIA_53)) );
+	REQUIRE( !is_method_dirk(get_coefficients(LOBATTO_IIIC_43)) );
+
+	for (int method : { ESDIRK_23, ESDIRK_34, SDIRK_45 }) {
+		solver_coeffs sc = get_coefficients(method);
+		std::cerr << "Checking " << sc.name << "\n";
+		REQUIRE( verify_solver_coeffs(sc) );
+		REQUIRE( is_method_dirk(sc) );
+		REQUIRE( is_method_sdirk(sc) );
+		REQUIRE( !is_method_explicit(sc) );
+
+		REQUIRE( arma::accu(sc.b)  == Approx(1.0) );
+		REQUIRE( arma::accu(sc.b2) == Approx(1.0) );
+		for (std::size_t i = 0; i < sc.c.size(); ++i) {
+			double ci = arma::accu(sc.A.row(i));
+			REQUIRE( ci == Approx(sc.c(i)).margin(1e-12) );
+		}
+
+		// The stiff test equation should be integrated accurately:
+		test_equations::stiff_eq se;
+		auto so = default_solver_options();
+		newton::options opts;
+		so.rel_tol = 1e-6;
+		so.abs_tol = 1e-6;
+		opts.tol = 0.1*so.rel_tol;
+		opts.dx_delta = 0.1*so.rel_tol;
+		so.newton_opts = &opts;
+
+		vec_type Y0 = se.sol(0.0);
+		rk_output sol = odeint(se, 0.0, 2.0, Y0, so, method, 1e-4);
+		REQUIRE( sol.status == 0 );
+		REQUIRE( sol.t_vals.size() > 0 );
+		for (std::size_t i = 0; i < sol.t_vals.size(); ++i) {
+			vec_type y_true = se.sol(sol.t_vals[i]);
+			REQUIRE( sol.y_vals[i](0) == Approx(y_true(0)).epsilon(1e-3) );
+		}
+	}
+}
+
+
+TEST_CASE("Newton failures are recovered from.", "[irk_newton_recovery]")
+{
+	using namespace irk;
+
+	test_equations::vdpol vdp(1e-3);
+	vec_type Y0 = { 2.0, 0.0 };
+
+	auto so = default_solver_options();
+	newton::options opts;
+	so.rel_tol = 1e-6;
+	so.abs_tol = 1e-6;
+	opts.tol = 1e-7;
+	// Few iterations make the Newton iteration fail regularly:
+	opts.maxit = 10;
+	so.newton_opts = &opts;
+
+	rk_output sol = odeint(vdp, 0.0, 2.0, Y0, so, RADAU_IIA_53);
+	REQUIRE( sol.status == 0 );
+	REQUIRE( sol.count.reject_newton > 0 );
+	REQUIRE( sol.count.reject_newton ==
+	         sol.count.newton_incr_diverge +
+	         sol.count.newton_iter_error_too_large +
+	         sol.count.newton_maxit_exceed );
+	// Retries at the same point should not re-evaluate J:
+	REQUIRE( sol.count.jac_evals < sol.count.attempt );
+
+	// Always evaluating J should give the same answer:
+	so.jac_reuse_contraction = 0.0;
+	rk_output sol2 = odeint(vdp, 0.0, 2.0, Y0, so, RADAU_IIA_53);
+	REQUIRE( sol2.status == 0 );
+	REQUIRE( sol2.count.newton_jac_refresh == 0 );
+	REQUIRE( sol.y_vals.back()(0) ==
+	         Approx(sol2.y_vals.back()(0)).epsilon(1e-4) );
+	REQUIRE( sol.y_vals.back()(1) ==
+	         Approx(sol2.y_vals.back()(1)).epsilon(1e-3) );
+}
+
+
+/// \brief vdpol that evaluates all stages in one call.
+struct vdpol_stages : public test_equations::vdpol
+{
+	vdpol_stages(double mu) : vdpol(mu), stage_calls(0) {}
+
+	void fun_stages(const vec_type &t, const mat_type &Y, mat_type &F)
+	{
+		++stage_calls;
+		for (std::size_t i = 0; i < Y.n_cols; ++i) {
+			F.col(i) = fun(t(i), Y.col(i));
+		}
+	}
+
+	std::size_t stage_calls;
+};
+
+
+/// \brief vdpol that may be evaluated from several threads.
+struct vdpol_thread_safe : public test_equations::vdpol
+{
+	static constexpr bool thread_safe = true;
+
+	vdpol_thread_safe(double mu) : vdpol(mu) {}
+};
+
+
+TEST_CASE("Stages can be evaluated in one call or concurrently.",
+          "[irk_stages]")
+{
+	using namespace irk;
+
+	REQUIRE( !functor_has_fun_stages<test_equations::vdpol>::value );
+	REQUIRE( functor_has_fun_stages<vdpol_stages>::value );
+	REQUIRE( !functor_is_thread_safe<test_equations::vdpol>::value );
+	REQUIRE( functor_is_thread_safe<vdpol_thread_safe>::value );
+
+	test_equations::vdpol vdp(1e-2);
+	vdpol_stages vdp_s(1e-2);
+	vdpol_thread_safe vdp_t(1e-2);
+	vec_type Y0 = { 2.0, 0.0 };
+
+	auto so = default_solver_options();
+	newton::options opts;
+	so.rel_tol = so.abs_tol = 1e-6;
+	opts.tol = 1e-7;
+	so.newton_opts = &opts;
+
+	for (int method : { RADAU_IIA_53, RADAU_IIA_137 }) {
+		rk_output sol = odeint(vdp, 0.0, 1.0, Y0, so, method);
+		rk_output sol_s = odeint(vdp_s, 0.0, 1.0, Y0, so, method);
+		so.parallel_stages = true;
+		rk_output sol_t = odeint(vdp_t, 0.0, 1.0, Y0, so, method);
+		so.parallel_stages = false;
+
+		REQUIRE( sol.status == SUCCESS );
+		REQUIRE( vdp_s.stage_calls > 0 );
+		REQUIRE( sol_s.t_vals.size() == sol.t_vals.size() );
+		REQUIRE( sol_t.t_vals.size() == sol.t_vals.size() );
+		for (std::size_t i = 0; i < 2; ++i) {
+			REQUIRE( sol_s.y_vals.back()(i) == sol.y_vals.back()(i) );
+			REQUIRE( sol_t.y_vals.back()(i) == sol.y_vals.back()(i) );
+		}
+	}
+}
+
+
+TEST_CASE("Stages can be solved with parallel iteration.", "[irk_pirk]")
+{
+	using namespace irk;
+
+	test_equations::vdpol vdp(1e-3);
+	vec_type Y0 = { 2.0, 0.0 };
+
+	auto so = default_solver_options();
+	newton::options opts;
+	so.rel_tol = so.abs_tol = 1e-6;
+	opts.tol = 1e-8;
+	so.newton_opts = &opts;
+
+	so.rel_tol = so.abs_tol = 1e-10;
+	opts.tol = 1e-11;
+	rk_output ref = odeint(vdp, 0.0, 1.0, Y0, so, RADAU_IIA_95);
+	so.rel_tol = so.abs_tol = 1e-6;
+	opts.tol = 1e-8;
+
+	for (int method : { RADAU_IIA_32, RADAU_IIA_53, RADAU_IIA_95 }) {
+		solver_coeffs sc = get_coefficients(method);
+		REQUIRE( sc.pirk_d.size() == sc.b.size() );
+
+		so.internal_solver = solver_options::NEWTON;
+		rk_output sol = odeint(vdp, 0.0, 1.0, Y0, so, method);
+		so.internal_solver = solver_options::PIRK;
+		rk_output sol_p = odeint(vdp, 0.0, 1.0, Y0, so, method);
+
+		REQUIRE( sol.status == SUCCESS );
+		REQUIRE( sol_p.status == SUCCESS );
+		REQUIRE( sol_p.t_vals.back() == Approx(1.0) );
+		for (std::size_t i = 0; i < 2; ++i) {
+			REQUIRE( sol.y_vals.back()(i) ==
+			         Approx(ref.y_vals.back()(i)).epsilon(5e-4) );
+			REQUIRE( sol_p.y_vals.back()(i) ==
+			         Approx(ref.y_vals.back()(i)).epsilon(5e-4) );
+		}
+	}
+
+	// Methods without a PIRK diagonal fall back to Newton:
+	so.quiet = true;
+	rk_output sol_l = odeint(vdp, 0.0, 1.0, Y0, so, LOBATTO_IIIC_43);
+	REQUIRE( sol_l.status == SUCCESS );
+}
+
+
+TEST_CASE("Stages can be solved with limited-memory Broyden.",
+          "[irk_broyden]")
+{
+	using namespace irk;
+
+	test_equations::vdpol vdp(1e-3);
+	vec_type Y0 = { 2.0, 0.0 };
+
+	auto so = default_solver_options();
+	newton::options opts;
+	so.newton_opts = &opts;
+
+	so.rel_tol = so.abs_tol = 1e-10;
+	opts.tol = 1e-11;
+	rk_output ref = odeint(vdp, 0.0, 1.0, Y0, so, RADAU_IIA_95);
+	so.rel_tol = so.abs_tol = 1e-6;
+	opts.tol = 1e-8;
+
+	for (int method : { RADAU_IIA_32, RADAU_IIA_53, RADAU_IIA_95 }) {
+		so.internal_solver = solver_options::NEWTON;
+		rk_output sol = odeint(vdp, 0.0, 1.0, Y0, so, method);
+		so.internal_solver = solver_options::BROYDEN;
+		rk_output sol_b = odeint(vdp, 0.0, 1.0, Y0, so, method);
+
+		REQUIRE( sol.status == SUCCESS );
+		REQUIRE( sol_b.status == SUCCESS );
+		REQUIRE( sol_b.t_vals.back() == Approx(1.0) );
+		// The Broyden updates make up for an outdated Jacobi matrix:
+		REQUIRE( sol_b.count.jac_evals < sol.count.jac_evals );
+		for (std::size_t i = 0; i < 2; ++i) {
+			REQUIRE( sol_b.y_vals.back()(i) ==
+			         Approx(ref.y_vals.back()(i)).epsilon(5e-4) );
+		}
+	}
+}
+
+
+/// \brief Kepler's problem, without Jacobi matrix.
+struct kepler
+{
+	vec_type fun(double t, const vec_type &y)
+	{
+		double r2 = y(0)*y(0) + y(1)*y(1);
+		double r3 = r2*std::sqrt(r2);
+		return { y(2), y(3), -y(0) / r3, -y(1) / r3 };
+	}
+
+	double energy(const vec_type &y) const
+	{
+		return 0.5*(y(2)*y(2) + y(3)*y(3))
+			- 1.0 / std::sqrt(y(0)*y(0) + y(1)*y(1));
+	}
+};
+
+
+TEST_CASE("Stages can be solved with accelerated fixed-point iteration.",
+          "[irk_anderson]")
+{
+	using namespace irk;
+
+	kepler func;
+	// An eccentric orbit with period 2*pi:
+	vec_type Y0 = { 0.5, 0.0, 0.0, std::sqrt(3.0) };
+	double t1 = 20.0*M_PI;
+
+	auto so = default_solver_options();
+	newton::options opts;
+	opts.tol = 1e-12;
+	opts.dx_delta = 1e-12;
+	so.newton_opts = &opts;
+	so.adaptive_step_size = false;
+
+	so.internal_solver = solver_options::NEWTON;
+	rk_output sol = odeint(func, 0.0, t1, Y0, so, GAUSS_LEGENDRE_147, 0.2);
+	so.internal_solver = solver_options::ANDERSON;
+	rk_output sol_a = odeint(func, 0.0, t1, Y0, so, GAUSS_LEGENDRE_147, 0.2);
+
+	REQUIRE( sol.status == SUCCESS );
+	REQUIRE( sol_a.status == SUCCESS );
+	REQUIRE( sol.count.jac_evals > 0 );
+	REQUIRE( sol_a.count.jac_evals == 0 );
+	REQUIRE( sol_a.t_vals.back() == Approx(t1) );
+
+	// The method is symplectic, so the energy does not drift:
+	double E0 = func.energy(Y0);
+	for (const vec_type &y : sol_a.y_vals) {
+		REQUIRE( func.energy(y) == Approx(E0).epsilon(1e-5) );
+	}
+	for (std::size_t i = 0; i < 4; ++i) {
+		REQUIRE( sol_a.y_vals.back()(i) ==
+		         Approx(sol.y_vals.back()(i)).margin(1e-7) );
+		REQUIRE( sol_a.y_vals.back()(i) == Approx(Y0(i)).margin(1e-3) );
+	}
+
+	SECTION( "Without mixing, it is plain fixed-point iteration." ){
+		opts.anderson_memory = 0;
+		rk_output sol_p = odeint(func, 0.0, t1, Y0, so, GAUSS_LEGENDRE_147,
+		                         0.2);
+		REQUIRE( sol_p.status == SUCCESS );
+		REQUIRE( sol_p.count.jac_evals == 0 );
+		for (std::size_t i = 0; i < 4; ++i) {
+			REQUIRE( sol_p.y_vals.back()(i) ==
+			         Approx(sol_a.y_vals.back()(i)).margin(1e-7) );
+		}
+	}
+}
+
+
+TEST_CASE("Stages can be solved with a single precision LU decomposition.",
+          "[irk_mixed]")
+{
+	using namespace irk;
+
+	auto so = default_solver_options();
+	newton::options opts;
+	so.newton_opts = &opts;
+	so.rel_tol = so.abs_tol = 1e-8;
+	opts.tol = 1e-10;
+
+	for (double mu : { 1.0, 1e-3 }) {
+		test_equations::vdpol vdp(mu);
+		vec_type Y0 = { 2.0, 0.0 };
+
+		for (int method : { RADAU_IIA_53, LOBATTO_IIIC_43 }) {
+			so.mixed_precision_lu = false;
+			rk_output sol = odeint(vdp, 0.0, 2.0, Y0, so, method);
+			so.mixed_precision_lu = true;
+			rk_output sol_m = odeint(vdp, 0.0, 2.0, Y0, so, method);
+
+			REQUIRE( sol.status == SUCCESS );
+			REQUIRE( sol_m.status == SUCCESS );
+			// Refinement makes up for the lower precision:
+			REQUIRE( sol_m.count.attempt <= sol.count.attempt + 2 );
+			for (std::size_t i = 0; i < 2; ++i) {
+				REQUIRE( sol_m.y_vals.back()(i) ==
+				         Approx(sol.y_vals.back()(i)).epsilon(1e-6) );
+			}
+		}
+	}
+}
+
+
+TEST_CASE("Implicit steps reuse the workspace of the integrator.",
+          "[irk_workspace]")
+{
+	using namespace irk;
+
+	auto so = default_solver_options();
+	newton::options opts;
+	so.newton_opts = &opts;
+	so.rel_tol = so.abs_tol = 1e-8;
+
+	test_equations::vdpol vdp(1.0);
+	vec_type Y0 = { 2.0, 0.0 };
+
+	for (int method : { RADAU_IIA_53, SDIRK_45 }) {
+		rk_output sol_short = odeint(vdp, 0.0, 0.5, Y0, so, method);
+		rk_output sol_long  = odeint(vdp, 0.0, 5.0, Y0, so, method);
+		REQUIRE( sol_long.count.attempt > 2*sol_short.count.attempt );
+		REQUIRE( sol_long.count.steps ==
+		         sol_long.count.attempt - sol_long.count.reject_newton
+		         - sol_long.count.reject_err );
+		// Only the first step sizes the workspace:
+		REQUIRE( sol_short.count.workspace_resizes > 0 );
+		REQUIRE( sol_long.count.workspace_resizes ==
+		         sol_short.count.workspace_resizes );
+	}
+}
+
+
+TEST_CASE("Every exit stores the final state.", "[irk_exit]")
+{
+	using namespace irk;
+
+	auto so = default_solver_options();
+	newton::options opts;
+	so.newton_opts = &opts;
+	so.rel_tol = so.abs_tol = 1e-8;
+	so.quiet = true;
+
+	test_equations::vdpol vdp(1.0);
+	vec_type Y0 = { 2.0, 0.0 };
+
+	so.max_steps = 5;
+	rk_output sol = odeint(vdp, 0.0, 5.0, Y0, so, RADAU_IIA_53);
+	REQUIRE( sol.status == ERROR_MAX_STEPS_EXCEEDED );
+	REQUIRE( !sol.t_vals.empty() );
+	REQUIRE( sol.y_vals.size() == sol.t_vals.size() );
+	REQUIRE( sol.t_vals.back() > 0.0 );
+	REQUIRE( sol.t_vals.back() < 5.0 );
+	REQUIRE( sol.count.steps == 6 );
+	REQUIRE( sol.next_dt > 0.0 );
+
+	// Newton cannot converge in one iteration:
+	so.max_steps = -1;
+	so.adaptive_step_size = false;
+	opts.maxit = 1;
+	sol = odeint(vdp, 0.0, 5.0, Y0, so, RADAU_IIA_53, 0.1);
+	REQUIRE( sol.status == GENERAL_ERROR );
+	REQUIRE( sol.t_vals.size() == 1 );
+	REQUIRE( sol.t_vals[0] == 0.0 );
+	REQUIRE( sol.y_vals[0](0) == Y0(0) );
+	REQUIRE( sol.count.steps == 0 );
+	REQUIRE( sol.next_dt == 0.1 );
+}
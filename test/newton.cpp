@@ -74,6 +74,78 @@ struct inverse_power
 };
 
 
+/// \brief A weakly nonlinear system A*x + c*x^3 = b with tridiagonal A.
+struct cubic_chain
+{
+	typedef mat_type jac_type;
+
+	cubic_chain( std::size_t N, double c ) : N(N), c(c) {}
+
+	vec_type fun( const vec_type &x )
+	{
+		vec_type F(N);
+		for( std::size_t i = 0; i < N; ++i ){
+			F(i) = 4.0*x(i) + c*x(i)*x(i)*x(i) - 1.0;
+			if( i > 0 )     F(i) -= x(i-1);
+			if( i + 1 < N ) F(i) -= x(i+1);
+		}
+		return F;
+	}
+
+	mat_type jac( const vec_type &x )
+	{
+		mat_type J(N,N);
+		J.zeros();
+		for( std::size_t i = 0; i < N; ++i ){
+			J(i,i) = 4.0 + 3.0*c*x(i)*x(i);
+			if( i > 0 )     J(i,i-1) = -1.0;
+			if( i + 1 < N ) J(i,i+1) = -1.0;
+		}
+		return J;
+	}
+
+	std::size_t N;
+	double c;
+};
+
+
+/// \brief Shifted arc tangents, for which Newton's method overshoots
+///        from far away.
+struct arctan_chain
+{
+	typedef mat_type jac_type;
+
+	explicit arctan_chain( std::size_t N ) : N(N) {}
+
+	vec_type fun( const vec_type &x )
+	{
+		vec_type F(N);
+		for( std::size_t i = 0; i < N; ++i ){
+			F(i) = std::atan( x(i) - 0.1*i );
+			if( i > 0 ) F(i) += 0.05*(x(i) - x(i-1));
+		}
+		return F;
+	}
+
+	mat_type jac( const vec_type &x )
+	{
+		mat_type J(N,N);
+		J.zeros();
+		for( std::size_t i = 0; i < N; ++i ){
+			double d = x(i) - 0.1*i;
+			J(i,i) = 1.0 / (1.0 + d*d);
+			if( i > 0 ){
+				J(i,i)   += 0.05;
+				J(i,i-1) = -0.05;
+			}
+		}
+		return J;
+	}
+
+	std::size_t N;
+};
+
+
 TEST_CASE( "Newton iteration on various functions.", "[newton_iter]" )
 {
 	SECTION( "Rosenbrock" ){
@@ -124,6 +196,120 @@ TEST_CASE( "Newton iteration on various functions.", "[newton_iter]" )
 
 
 
+TEST_CASE( "Newton iteration reuses the LU decomposition.", "[newton_iter]" )
+{
+	std::size_t N = 40;
+	cubic_chain func( N, 0.5 );
+	vec_type x0(N);
+	x0.zeros();
+
+	newton::options opts;
+	opts.dx_delta = 1e-12;
+	opts.maxit = 100;
+
+	for( bool precondition : { false, true } ){
+		opts.precondition = precondition;
+
+		newton::status frozen, fresh;
+		opts.refresh_jac = false;
+		vec_type x_frozen = newton::newton_iterate( func, x0, opts, frozen );
+		opts.refresh_jac = true;
+		vec_type x_fresh = newton::newton_iterate( func, x0, opts, fresh );
+
+		REQUIRE( frozen.conv_status == newton::SUCCESS );
+		REQUIRE( fresh.conv_status == newton::SUCCESS );
+		REQUIRE( frozen.lu_decomps == 1 );
+		REQUIRE( fresh.lu_decomps == fresh.iters );
+		REQUIRE( fresh.iters < frozen.iters );
+
+		vec_type F = func.fun( x_frozen );
+		for( std::size_t i = 0; i < N; ++i ){
+			REQUIRE( std::fabs( F(i) ) < 1e-10 );
+			REQUIRE( x_fresh(i) == Approx( x_frozen(i) ) );
+		}
+	}
+}
+
+
+
+
+
+TEST_CASE( "Globalised Newton iteration converges from far away.",
+           "[newton_iter]" )
+{
+	std::size_t N = 10;
+	arctan_chain func( N );
+	vec_type x0(N);
+	x0.fill( 3.0 );
+
+	newton::options opts;
+	opts.refresh_jac = true;
+	opts.dx_delta = 1e-12;
+	opts.maxit = 100;
+
+	newton::status plain;
+	newton::newton_iterate( func, x0, opts, plain );
+	REQUIRE( plain.conv_status != newton::SUCCESS );
+
+	for( int glob : { newton::LINE_SEARCH, newton::TRUST_REGION } ){
+		opts.globalisation = glob;
+		newton::status stats;
+		vec_type x = newton::newton_iterate( func, x0, opts, stats );
+
+		REQUIRE( stats.conv_status == newton::SUCCESS );
+		if( glob == newton::LINE_SEARCH ){
+			REQUIRE( stats.backtracks > 0 );
+		}else{
+			// Rejected steps reuse the LU decomposition:
+			REQUIRE( stats.rejected_steps > 0 );
+			REQUIRE( stats.lu_decomps < stats.iters );
+		}
+		vec_type F = func.fun( x );
+		for( std::size_t i = 0; i < N; ++i ){
+			REQUIRE( std::fabs( F(i) ) < 1e-10 );
+		}
+	}
+}
+
+
+
+
+
+TEST_CASE( "Limited-memory Broyden improves on a frozen Jacobi matrix.",
+           "[broyden_iter]" )
+{
+	std::size_t N = 40;
+	cubic_chain func( N, 2.0 );
+	vec_type x0(N);
+	x0.zeros();
+
+	// Iterate with H_0 = inv(J(x0)), with and without Broyden updates:
+	mat_type J0 = func.jac( x0 );
+	int iters[2] = { 0, 0 };
+	for( int memory : { 0, 5 } ){
+		newton::limited_broyden broyden( memory );
+		vec_type x = x0;
+		vec_type F = func.fun( x );
+		int &it = iters[memory > 0];
+		while( arma::norm( F ) > 1e-12 && it < 200 ){
+			vec_type dx = -arma::solve( J0, F );
+			if( memory > 0 ) dx = broyden.next_step( dx );
+			x += dx;
+			F = func.fun( x );
+			++it;
+		}
+		REQUIRE( arma::norm( F ) <= 1e-12 );
+		if( memory > 0 ){
+			REQUIRE( broyden.steps.size() <= 5 );
+		}
+	}
+	REQUIRE( iters[1] < iters[0] );
+}
+
+
+
+
+
 TEST_CASE( "Broyden iteration on various functions.", "[broyden_iter]" )
 {
 	SECTION( "Rosenbrock" ){
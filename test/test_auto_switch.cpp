@@ -0,0 +1,76 @@
+#include <catch2/catch.hpp>
+
+#include "auto_switch.hpp"
+#include "functor.hpp"
+
+
+/// \brief A linear problem that is only stiff for t < 1.
+struct stiff_then_not : public functor
+{
+	typedef mat_type jac_type;
+
+	double lambda(double t)
+	{
+		return t < 1.0 ? 1e4 : 1.0;
+	}
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		return { -lambda(t)*(y(0) - std::cos(t)) };
+	}
+
+	jac_type jac(double t, const vec_type &y)
+	{
+		return { -lambda(t) };
+	}
+};
+
+
+TEST_CASE("Switching between explicit and implicit methods.", "[auto_switch]")
+{
+	stiff_then_not func;
+	auto_switch::solver_options so;
+	so.rel_tol = 1e-6;
+	so.abs_tol = 1e-6;
+
+	vec_type y0 = { 1.0 };
+	auto_switch::switch_output sol =
+		auto_switch::odeint(func, 0.0, 3.0, y0, so, 1e-4);
+
+	REQUIRE( sol.status == SUCCESS );
+	REQUIRE( sol.t_vals.back() == Approx(3.0) );
+
+	// It should go stiff early and become non-stiff after t = 1:
+	REQUIRE( sol.count.switches >= 2 );
+	REQUIRE( sol.switch_to_stiff[0] );
+	REQUIRE( sol.switch_times[0] < 1.0 );
+	REQUIRE( !sol.switch_to_stiff[1] );
+	REQUIRE( sol.switch_times[1] > 1.0 );
+
+	// Both parts take steps, and each attempt is counted once:
+	REQUIRE( sol.count.erk_steps > 0 );
+	REQUIRE( sol.count.irk_steps > 0 );
+	REQUIRE( sol.count.erk_steps + sol.count.irk_steps <= sol.count.attempt );
+
+	// The time points should be increasing:
+	for (std::size_t i = 1; i < sol.t_vals.size(); ++i) {
+		REQUIRE( sol.t_vals[i] > sol.t_vals[i-1] );
+	}
+
+	// In the stiff part the solution follows cos(t) closely:
+	for (std::size_t i = 0; i < sol.t_vals.size(); ++i) {
+		double t = sol.t_vals[i];
+		if (t > 0.01 && t < 1.0) {
+			REQUIRE( sol.y_vals[i](0) == Approx(std::cos(t)).epsilon(1e-3) );
+		}
+	}
+
+	SECTION( "Limiting the number of switches." ){
+		so.max_switches = 1;
+		auto_switch::switch_output sol1 =
+			auto_switch::odeint(func, 0.0, 3.0, y0, so, 1e-4);
+		REQUIRE( sol1.status == SUCCESS );
+		REQUIRE( sol1.count.switches == 1 );
+		REQUIRE( sol1.t_vals.back() == Approx(3.0) );
+	}
+}
@@ -0,0 +1,164 @@
+#include <catch2/catch.hpp>
+
+#include "autodiff.hpp"
+#include "irk.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Dual numbers differentiate.", "[autodiff]")
+{
+	using namespace autodiff;
+	typedef dual<2> d2;
+
+	d2 x(0.7), y(-1.3);
+	x.d[0] = 1.0;
+	y.d[1] = 1.0;
+
+	d2 f = x*x*y + sin(x)/y - 2.0*exp(y) + pow(x, 2.5) + sqrt(x*x + y*y);
+	double r = std::sqrt(0.7*0.7 + 1.3*1.3);
+	REQUIRE( f.v == Approx(0.49*-1.3 + std::sin(0.7)/-1.3
+	                       - 2.0*std::exp(-1.3) + std::pow(0.7, 2.5) + r) );
+	REQUIRE( f.d[0] == Approx(2*0.7*-1.3 + std::cos(0.7)/-1.3
+	                          + 2.5*std::pow(0.7, 1.5) + 0.7/r) );
+	REQUIRE( f.d[1] == Approx(0.49 - std::sin(0.7)/(1.3*1.3)
+	                          - 2.0*std::exp(-1.3) - 1.3/r) );
+
+	d2 g = tanh(x) - log(x) + atan(y) + fabs(y) - (1.0 - x);
+	REQUIRE( g.d[0] == Approx(1.0 - std::pow(std::tanh(0.7), 2)
+	                          - 1.0/0.7 + 1.0) );
+	REQUIRE( g.d[1] == Approx(1.0/(1.0 + 1.3*1.3) - 1.0) );
+	REQUIRE( (x < y) == false );
+}
+
+
+/// \brief test_equations::vdpol, written once for any scalar type.
+struct vdpol_generic
+{
+	explicit vdpol_generic(double mu) : mu(mu) {}
+
+	template <typename T>
+	void fun_generic(double t, const std::vector<T> &y, std::vector<T> &dy)
+	{
+		dy[0] = y[1];
+		dy[1] = ((1.0 - y[0]*y[0])*y[1] - y[0]) / mu;
+	}
+
+	double mu;
+};
+
+
+/// \brief The three-body problem, written once for any scalar type.
+struct three_body_generic
+{
+	template <typename T>
+	void fun_generic(double t, const std::vector<T> &y, std::vector<T> &dy)
+	{
+		using std::sqrt;
+		for (int a = 0; a < 3; ++a) {
+			dy[2*a]     = y[6 + 2*a];
+			dy[2*a + 1] = y[7 + 2*a];
+			dy[6 + 2*a] = 0.0;
+			dy[7 + 2*a] = 0.0;
+		}
+		for (int a = 0; a < 3; ++a) {
+			for (int b = 0; b < 3; ++b) {
+				if (a == b) continue;
+				T dx = y[2*b] - y[2*a];
+				T dz = y[2*b + 1] - y[2*a + 1];
+				T r = sqrt(dx*dx + dz*dz);
+				T r3 = r*r*r;
+				dy[6 + 2*a] += dx / r3;
+				dy[7 + 2*a] += dz / r3;
+			}
+		}
+	}
+};
+
+
+TEST_CASE("Jacobi matrices from automatic differentiation are exact.",
+          "[autodiff]")
+{
+	using namespace autodiff;
+
+	REQUIRE( has_fun_generic<vdpol_generic>::value );
+	REQUIRE( !has_fun_generic<test_equations::vdpol>::value );
+
+	vdpol_generic vdp(0.3);
+	test_equations::vdpol vdp_ref(0.3);
+	ad_functor<vdpol_generic> ad_vdp(vdp);
+	vec_type y = { 1.5, -0.5 };
+	mat_type J = ad_vdp.jac(0.0, y);
+	mat_type J_ref = vdp_ref.jac(0.0, y);
+	for (std::size_t i = 0; i < 2; ++i) {
+		REQUIRE( ad_vdp.fun(0.0, y)(i) == vdp_ref.fun(0.0, y)(i) );
+		for (std::size_t j = 0; j < 2; ++j) {
+			REQUIRE( J(i,j) == Approx(J_ref(i,j)).epsilon(1e-14) );
+		}
+	}
+	REQUIRE( ad_vdp.fun_evals == 1 );
+
+	// 12 columns need two passes with 8 directions, or more for fewer:
+	three_body_generic tb;
+	ad_functor<three_body_generic> ad_tb(tb);
+	ad_functor<three_body_generic, 3> ad_tb3(tb);
+	vec_type q = { 0.0, 0.0, 1.0, 0.2, -0.4, 1.1,
+	               0.1, 0.0, -0.3, 0.2, 0.2, -0.2 };
+	mat_type J8 = ad_tb.jac(0.0, q);
+	mat_type J3 = ad_tb3.jac(0.0, q);
+	REQUIRE( ad_tb.fun_evals == 2 );
+	REQUIRE( ad_tb3.fun_evals == 4 );
+
+	std::size_t evals = 0;
+	jacobian::options opts;
+	opts.central = true;
+	vec_type f0 = ad_tb.fun(0.0, q);
+	mat_type J_fd = jacobian::fd_jacobian(ad_tb, 0.0, q, f0, opts, evals);
+	for (std::size_t i = 0; i < 12; ++i) {
+		for (std::size_t j = 0; j < 12; ++j) {
+			REQUIRE( J3(i,j) == J8(i,j) );
+			REQUIRE( J8(i,j) == Approx(J_fd(i,j)).margin(1e-7) );
+		}
+	}
+
+	SECTION( "Colouring packs a banded Jacobi matrix into one pass." ){
+		vdpol_generic vdp2(0.3);
+		jacobian::sparsity_pattern p = jacobian::dense_pattern(2);
+		ad_functor<vdpol_generic, 1> ad1(vdp2, &p);
+		mat_type J1 = ad1.jac(0.0, y);
+		REQUIRE( ad1.fun_evals == 2 );
+
+		ad_functor<vdpol_generic, 1> ad_detect(vdp2, nullptr, true);
+		mat_type J_d = ad_detect.jac(0.0, y);
+		REQUIRE( ad_detect.pattern.n_nonzero() == 4 );
+		for (std::size_t i = 0; i < 2; ++i) {
+			for (std::size_t j = 0; j < 2; ++j) {
+				REQUIRE( J1(i,j) == J(i,j) );
+				REQUIRE( J_d(i,j) == J(i,j) );
+			}
+		}
+	}
+}
+
+
+TEST_CASE("irk uses automatic differentiation without a jac.", "[autodiff]")
+{
+	vdpol_generic vdp(0.01);
+	test_equations::vdpol vdp_ref(0.01);
+	vec_type y0 = { 2.0, 0.0 };
+
+	irk::solver_options so = irk::default_solver_options();
+	newton::options n_opts;
+	so.rel_tol = so.abs_tol = 1e-8;
+	n_opts.tol = 1e-9;
+	so.newton_opts = &n_opts;
+
+	irk::rk_output ref = irk::odeint(vdp_ref, 0.0, 2.0, y0, so);
+	irk::rk_output sol = irk::odeint(vdp, 0.0, 2.0, y0, so);
+	REQUIRE( sol.status == SUCCESS );
+	REQUIRE( sol.count.jac_evals == ref.count.jac_evals );
+	REQUIRE( sol.count.attempt == ref.count.attempt );
+	for (std::size_t i = 0; i < 2; ++i) {
+		REQUIRE( sol.y_vals.back()(i) ==
+		         Approx(ref.y_vals.back()(i)).epsilon(1e-10) );
+	}
+}
@@ -0,0 +1,55 @@
+// Tests the LAPACK-backed LU decomposition.
+
+#include "../arma_include.hpp"
+
+#include <catch2/catch.hpp>
+#include "dense_lu.hpp"
+
+
+TEST_CASE("Dense LU decomposition solves linear systems.", "[dense_lu]")
+{
+	// Needs pivoting for the first column:
+	arma::mat M = { {  0.0, 1.0, -1.0, 0.5 },
+	                { -3.0, -1.0, 2.0, 0.0 },
+	                { -2.0, 1.0, 2.0, 1.0 },
+	                {  1.0, 4.0, 1.0, -2.0 } };
+	arma::vec b = { 8.0, -11.0, -3.0, 1.0 };
+	arma::vec b2 = { 1.0, 0.0, -2.0, 5.0 };
+	arma::vec x_ref  = arma::solve(M, b);
+	arma::vec x2_ref = arma::solve(M, b2);
+
+	dense_lu<double> lu;
+	REQUIRE( lu.factor(M) );
+	arma::vec x = b;
+	lu.solve(x);
+	for (std::size_t i = 0; i < 4; ++i) {
+		REQUIRE( x(i) == Approx(x_ref(i)) );
+	}
+
+	// The factors can be reused, also for several right-hand sides:
+	arma::mat B(4, 2);
+	B.col(0) = b;
+	B.col(1) = b2;
+	lu.solve(B);
+	for (std::size_t i = 0; i < 4; ++i) {
+		REQUIRE( B(i,0) == Approx(x_ref(i)) );
+		REQUIRE( B(i,1) == Approx(x2_ref(i)) );
+	}
+
+	SECTION( "Single precision." ){
+		dense_lu<float> lu_f;
+		REQUIRE( lu_f.factor(arma::conv_to<arma::fmat>::from(M)) );
+		arma::fvec xf = arma::conv_to<arma::fvec>::from(b);
+		lu_f.solve(xf);
+		for (std::size_t i = 0; i < 4; ++i) {
+			REQUIRE( xf(i) == Approx(x_ref(i)).epsilon(1e-5) );
+		}
+	}
+
+	SECTION( "Singular matrices are reported." ){
+		arma::mat S = { { 1.0, 2.0 },
+		                { 2.0, 4.0 } };
+		dense_lu<double> lu_s;
+		REQUIRE( !lu_s.factor(S) );
+	}
+}
@@ -0,0 +1,321 @@
+#include <catch2/catch.hpp>
+
+#include "ensemble.hpp"
+#include "functor.hpp"
+
+
+/// \brief Linear decay y' = -k*(y - c), with parameter k.
+struct param_decay : public functor
+{
+	param_decay() : k(1.0), c(0.0) {}
+
+	typedef mat_type jac_type;
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		return { -k*(y(0) - c) };
+	}
+
+	jac_type jac(double t, const vec_type &y)
+	{
+		return { -k };
+	}
+
+	double k, c;
+};
+
+
+struct set_rate
+{
+	void operator()(param_decay &f, double k) const
+	{
+		f.k = k;
+	}
+};
+
+
+TEST_CASE("Integrating an ensemble of parameter sets.", "[ensemble]")
+{
+	param_decay func;
+	double t1 = 2.0;
+
+	// A mix of cheap and (for an explicit method) expensive members:
+	std::vector<double> rates;
+	for (int i = 0; i < 40; ++i) {
+		rates.push_back(i % 10 == 0 ? 200.0 : 0.5 + 0.1*i);
+	}
+	std::vector<vec_type> y0s = { { 1.0 } };
+
+	ensemble::solver_options so;
+	so.rel_tol = 1e-8;
+	so.abs_tol = 1e-8;
+	so.n_threads = 4;
+
+	ensemble::ensemble_output sol =
+		ensemble::odeint(func, 0.0, t1, y0s, rates, set_rate(), so);
+
+	REQUIRE( sol.status == SUCCESS );
+	REQUIRE( sol.n_failed == 0 );
+	REQUIRE( sol.y_final.n_cols == rates.size() );
+	REQUIRE( sol.solutions.empty() );
+	for (std::size_t i = 0; i < rates.size(); ++i) {
+		REQUIRE( sol.member_status[i] == SUCCESS );
+		REQUIRE( sol.t_final[i] == Approx(t1) );
+		REQUIRE( sol.y_final(0,i) ==
+		         Approx(std::exp(-rates[i]*t1)).margin(1e-7) );
+	}
+
+	SECTION( "Results do not depend on the number of threads." ){
+		so.n_threads = 1;
+		ensemble::ensemble_output sol1 =
+			ensemble::odeint(func, 0.0, t1, y0s, rates, set_rate(), so);
+		REQUIRE( sol1.count.steals == 0 );
+		REQUIRE( sol1.count.attempt == sol.count.attempt );
+		for (std::size_t i = 0; i < rates.size(); ++i) {
+			REQUIRE( sol1.y_final(0,i) == sol.y_final(0,i) );
+			REQUIRE( sol1.member_attempts[i] == sol.member_attempts[i] );
+		}
+	}
+
+	SECTION( "Implicit members that run out of steps are reported." ){
+		so.method = irk::RADAU_IIA_53;
+		so.max_steps = 2;
+		so.quiet = true;
+		ensemble::ensemble_output sol2 =
+			ensemble::odeint(func, 0.0, t1, y0s, rates, set_rate(), so);
+		REQUIRE( sol2.status == ERROR_MAX_STEPS_EXCEEDED );
+		REQUIRE( sol2.n_failed == rates.size() );
+		for (std::size_t i = 0; i < rates.size(); ++i) {
+			REQUIRE( sol2.t_final[i] > 0.0 );
+			REQUIRE( sol2.t_final[i] < t1 );
+			REQUIRE( sol2.y_final(0,i) > 0.0 );
+		}
+	}
+
+	SECTION( "Implicit methods and full solutions." ){
+		so.method = irk::RADAU_IIA_53;
+		so.store_solutions = true;
+		ensemble::ensemble_output sol2 =
+			ensemble::odeint(func, 0.0, t1, y0s, rates, set_rate(), so);
+		REQUIRE( sol2.status == SUCCESS );
+		REQUIRE( sol2.count.jac_evals > 0 );
+		REQUIRE( sol2.solutions.size() == rates.size() );
+		for (std::size_t i = 0; i < rates.size(); ++i) {
+			const basic_output &s = sol2.solutions[i];
+			REQUIRE( s.t_vals.back() == Approx(t1) );
+			REQUIRE( s.y_vals.back()(0) == sol2.y_final(0,i) );
+			REQUIRE( sol2.y_final(0,i) ==
+			         Approx(std::exp(-rates[i]*t1)).margin(1e-6) );
+		}
+	}
+}
+
+
+TEST_CASE("Integrating an ensemble of initial values.", "[ensemble]")
+{
+	param_decay func;
+	std::vector<vec_type> y0s;
+	for (int i = 0; i < 16; ++i) {
+		y0s.push_back( { 0.25*i } );
+	}
+
+	ensemble::solver_options so;
+	so.rel_tol = 1e-8;
+	so.abs_tol = 1e-8;
+	so.n_threads = 3;
+
+	ensemble::ensemble_output sol =
+		ensemble::odeint(func, 0.0, 1.0, y0s, so);
+	REQUIRE( sol.status == SUCCESS );
+	for (std::size_t i = 0; i < y0s.size(); ++i) {
+		REQUIRE( sol.y_final(0,i) ==
+		         Approx(0.25*i*std::exp(-1.0)).margin(1e-7) );
+	}
+}
+
+
+/// \brief Van der Pol oscillator with parameter mu, also in lanes.
+struct vdpol_lanes
+{
+	vdpol_lanes() : mu{} {}
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		return { y(1), mu[0]*(1.0 - y(0)*y(0))*y(1) - y(0) };
+	}
+
+	mat_type jac(double t, const vec_type &y)
+	{
+		return { { 0.0, 1.0 },
+		         { -2.0*mu[0]*y(0)*y(1) - 1.0, mu[0]*(1.0 - y(0)*y(0)) } };
+	}
+
+	template <std::size_t W>
+	void fun_lanes(const double *t, const double *y, double *dy)
+	{
+		for (std::size_t l = 0; l < W; ++l) {
+			double x = y[l], v = y[W + l];
+			dy[l]     = v;
+			dy[W + l] = mu[l]*(1.0 - x*x)*v - x;
+		}
+	}
+
+	template <std::size_t W>
+	void jac_lanes(const double *t, const double *y, double *J)
+	{
+		for (std::size_t l = 0; l < W; ++l) {
+			double x = y[l], v = y[W + l];
+			J[l]       = 0.0;
+			J[W + l]   = -2.0*mu[l]*x*v - 1.0;
+			J[2*W + l] = 1.0;
+			J[3*W + l] = mu[l]*(1.0 - x*x);
+		}
+	}
+
+	double mu[8];
+};
+
+
+struct set_vdpol_mu
+{
+	void operator()(vdpol_lanes &f, double mu) const
+	{
+		f.mu[0] = mu;
+	}
+
+	void operator()(vdpol_lanes &f, std::size_t lane, double mu) const
+	{
+		f.mu[lane] = mu;
+	}
+};
+
+
+TEST_CASE("Integrating an ensemble in lockstep lanes.", "[ensemble_lanes]")
+{
+	typedef erk::tableaux::dormand_prince_54 dp54;
+	vdpol_lanes func;
+	std::vector<double> mus;
+	for (int i = 0; i < 21; ++i) {
+		mus.push_back(0.1 + 0.25*i);
+	}
+	std::vector<vec_type> y0s = { { 2.0, 0.0 } };
+	double t1 = 5.0;
+
+	ensemble::solver_options so;
+	so.rel_tol = 1e-9;
+	so.abs_tol = 1e-9;
+	so.n_threads = 2;
+
+	ensemble::ensemble_output ref =
+		ensemble::odeint(func, 0.0, t1, y0s, mus, set_vdpol_mu(), so);
+	REQUIRE( ref.status == SUCCESS );
+
+	ensemble::ensemble_output sol =
+		ensemble::odeint_lanes<dp54, 2, 4>(func, 0.0, t1, y0s, mus,
+		                                   set_vdpol_mu(), so);
+	REQUIRE( sol.status == SUCCESS );
+	REQUIRE( sol.n_failed == 0 );
+	for (std::size_t i = 0; i < mus.size(); ++i) {
+		REQUIRE( sol.t_final[i] == Approx(t1) );
+		REQUIRE( sol.y_final(0,i) == Approx(ref.y_final(0,i)).margin(1e-6) );
+		REQUIRE( sol.y_final(1,i) == Approx(ref.y_final(1,i)).margin(1e-6) );
+	}
+
+	SECTION( "Lanes do not interfere." ){
+		// With a different lane count and a fixed initial dt, every
+		// member takes the same steps as on its own:
+		so.dt = 1e-3;
+		so.n_threads = 1;
+		ensemble::ensemble_output sol8 =
+			ensemble::odeint_lanes<dp54, 2, 8>(func, 0.0, t1, y0s, mus,
+			                                   set_vdpol_mu(), so);
+		ensemble::ensemble_output sol1 =
+			ensemble::odeint_lanes<dp54, 2, 1>(func, 0.0, t1, y0s, mus,
+			                                   set_vdpol_mu(), so);
+		REQUIRE( sol8.status == SUCCESS );
+		for (std::size_t i = 0; i < mus.size(); ++i) {
+			REQUIRE( sol8.member_attempts[i] == sol1.member_attempts[i] );
+			REQUIRE( sol8.y_final(0,i) == Approx(sol1.y_final(0,i)) );
+			REQUIRE( sol8.y_final(1,i) == Approx(sol1.y_final(1,i)) );
+		}
+	}
+
+	SECTION( "Tolerances have to match the number of equations." ){
+		so.quiet = true;
+		so.abs_tols = { 1e-9 };
+		ensemble::ensemble_output sol2 =
+			ensemble::odeint_lanes<dp54, 2, 4>(func, 0.0, t1, y0s, mus,
+			                                   set_vdpol_mu(), so);
+		REQUIRE( sol2.status == GENERAL_ERROR );
+		REQUIRE( sol2.n_failed == mus.size() );
+	}
+
+	SECTION( "Members that run out of steps are reported." ){
+		so.max_steps = 10;
+		ensemble::ensemble_output sol2 =
+			ensemble::odeint_lanes<dp54, 2, 4>(func, 0.0, t1, y0s, mus,
+			                                   set_vdpol_mu(), so);
+		REQUIRE( sol2.status == ERROR_MAX_STEPS_EXCEEDED );
+		REQUIRE( sol2.n_failed == mus.size() );
+		REQUIRE( sol2.t_final[0] < t1 );
+	}
+}
+
+
+TEST_CASE("Lanes without FSAL only estimate dt for new members.",
+          "[ensemble_lanes]")
+{
+	typedef erk::tableaux::cash_karp_54 ck54;
+	vdpol_lanes func;
+	std::vector<double> mus = { 1.0 };
+	std::vector<vec_type> y0s = { { 2.0, 0.0 } };
+
+	ensemble::solver_options so;
+	so.rel_tol = 1e-8;
+	so.abs_tol = 1e-8;
+	so.n_threads = 1;
+
+	ensemble::ensemble_output sol =
+		ensemble::odeint_lanes<ck54, 2, 1>(func, 0.0, 5.0, y0s, mus,
+		                                   set_vdpol_mu(), so);
+	REQUIRE( sol.status == SUCCESS );
+	REQUIRE( sol.count.attempt > 10 );
+	// Every attempt evaluates all stages, and the estimate of the first
+	// dt costs one extra evaluation (its f(t0,y0) is the first stage):
+	REQUIRE( sol.count.fun_evals == ck54::Ns*sol.count.attempt + 1 );
+}
+
+
+TEST_CASE("Integrating a stiff ensemble in lockstep lanes.",
+          "[ensemble_lanes]")
+{
+	vdpol_lanes func;
+	std::vector<double> mus;
+	for (int i = 0; i < 13; ++i) {
+		mus.push_back(1.0 + 50.0*i);
+	}
+	std::vector<vec_type> y0s = { { 2.0, 0.0 } };
+	double t1 = 2.0;
+
+	ensemble::solver_options so;
+	so.method = irk::RADAU_IIA_53;
+	so.rel_tol = 1e-7;
+	so.abs_tol = 1e-7;
+	so.n_threads = 2;
+
+	ensemble::ensemble_output ref =
+		ensemble::odeint(func, 0.0, t1, y0s, mus, set_vdpol_mu(), so);
+	REQUIRE( ref.status == SUCCESS );
+
+	ensemble::ensemble_output sol =
+		ensemble::odeint_lanes_implicit<2, 3, 4>(func, 0.0, t1, y0s, mus,
+		                                         set_vdpol_mu(), so);
+	REQUIRE( sol.status == SUCCESS );
+	REQUIRE( sol.count.jac_evals > 0 );
+	for (std::size_t i = 0; i < mus.size(); ++i) {
+		REQUIRE( sol.t_final[i] == Approx(t1) );
+		REQUIRE( sol.y_final(0,i) == Approx(ref.y_final(0,i)).epsilon(1e-4) );
+		REQUIRE( sol.y_final(1,i) ==
+		         Approx(ref.y_final(1,i)).epsilon(1e-4).margin(1e-6) );
+	}
+}
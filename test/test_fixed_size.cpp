@@ -0,0 +1,167 @@
+// Tests the fixed-size code paths for small systems.
+
+#include "../arma_include.hpp"
+
+#include <catch2/catch.hpp>
+#include "erk.hpp"
+#include "irk.hpp"
+#include "small_lu.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Small LU decomposition solves linear systems.", "[small_lu]")
+{
+	arma::mat M = { {  2.0, 1.0, -1.0, 0.5 },
+	                { -3.0, -1.0, 2.0, 0.0 },
+	                { -2.0, 1.0, 2.0, 1.0 },
+	                {  0.0, 4.0, 1.0, -2.0 } };
+	arma::vec b = { 8.0, -11.0, -3.0, 1.0 };
+	arma::vec x_ref = arma::solve(M, b);
+
+	small_lu<4> lu;
+	REQUIRE( lu.factor(M.memptr()) );
+	arma::vec x = b;
+	lu.solve(x.memptr());
+	for (std::size_t i = 0; i < 4; ++i) {
+		REQUIRE( x(i) == Approx(x_ref(i)) );
+	}
+
+	arma::mat S = arma::zeros(2,2);
+	small_lu<2> lu_s;
+	REQUIRE( !lu_s.factor(S.memptr()) );
+}
+
+
+TEST_CASE("Batched LU decomposition solves many systems at once.",
+          "[small_lu]")
+{
+	const std::size_t N = 5, W = 4;
+	std::vector<arma::mat> Ms(W, arma::mat(N,N));
+	std::vector<arma::vec> bs(W, arma::vec(N));
+	for (std::size_t l = 0; l < W; ++l) {
+		for (std::size_t i = 0; i < N; ++i) {
+			bs[l](i) = std::cos(0.3 + 1.1*i + 0.5*l);
+			for (std::size_t j = 0; j < N; ++j) {
+				Ms[l](i,j) = std::sin(1.0 + 3.1*i + 1.7*j*j
+				                      + 0.37*i*j + 0.9*l);
+			}
+		}
+	}
+	// Make the last lane singular:
+	Ms[W-1].col(2).zeros();
+
+	double M[N*N*W], b[N*W];
+	for (std::size_t l = 0; l < W; ++l) {
+		for (std::size_t i = 0; i < N; ++i) {
+			b[i*W + l] = bs[l](i);
+			for (std::size_t j = 0; j < N; ++j) {
+				M[(i + j*N)*W + l] = Ms[l](i,j);
+			}
+		}
+	}
+
+	batched_small_lu<N,W> lu;
+	REQUIRE( !lu.factor(M) );
+	lu.solve(b);
+	for (std::size_t l = 0; l + 1 < W; ++l) {
+		REQUIRE( !lu.singular[l] );
+		arma::vec x_ref = arma::solve(Ms[l], bs[l]);
+		for (std::size_t i = 0; i < N; ++i) {
+			REQUIRE( b[i*W + l] == Approx(x_ref(i)) );
+		}
+	}
+	REQUIRE( lu.singular[W-1] );
+}
+
+
+// y' = lambda*y, for which I - dt*lambda*J is singular at dt = 1/lambda:
+struct linear_decay
+{
+	explicit linear_decay(double lambda) : lambda(lambda) {}
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		return lambda*y;
+	}
+
+	mat_type jac(double t, const vec_type &y)
+	{
+		return lambda*arma::eye(y.size(), y.size());
+	}
+
+	double lambda;
+};
+
+
+TEST_CASE("Fixed-size Newton reports singular stage matrices.",
+          "[fixed_size]")
+{
+	linear_decay func(4.0);
+	irk::solver_coeffs sc = irk::get_coefficients(irk::IMPLICIT_EULER);
+	vec_type y = { 1.0, 2.0 };
+	vec_type Y;
+	mat_type J;
+	newton::status stats;
+	std::size_t fun_evals = 0, jac_evals = 0;
+
+	int status = irk::newton_solve_stages_fixed<2,1>(
+		func, y, 0.0, 1.0 / func.lambda, sc, 10, 5, 1e-10, 1e-10, Y, J,
+		stats, fun_evals, jac_evals);
+	REQUIRE( status == newton::GENERIC_ERROR );
+	REQUIRE( stats.conv_status == newton::GENERIC_ERROR );
+	REQUIRE( jac_evals == 1 );
+	REQUIRE( fun_evals == 0 );
+
+	// A step size away from the singularity is solved:
+	status = irk::newton_solve_stages_fixed<2,1>(
+		func, y, 0.0, 0.1, sc, 10, 5, 1e-10, 1e-10, Y, J,
+		stats, fun_evals, jac_evals);
+	REQUIRE( status == newton::SUCCESS );
+	REQUIRE( Y(0) == Approx(0.1*func.lambda / (1.0 - 0.1*func.lambda)) );
+}
+
+
+TEST_CASE("Fixed-size integrators match the dynamic ones.", "[fixed_size]")
+{
+	test_equations::vdpol vdp(1e-2);
+	vec_type y0 = { 2.0, 0.0 };
+
+	SECTION( "Explicit methods" ){
+		erk::solver_options so = erk::default_solver_options();
+		so.rel_tol = so.abs_tol = 1e-8;
+		for (int method : { erk::BOGACKI_SHAMPINE_32,
+		                    erk::DORMAND_PRINCE_54 }) {
+			erk::rk_output sol = erk::odeint(vdp, 0.0, 0.5, y0,
+			                                 so, method);
+			erk::rk_output sol_f = erk::odeint_fixed<2>(vdp, 0.0, 0.5,
+			                                            y0, so, method);
+			REQUIRE( sol_f.status == SUCCESS );
+			REQUIRE( sol.t_vals.size() == sol_f.t_vals.size() );
+			REQUIRE( sol.y_vals.back()(0) ==
+			         Approx(sol_f.y_vals.back()(0)).margin(1e-10) );
+			REQUIRE( sol.y_vals.back()(1) ==
+			         Approx(sol_f.y_vals.back()(1)).margin(1e-10) );
+		}
+	}
+
+	SECTION( "Implicit methods" ){
+		irk::solver_options so = irk::default_solver_options();
+		newton::options opts;
+		so.rel_tol = so.abs_tol = 1e-8;
+		opts.tol = 1e-9;
+		so.newton_opts = &opts;
+		for (int method : { irk::RADAU_IIA_53, irk::LOBATTO_IIIC_43,
+		                    irk::RADAU_IIA_95, irk::SDIRK_45 }) {
+			irk::rk_output sol = irk::odeint(vdp, 0.0, 2.0, y0,
+			                                 so, method);
+			irk::rk_output sol_f = irk::odeint_fixed<2>(vdp, 0.0, 2.0,
+			                                            y0, so, method);
+			REQUIRE( sol_f.status == SUCCESS );
+			REQUIRE( sol.count.attempt == sol_f.count.attempt );
+			REQUIRE( sol.y_vals.back()(0) ==
+			         Approx(sol_f.y_vals.back()(0)).margin(1e-10) );
+			REQUIRE( sol.y_vals.back()(1) ==
+			         Approx(sol_f.y_vals.back()(1)).margin(1e-10) );
+		}
+	}
+}
@@ -0,0 +1,350 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+
+#include "irk.hpp"
+#include "jacobian.hpp"
+
+
+/// \brief A nonlinear reaction-diffusion system with a tridiagonal Jacobian.
+struct brusselator_1d
+{
+	explicit brusselator_1d(std::size_t N) : N(N) {}
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		vec_type dy(N);
+		double D = 0.02*(N + 1.0)*(N + 1.0);
+		for (std::size_t i = 0; i < N; ++i) {
+			double l = i > 0 ? y(i-1) : 1.0;
+			double r = i + 1 < N ? y(i+1) : 1.0;
+			dy(i) = D*(l - 2.0*y(i) + r) + 1.0 - 4.0*y(i) + y(i)*y(i);
+		}
+		return dy;
+	}
+
+	std::size_t N;
+};
+
+
+/// \brief The same, but with its exact Jacobi matrix.
+struct brusselator_1d_jac : public brusselator_1d
+{
+	explicit brusselator_1d_jac(std::size_t N) : brusselator_1d(N) {}
+
+	mat_type jac(double t, const vec_type &y)
+	{
+		mat_type J(N, N);
+		J.zeros();
+		double D = 0.02*(N + 1.0)*(N + 1.0);
+		for (std::size_t i = 0; i < N; ++i) {
+			J(i,i) = -2.0*D - 4.0 + 2.0*y(i);
+			if (i > 0)     J(i,i-1) = D;
+			if (i + 1 < N) J(i,i+1) = D;
+		}
+		return J;
+	}
+};
+
+
+struct brusselator_1d_thread_safe : public brusselator_1d
+{
+	static constexpr bool thread_safe = true;
+
+	explicit brusselator_1d_thread_safe(std::size_t N) : brusselator_1d(N) {}
+};
+
+
+TEST_CASE("Columns are coloured without conflicts.", "[jacobian]")
+{
+	using namespace jacobian;
+
+	std::vector<std::size_t> colours;
+	sparsity_pattern band = banded_pattern(20, 2, 1);
+	REQUIRE( band.n_nonzero() == 20 + 19 + 19 + 18 );
+	REQUIRE( colour_columns(band, colours) == 4 );
+
+	sparsity_pattern dense = dense_pattern(7);
+	REQUIRE( colour_columns(dense, colours) == 7 );
+
+	// Columns of the same colour never share a row:
+	std::size_t n_colours = colour_columns(band, colours);
+	for (std::size_t c = 0; c < n_colours; ++c) {
+		std::vector<int> hits(band.N, 0);
+		for (std::size_t j = 0; j < band.N; ++j) {
+			if (colours[j] != c) continue;
+			for (std::size_t i : band.col_rows[j]) {
+				REQUIRE( ++hits[i] == 1 );
+			}
+		}
+	}
+}
+
+
+TEST_CASE("Finite difference Jacobi matrices are accurate.", "[jacobian]")
+{
+	using namespace jacobian;
+
+	std::size_t N = 30;
+	brusselator_1d_jac func(N);
+	brusselator_1d_thread_safe func_ts(N);
+	vec_type y(N);
+	for (std::size_t i = 0; i < N; ++i) {
+		y(i) = 1.0 + 0.5*std::sin(0.3*i);
+	}
+	vec_type f0 = func.fun(0.0, y);
+	mat_type J = func.jac(0.0, y);
+
+	sparsity_pattern band = banded_pattern(N, 1, 1);
+	options opts;
+
+	for (bool central : { false, true }) {
+		opts.central = central;
+		double tol = central ? 1e-8 : 1e-5;
+
+		std::size_t evals_dense = 0, evals_band = 0, evals_par = 0;
+		opts.pattern = nullptr;
+		mat_type J_dense = fd_jacobian(func, 0.0, y, f0, opts, evals_dense);
+		opts.pattern = &band;
+		mat_type J_band = fd_jacobian(func, 0.0, y, f0, opts, evals_band);
+		opts.parallel = true;
+		mat_type J_par = fd_jacobian(func_ts, 0.0, y, f0, opts, evals_par);
+		opts.parallel = false;
+
+		REQUIRE( evals_dense == (central ? 2 : 1)*N );
+		REQUIRE( evals_band == (central ? 2 : 1)*3 );
+		REQUIRE( evals_par == evals_band );
+		for (std::size_t i = 0; i < N; ++i) {
+			for (std::size_t j = 0; j < N; ++j) {
+				double scale = std::max(1.0, std::fabs(J(i,j)));
+				REQUIRE( std::fabs(J_dense(i,j) - J(i,j)) < tol*scale );
+				REQUIRE( J_band(i,j) == J_dense(i,j) );
+				REQUIRE( J_par(i,j) == J_band(i,j) );
+			}
+		}
+	}
+}
+
+
+TEST_CASE("irk falls back to a finite difference Jacobi matrix.",
+          "[jacobian]")
+{
+	std::size_t N = 20;
+	brusselator_1d func(N);
+	brusselator_1d_jac func_jac(N);
+	vec_type y0(N);
+	for (std::size_t i = 0; i < N; ++i) {
+		y0(i) = 1.0 + std::sin(3.0*i / N);
+	}
+
+	REQUIRE( !functor_has_jac<brusselator_1d>::value );
+	REQUIRE( functor_has_jac<brusselator_1d_jac>::value );
+
+	irk::solver_options so = irk::default_solver_options();
+	newton::options n_opts;
+	so.rel_tol = so.abs_tol = 1e-7;
+	n_opts.tol = 1e-8;
+	so.newton_opts = &n_opts;
+
+	irk::rk_output ref = irk::odeint(func_jac, 0.0, 2.0, y0, so);
+	jacobian::sparsity_pattern band = jacobian::banded_pattern(N, 1, 1);
+	so.fd_jac.pattern = &band;
+	irk::rk_output sol = irk::odeint(func, 0.0, 2.0, y0, so);
+	irk::rk_output sol_fixed = irk::odeint_fixed<20>(func, 0.0, 2.0, y0, so);
+
+	REQUIRE( sol.status == SUCCESS );
+	REQUIRE( sol_fixed.status == SUCCESS );
+	REQUIRE( sol.count.jac_evals > 0 );
+	REQUIRE( sol.count.fun_evals > ref.count.fun_evals );
+	for (std::size_t i = 0; i < N; ++i) {
+		REQUIRE( sol.y_vals.back()(i) ==
+		         Approx(ref.y_vals.back()(i)).epsilon(1e-6) );
+		REQUIRE( sol_fixed.y_vals.back()(i) ==
+		         Approx(ref.y_vals.back()(i)).epsilon(1e-6) );
+	}
+}
+
+
+/// \brief Couples every component to the next two and to the first.
+struct arrow_coupling
+{
+	vec_type fun(double t, const vec_type &y)
+	{
+		std::size_t N = y.size();
+		vec_type dy(N);
+		for (std::size_t i = 0; i < N; ++i) {
+			dy(i) = -y(i);
+			if (i + 1 < N) dy(i) += y(i) * y(i+1);
+			if (i + 2 < N) dy(i) += std::sin(y(i+2));
+			if (i > 0)     dy(i) += 0.1*y(0)*y(0);
+		}
+		return dy;
+	}
+};
+
+
+TEST_CASE("Sparsity patterns are detected.", "[jacobian]")
+{
+	using namespace jacobian;
+
+	std::size_t N = 12;
+	arrow_coupling func;
+	// With zeros, y(i)*y(i+1) has a vanishing derivative at y:
+	vec_type y(N);
+	y.zeros();
+
+	std::size_t evals = 0;
+	sparsity_pattern p = detect_pattern(func, 0.0, y, evals);
+	REQUIRE( evals == 2*(N + 1) );
+	REQUIRE( p.N == N );
+	for (std::size_t j = 0; j < N; ++j) {
+		for (std::size_t i = 0; i < N; ++i) {
+			bool expect = (i == j) || (j == i + 1) || (j == i + 2)
+				|| (j == 0 && i > 0);
+			bool found = std::find(p.col_rows[j].begin(),
+			                       p.col_rows[j].end(), i)
+				!= p.col_rows[j].end();
+			REQUIRE( found == expect );
+		}
+	}
+
+	std::size_t lower, upper;
+	bandwidth(p, lower, upper);
+	REQUIRE( lower == N - 1 );
+	REQUIRE( upper == 2 );
+
+	sparsity_pattern band = banded_pattern(N, 3, 1);
+	bandwidth(band, lower, upper);
+	REQUIRE( lower == 3 );
+	REQUIRE( upper == 1 );
+
+	SECTION( "irk detects the pattern once and uses it." ){
+		std::size_t M = 40;
+		brusselator_1d bruss(M);
+		vec_type y0(M);
+		for (std::size_t i = 0; i < M; ++i) {
+			y0(i) = 1.0 + std::sin(3.0*i / M);
+		}
+		irk::solver_options so = irk::default_solver_options();
+		newton::options n_opts;
+		so.rel_tol = so.abs_tol = 1e-7;
+		n_opts.tol = 1e-8;
+		so.newton_opts = &n_opts;
+
+		irk::rk_output sol = irk::odeint(bruss, 0.0, 1.0, y0, so);
+		so.fd_jac.detect_pattern = true;
+		irk::rk_output sol_d = irk::odeint(bruss, 0.0, 1.0, y0, so);
+
+		REQUIRE( sol_d.status == SUCCESS );
+		REQUIRE( sol_d.count.jac_evals == sol.count.jac_evals );
+		REQUIRE( sol_d.count.fun_evals < sol.count.fun_evals );
+		for (std::size_t i = 0; i < M; ++i) {
+			REQUIRE( sol_d.y_vals.back()(i) ==
+			         Approx(sol.y_vals.back()(i)).epsilon(1e-6) );
+		}
+	}
+}
+
+
+/// \brief The same, but its RHS can also be evaluated for complex y.
+struct brusselator_1d_complex
+{
+	typedef mat_type jac_type;
+
+	explicit brusselator_1d_complex(std::size_t N) : N(N) {}
+
+	template <typename T>
+	arma::Col<T> rhs(const arma::Col<T> &y)
+	{
+		arma::Col<T> dy(N);
+		double D = 0.02*(N + 1.0)*(N + 1.0);
+		for (std::size_t i = 0; i < N; ++i) {
+			T l = i > 0 ? y(i-1) : T(1.0);
+			T r = i + 1 < N ? y(i+1) : T(1.0);
+			dy(i) = D*(l - 2.0*y(i) + r) + 1.0 - 4.0*y(i) + y(i)*y(i);
+		}
+		return dy;
+	}
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		return rhs(y);
+	}
+
+	arma::cx_vec fun(double t, const arma::cx_vec &y)
+	{
+		return rhs(y);
+	}
+
+	std::size_t N;
+};
+
+
+TEST_CASE("Complex step Jacobi matrices are exact.", "[jacobian]")
+{
+	using namespace jacobian;
+
+	REQUIRE( functor_has_complex_fun<brusselator_1d_complex>::value );
+	REQUIRE( !functor_has_complex_fun<brusselator_1d>::value );
+
+	std::size_t N = 30;
+	brusselator_1d_complex func(N);
+	brusselator_1d_jac func_jac(N);
+	vec_type y(N);
+	for (std::size_t i = 0; i < N; ++i) {
+		y(i) = 1.0 + 0.5*std::sin(0.3*i);
+	}
+	mat_type J = func_jac.jac(0.0, y);
+
+	options opts;
+	sparsity_pattern dense = dense_pattern(N);
+	sparsity_pattern band = banded_pattern(N, 1, 1);
+	std::size_t evals_dense = 0, evals_band = 0;
+	mat_type J_dense = cs_jacobian(func, 0.0, y, dense, colour_groups(dense),
+	                               opts, evals_dense);
+	mat_type J_band = cs_jacobian(func, 0.0, y, band, colour_groups(band),
+	                              opts, evals_band);
+	newton::newton_functor_wrapper<brusselator_1d_complex> nw(func, 0.0);
+	mat_type J_newton = newton::complex_step_jacobi_matrix(y, nw);
+
+	REQUIRE( evals_dense == N );
+	REQUIRE( evals_band == 3 );
+	for (std::size_t i = 0; i < N; ++i) {
+		for (std::size_t j = 0; j < N; ++j) {
+			double scale = std::max(1.0, std::fabs(J(i,j)));
+			REQUIRE( std::fabs(J_dense(i,j) - J(i,j)) < 1e-14*scale );
+			REQUIRE( J_band(i,j) == J_dense(i,j) );
+			REQUIRE( J_newton(i,j) == J_dense(i,j) );
+		}
+	}
+
+	SECTION( "irk uses complex steps when it can." ){
+		vec_type y0(N);
+		for (std::size_t i = 0; i < N; ++i) {
+			y0(i) = 1.0 + std::sin(3.0*i / N);
+		}
+		irk::solver_options so = irk::default_solver_options();
+		newton::options n_opts;
+		so.rel_tol = so.abs_tol = 1e-7;
+		n_opts.tol = 1e-8;
+		so.newton_opts = &n_opts;
+
+		irk::rk_output ref = irk::odeint(func_jac, 0.0, 2.0, y0, so);
+		irk::rk_output sol = irk::odeint(func, 0.0, 2.0, y0, so);
+		so.fd_jac.complex_step = false;
+		irk::rk_output sol_fd = irk::odeint(func, 0.0, 2.0, y0, so);
+
+		REQUIRE( sol.status == SUCCESS );
+		REQUIRE( sol_fd.status == SUCCESS );
+		// Exact Jacobi matrices take the same steps:
+		REQUIRE( sol.count.attempt == ref.count.attempt );
+		REQUIRE( sol.count.jac_evals == ref.count.jac_evals );
+		REQUIRE( sol.count.fun_evals ==
+		         ref.count.fun_evals + N*sol.count.jac_evals );
+		REQUIRE( sol_fd.count.fun_evals > sol.count.fun_evals );
+		for (std::size_t i = 0; i < N; ++i) {
+			REQUIRE( sol.y_vals.back()(i) ==
+			         Approx(ref.y_vals.back()(i)).epsilon(1e-10) );
+		}
+	}
+}
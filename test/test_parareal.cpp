@@ -0,0 +1,101 @@
+#include <catch2/catch.hpp>
+
+#include "parareal.hpp"
+#include "functor.hpp"
+
+
+/// \brief The Brusselator, a mildly stiff oscillator.
+struct brusselator : public functor
+{
+	brusselator() : a(1.0), b(3.0) {}
+
+	typedef mat_type jac_type;
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		double x = y(0), v = y(1);
+		return { a + x*x*v - (b + 1.0)*x, b*x - x*x*v };
+	}
+
+	jac_type jac(double t, const vec_type &y)
+	{
+		double x = y(0), v = y(1);
+		return { { 2.0*x*v - (b + 1.0), x*x },
+		         { b - 2.0*x*v, -x*x } };
+	}
+
+	double a, b;
+};
+
+
+TEST_CASE("Integrating with Parareal.", "[parareal]")
+{
+	brusselator func;
+	vec_type y0 = { 1.5, 3.0 };
+	double t1 = 10.0;
+
+	parareal::solver_options so;
+	so.rel_tol = 1e-7;
+	so.abs_tol = 1e-7;
+	so.n_slices = 8;
+	so.n_threads = 4;
+	so.coarse_method = irk::RADAU_IIA_32;
+	so.coarse_steps = 8;
+
+	irk::solver_options i_opts = irk::default_solver_options();
+	newton::options n_opts;
+	n_opts.tol = 1e-8;
+	i_opts.newton_opts = &n_opts;
+	i_opts.rel_tol = so.rel_tol;
+	i_opts.abs_tol = so.abs_tol;
+	irk::rk_output ref = irk::odeint(func, 0.0, t1, y0, i_opts,
+	                                 irk::RADAU_IIA_53);
+	REQUIRE( ref.status == SUCCESS );
+
+	parareal::parareal_output sol = parareal::odeint(func, 0.0, t1, y0, so);
+	REQUIRE( sol.status == SUCCESS );
+	REQUIRE( sol.iterations > 0 );
+	REQUIRE( sol.iterations <= so.n_slices );
+	REQUIRE( sol.corrections.size() == std::size_t(sol.iterations) );
+	REQUIRE( sol.slice_times.size() == std::size_t(so.n_slices) + 1 );
+	REQUIRE( sol.slice_y.size() == sol.slice_times.size() );
+	REQUIRE( sol.speedup > 0.0 );
+	REQUIRE( sol.count.fine_solves >= std::size_t(so.n_slices) );
+
+	REQUIRE( sol.t_vals.back() == Approx(t1) );
+	for (std::size_t i = 1; i < sol.t_vals.size(); ++i) {
+		REQUIRE( sol.t_vals[i] > sol.t_vals[i-1] );
+	}
+	REQUIRE( sol.y_vals.back()(0) == Approx(ref.y_vals.back()(0)).epsilon(1e-4) );
+	REQUIRE( sol.y_vals.back()(1) == Approx(ref.y_vals.back()(1)).epsilon(1e-4) );
+
+	SECTION( "Explicit fine propagator." ){
+		so.fine_method = erk::DORMAND_PRINCE_54;
+		parareal::parareal_output sol2 =
+			parareal::odeint(func, 0.0, t1, y0, so);
+		REQUIRE( sol2.status == SUCCESS );
+		REQUIRE( sol2.y_vals.back()(0) ==
+		         Approx(ref.y_vals.back()(0)).epsilon(1e-4) );
+	}
+
+	SECTION( "Adaptive coarse propagator." ){
+		so.coarse_method = irk::ESDIRK_23;
+		so.coarse_steps = 1;
+		so.coarse_tol = 1e-3;
+		parareal::parareal_output sol3 =
+			parareal::odeint(func, 0.0, t1, y0, so);
+		REQUIRE( sol3.status == SUCCESS );
+		REQUIRE( sol3.iterations < so.n_slices );
+		REQUIRE( sol3.slice_y.back()(0) ==
+		         Approx(ref.y_vals.back()(0)).epsilon(1e-4) );
+	}
+
+	SECTION( "Running out of iterations is reported." ){
+		so.max_iter = 1;
+		so.quiet = true;
+		parareal::parareal_output sol4 =
+			parareal::odeint(func, 0.0, t1, y0, so);
+		REQUIRE( sol4.status == GENERAL_ERROR );
+		REQUIRE( sol4.iterations == 1 );
+	}
+}
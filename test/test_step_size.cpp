@@ -0,0 +1,206 @@
+// Tests the time step size selection.
+
+#include "../arma_include.hpp"
+
+#include <catch2/catch.hpp>
+#include "erk.hpp"
+#include "irk.hpp"
+#include "step_size.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("The initial time step size is estimated.", "[initial_dt]")
+{
+	test_equations::exponential ex(-1.0);
+	vec_type y0 = { 1.0 };
+	std::size_t fun_evals = 0;
+
+	double dt = initial_dt(ex, 0.0, 10.0, y0, 4, 1e-6, 1e-6, 0.0,
+	                       fun_evals);
+	REQUIRE( fun_evals == 2 );
+	REQUIRE( dt > 1e-4 );
+	REQUIRE( dt < 1.0 );
+
+	// Tighter tolerances should give smaller steps:
+	double dt_tight = initial_dt(ex, 0.0, 10.0, y0, 4, 1e-10, 1e-10, 0.0,
+	                             fun_evals);
+	REQUIRE( dt_tight < dt );
+
+	// It should respect max_dt and the interval:
+	REQUIRE( initial_dt(ex, 0.0, 10.0, y0, 4, 1e-6, 1e-6, 1e-3,
+	                    fun_evals) <= 1e-3 );
+	REQUIRE( initial_dt(ex, 0.0, 1e-5, y0, 4, 1e-6, 1e-6, 0.0,
+	                    fun_evals) <= 1e-5 );
+
+	SECTION( "Explicit methods take fewer steps with the estimate." ){
+		erk::solver_options so = erk::default_solver_options();
+		so.rel_tol = so.abs_tol = 1e-6;
+		erk::rk_output sol_est = erk::odeint(ex, 0.0, 10.0, y0, so,
+		                                     erk::DORMAND_PRINCE_54);
+		erk::rk_output sol_small = erk::odeint(ex, 0.0, 10.0, y0, so,
+		                                       erk::DORMAND_PRINCE_54,
+		                                       1e-6);
+		REQUIRE( sol_est.status == SUCCESS );
+		REQUIRE( sol_est.y_vals.back()(0) == Approx(std::exp(-10.0)).margin(1e-5) );
+		REQUIRE( sol_est.count.attempt < sol_small.count.attempt );
+	}
+
+	SECTION( "Implicit methods work with the estimate." ){
+		test_equations::stiff_eq se;
+		irk::solver_options so = irk::default_solver_options();
+		newton::options opts;
+		so.rel_tol = so.abs_tol = 1e-6;
+		opts.tol = 0.1*so.rel_tol;
+		so.newton_opts = &opts;
+
+		vec_type Y0 = se.sol(0.0);
+		irk::rk_output sol = irk::odeint(se, 0.0, 2.0, Y0, so);
+		REQUIRE( sol.status == SUCCESS );
+		vec_type y_true = se.sol(2.0);
+		REQUIRE( sol.y_vals.back()(0) == Approx(y_true(0)).epsilon(1e-3) );
+	}
+	SECTION( "Methods without an embedded pair use the estimate too." ){
+		erk::solver_options so = erk::default_solver_options();
+		so.rel_tol = so.abs_tol = 1e-6;
+		erk::rk_output sol = erk::odeint(ex, 0.0, 1.0, y0, so,
+		                                 erk::RUNGE_KUTTA_4);
+		REQUIRE( sol.status == SUCCESS );
+		REQUIRE( sol.t_vals.back() == Approx(1.0) );
+		REQUIRE( sol.y_vals.back()(0) == Approx(std::exp(-1.0)).epsilon(1e-4) );
+
+		irk::solver_options iso = irk::default_solver_options();
+		newton::options opts;
+		iso.rel_tol = iso.abs_tol = 1e-6;
+		opts.tol = 0.1*iso.rel_tol;
+		iso.newton_opts = &opts;
+		irk::rk_output isol = irk::odeint(ex, 0.0, 1.0, y0, iso,
+		                                  irk::IMPLICIT_EULER);
+		REQUIRE( isol.status == SUCCESS );
+		REQUIRE( isol.t_vals.back() == Approx(1.0) );
+		REQUIRE( isol.y_vals.back()(0) == Approx(std::exp(-1.0)).epsilon(1e-2) );
+	}
+}
+
+
+TEST_CASE("The step size controllers behave sensibly.", "[step_controller]")
+{
+	typedef common_solver_options cso;
+	for (int type : { cso::I_CONTROLLER, cso::PI_GUSTAFSSON,
+	                  cso::PREDICTIVE_GUSTAFSSON, cso::H211B }) {
+		step_controller ctrl(type, 4, 4.0);
+
+		// Rejected steps shrink dt:
+		REQUIRE( ctrl.next_dt(1.0, 10.0, false) < 1.0 );
+		REQUIRE( ctrl.next_dt(0.5, 2.0, false) < 0.5 );
+		REQUIRE( ctrl.rejects == 2 );
+		REQUIRE( ctrl.max_reject_streak == 2 );
+
+		// Accepted steps with tiny errors grow dt, but not too much:
+		double dt = ctrl.next_dt(0.25, 1e-10, true);
+		REQUIRE( dt > 0.25 );
+		REQUIRE( dt <= 4*0.25 );
+		REQUIRE( ctrl.accepts == 1 );
+		REQUIRE( ctrl.reject_streak == 0 );
+
+		dt = ctrl.next_dt(dt, 1e-10, true);
+		REQUIRE( dt <= 4*4*0.25 );
+
+		// A step with err = 1 that is repeated should roughly stay put:
+		step_controller ctrl2(type, 4, 4.0);
+		double dt2 = 1.0;
+		for (int i = 0; i < 10; ++i) {
+			dt2 = ctrl2.next_dt(1.0, 1.0, true);
+		}
+		REQUIRE( dt2 == Approx(0.9) );
+	}
+
+	SECTION( "PI control rejects fewer steps for explicit methods." ){
+		test_equations::vdpol vdp(1.0);
+		vec_type y0 = { 2.0, 0.0 };
+		erk::solver_options so = erk::default_solver_options();
+		so.rel_tol = so.abs_tol = 1e-7;
+
+		so.step_controller = cso::I_CONTROLLER;
+		erk::rk_output sol_i = erk::odeint(vdp, 0.0, 20.0, y0, so);
+		so.step_controller = cso::PI_GUSTAFSSON;
+		erk::rk_output sol_pi = erk::odeint(vdp, 0.0, 20.0, y0, so);
+
+		REQUIRE( sol_i.status == SUCCESS );
+		REQUIRE( sol_pi.status == SUCCESS );
+		REQUIRE( sol_pi.count.reject_err < sol_i.count.reject_err );
+		REQUIRE( sol_pi.y_vals.back()(0) ==
+		         Approx(sol_i.y_vals.back()(0)).epsilon(1e-4) );
+	}
+}
+
+
+TEST_CASE("The error norm is a weighted RMS norm.", "[error_norm]")
+{
+	// Large enough to be split over threads:
+	std::size_t N = 3*error_norm_parallel_min + 7;
+	arma::vec err(N), y0(N), y1(N);
+	std::vector<double> atols(N);
+	for (std::size_t i = 0; i < N; ++i) {
+		err(i) = 1e-6*std::sin(0.1*i);
+		y0(i)  = std::cos(0.01*i);
+		y1(i)  = -0.5*y0(i) + 1e-3;
+		atols[i] = 1e-8*(1.0 + i % 5);
+	}
+
+	for (std::size_t n : { std::size_t(0), std::size_t(1),
+	                       std::size_t(17), N }) {
+		double ref = 0.0, ref_v = 0.0;
+		for (std::size_t i = 0; i < n; ++i) {
+			double ym = std::max(std::fabs(y0(i)), std::fabs(y1(i)));
+			double e  = err(i) / (1e-8 + 1e-6*ym);
+			double ev = err(i) / (atols[i] + 1e-6*ym);
+			ref   += e*e;
+			ref_v += ev*ev;
+		}
+		if (n > 0) {
+			ref   = std::sqrt(ref / n);
+			ref_v = std::sqrt(ref_v / n);
+		}
+		REQUIRE( error_norm(err.memptr(), y0.memptr(), y1.memptr(), n,
+		                    1e-8, nullptr, 1e-6) == Approx(ref) );
+		REQUIRE( error_norm(err.memptr(), y0.memptr(), y1.memptr(), n,
+		                    1e-8, atols.data(), 1e-6) == Approx(ref_v) );
+	}
+
+	SECTION( "Per-component tolerances in the integrators." ){
+		test_equations::vdpol vdp(1.0);
+		vec_type y0 = { 2.0, 0.0 };
+
+		erk::solver_options so = erk::default_solver_options();
+		so.rel_tol = so.abs_tol = 1e-7;
+		erk::rk_output sol = erk::odeint(vdp, 0.0, 5.0, y0, so);
+		// The same tolerance for all components changes nothing:
+		so.abs_tols = { 1e-7, 1e-7 };
+		erk::rk_output sol_v = erk::odeint(vdp, 0.0, 5.0, y0, so);
+		REQUIRE( sol_v.count.attempt == sol.count.attempt );
+		REQUIRE( sol_v.y_vals.back()(0) == sol.y_vals.back()(0) );
+
+		// Tightening one component makes for more steps:
+		so.abs_tols = { 1e-7, 1e-11 };
+		so.rel_tol = 1e-11;
+		erk::rk_output sol_t = erk::odeint(vdp, 0.0, 5.0, y0, so);
+		REQUIRE( sol_t.status == SUCCESS );
+		REQUIRE( sol_t.count.attempt > sol.count.attempt );
+
+		irk::solver_options iso = irk::default_solver_options();
+		newton::options opts;
+		iso.newton_opts = &opts;
+		iso.rel_tol = iso.abs_tol = 1e-7;
+		irk::rk_output isol = irk::odeint(vdp, 0.0, 5.0, y0, iso);
+		iso.abs_tols = { 1e-7, 1e-7 };
+		irk::rk_output isol_v = irk::odeint(vdp, 0.0, 5.0, y0, iso);
+		REQUIRE( isol_v.count.attempt == isol.count.attempt );
+		REQUIRE( isol_v.y_vals.back()(0) == isol.y_vals.back()(0) );
+
+		// Tolerances for the wrong number of equations are an error:
+		so.quiet = iso.quiet = true;
+		so.abs_tols = iso.abs_tols = { 1e-7, 1e-7, 1e-7 };
+		REQUIRE( erk::odeint(vdp, 0.0, 5.0, y0, so).status == GENERAL_ERROR );
+		REQUIRE( irk::odeint(vdp, 0.0, 5.0, y0, iso).status == GENERAL_ERROR );
+	}
+}
@@ -0,0 +1,95 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file workspace.hpp
+
+   \brief Preallocated temporaries for the time integrators.
+
+   The integrators take their per-step vectors and matrices from a
+   workspace that lives as long as the integration, instead of creating
+   them anew on every attempt. Every time a buffer has to be (re)sized
+   this is counted. Only resizes of the workspace are counted, not heap
+   allocations in general: the functor, the stage solvers and the stored
+   output allocate on their own.
+*/
+
+#ifndef WORKSPACE_HPP
+#define WORKSPACE_HPP
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+   \brief A fixed number of vector and matrix slots.
+
+   The slots are created up front and never move, so references to them
+   stay valid for the lifetime of the workspace.
+
+   \tparam vec_t  The vector type, vec_type or a fixed-size type.
+   \tparam mat_t  The matrix type.
+*/
+template <typename vec_t, typename mat_t>
+struct workspace
+{
+	workspace(std::size_t n_vecs, std::size_t n_mats)
+		: resizes(0), vecs(n_vecs), mats(n_mats) {}
+
+	/**
+	   \brief Returns the vector in slot i with n elements.
+
+	   Its contents are unspecified unless the size did not change.
+	*/
+	vec_t &vec(std::size_t i, std::size_t n)
+	{
+		vec_t &v = vecs[i];
+		if (v.n_elem != n) {
+			v.set_size(n);
+			++resizes;
+		}
+		return v;
+	}
+
+	/**
+	   \brief Returns the matrix in slot i with the given size.
+
+	   Its contents are unspecified unless the size did not change.
+	*/
+	mat_t &mat(std::size_t i, std::size_t n_rows, std::size_t n_cols)
+	{
+		mat_t &m = mats[i];
+		if (m.n_rows != n_rows || m.n_cols != n_cols) {
+			m.set_size(n_rows, n_cols);
+			++resizes;
+		}
+		return m;
+	}
+
+	/// Number of times a slot was (re)sized.
+	std::size_t resizes;
+
+private:
+	std::vector<vec_t> vecs;
+	std::vector<mat_t> mats;
+};
+
+
+#endif // WORKSPACE_HPP